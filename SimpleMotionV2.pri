@@ -7,6 +7,9 @@ INCLUDE_BUILT_IN_DRIVERS = 1
 #requires FTDI D2XX driver & library. benefit of this support is automatic detection of correct device and automatic low latency setting for FTDI USB serial converters
 SUPPORT_FTDI_D2XX_DRIVER = 1
 
+#if 1, then bus handles are protected with per-bus locks so that SM library may be used from several threads (see smLockBus in simplemotion.h)
+ENABLE_BUS_LOCKING = 0
+
 INCLUDEPATH += $$PWD $$PWD/utils
 DEPENDPATH += $$PWD
 
@@ -17,16 +20,25 @@ DEFINES += SIMPLEMOTIONV2_LIBRARY
 #DEFINES += ENABLE_DEBUG_PRINTS
 
 SOURCES += $$PWD/sm_consts.c $$PWD/simplemotion.c $$PWD/busdevice.c \
-    $$PWD/bufferedmotion.c $$PWD/devicedeployment.c $$PWD/utils/crc.c
+    $$PWD/bufferedmotion.c $$PWD/devicedeployment.c $$PWD/eventtrace.c $$PWD/paramcache.c $$PWD/cyclicscheduler.c $$PWD/trajectory.c \
+    $$PWD/utils/crc.c
 
 HEADERS += $$PWD/simplemotion_private.h\
     $$PWD/busdevice.h  $$PWD/simplemotion.h $$PWD/sm485.h $$PWD/simplemotion_defs.h \
-    $$PWD/bufferedmotion.h $$PWD/devicedeployment.h \
+    $$PWD/bufferedmotion.h $$PWD/devicedeployment.h $$PWD/eventtrace.h $$PWD/paramcache.h $$PWD/cyclicscheduler.h $$PWD/trajectory.h \
     $$PWD/user_options.h \
     $$PWD/simplemotion_types.h \
     $$PWD/user_options.h $$PWD/utils/crc.h
 
 
+#cyclic scheduler thread
+linux:LIBS += -lpthread
+
+greaterThan(ENABLE_BUS_LOCKING, 0+)  {
+    DEFINES += ENABLE_BUS_LOCKING
+    unix:LIBS += -lpthread
+}
+
 greaterThan(INCLUDE_BUILT_IN_DRIVERS, 0+)  {
     SOURCES += $$PWD/drivers/serial/pcserialport.c $$PWD/drivers/tcpip/tcpclient.c
     HEADERS += $$PWD/drivers/serial/pcserialport.h $$PWD/drivers/tcpip/tcpclient.h
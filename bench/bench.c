@@ -0,0 +1,336 @@
+// Throughput benchmarks against the in-process device simulator. Each benchmark
+// calls one library function repeatedly for a fixed time and reports calls/s,
+// items/s (parameters, axes or motion points per call), bus bytes/s in both
+// directions and CPU time per call. CPU time includes the simulator, which is
+// small compared to the library as it does no CRC table lookups or buffering.
+//
+// With "pty" argument the simulator runs behind a pseudo-terminal (tests/ptydevice.h)
+// and the library talks to it through the built-in serial port driver, so results
+// include termios read path and system call costs. With "tcp" it runs behind a
+// simulated gateway on loopback (tests/gatewaydevice.h) and the TCP/IP driver is
+// used. Last column is then the number of pieces the host writes of one call
+// arrived in at the device side.
+//
+// CRC16 benchmarks report bytes as items.
+//
+// Last table compares host to device bytes per parameter of smWriteParameters to
+// encoding that sends status return length and write address for every value.
+//
+// usage: bench [seconds per benchmark, default 1] [pty|tcp]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../tests/ptydevice.h"
+#include "../tests/gatewaydevice.h"
+#include "../bufferedmotion.h"
+#include "../simplemotion_private.h"
+
+#define BATCH 32
+#define AXES 8
+#define CRC_BLOCK 4096
+#define STREAM_AXES 6
+
+static smbus handle;
+static BufferedMotionAxis streamAxis[STREAM_AXES];
+static BufferedMotionStreamer streamer;
+static int usePty, useTcp;
+static BufferedMotionAxis axis;
+static smint32 captureData[1024];
+static BufferedReturnRing captureRing;
+static smint16 paramIds[BATCH];
+static smint32 paramVals[BATCH];
+static smuint8 crcData[CRC_BLOCK];
+static volatile smuint16 crcSink;
+
+static SM_STATUS benchRead1Parameter(void) {
+	smint32 value;
+	return smRead1Parameter(handle, 1, SMP_TRAJ_PLANNER_VEL, &value);
+}
+
+static SM_STATUS benchReadParameters(void) {
+	return smReadParameters(handle, 1, paramIds, paramVals, BATCH);
+}
+
+static SM_STATUS benchWriteParameters(void) {
+	return smWriteParameters(handle, 1, paramIds, paramVals, NULL, BATCH);
+}
+
+static SM_STATUS benchFastUpdateCycle(void) {
+	smuint16 read1, read2;
+	return smFastUpdateCycle(handle, 1, 100, 200, &read1, &read2);
+}
+
+static SM_STATUS benchFastUpdateCycleMultiple(void) {
+	static const smuint8 nodes[AXES] = {1, 2, 3, 4, 5, 6, 7, 8};
+	FastUpdateCycleWriteData write[AXES];
+	FastUpdateCycleReadData read[AXES];
+	memset(write, 0, sizeof(write));
+	return smFastUpdateCycleMultiple(handle, AXES, nodes, write, read, NULL);
+}
+
+static SM_STATUS benchBufferedFillAndReceive(void) {
+	static smint32 position;
+	smint32 fill[40], received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, bytesFilled;
+	int i, n;
+	for (i = 0; i < 40; i++)
+		fill[i] = position + i;
+	// small steps go as 3 byte increments, so 40 points fit in a frame
+	n = smBufferedGetMaxFillSizeForPoints(&axis, SM485_MAX_PAYLOAD_BYTES, 40, fill);
+	position += n;
+	return smBufferedFillAndReceive(&axis, n, fill, &numReceived, received, &bytesFilled);
+}
+
+// same with return data going directly to a ring that is consumed every call, like feedback capture
+static SM_STATUS benchBufferedFillAndReceiveToRing(void) {
+	static smint32 position;
+	smint32 fill[40], numReceived, bytesFilled;
+	int i, n;
+	SM_STATUS stat;
+	for (i = 0; i < 40; i++)
+		fill[i] = position + i;
+	n = smBufferedGetMaxFillSizeForPoints(&axis, SM485_MAX_PAYLOAD_BYTES, 40, fill);
+	position += n;
+	stat = smBufferedFillAndReceiveToRing(&axis, n, fill, &captureRing, &numReceived, &bytesFilled);
+	smBufferedReturnRingConsume(&captureRing, captureRing.count);
+	return stat;
+}
+
+// one cycle of 6 axis contouring: free space query and fill of every axis, first one axis at a time and then with streamer
+static SM_STATUS benchBufferedAxesSerially(void) {
+	static smint32 position;
+	smint32 fill[30], received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, bytesFilled, freeBytes;
+	SM_STATUS stat = SM_OK;
+	int a, i, n;
+	for (a = 0; a < STREAM_AXES; a++) {
+		stat |= smBufferedGetFreeEstimate(&streamAxis[a], &freeBytes);
+		n = smBufferedGetMaxFillSize(&streamAxis[a], freeBytes);
+		for (i = 0; i < n; i++)
+			fill[i] = position++;
+		stat |= smBufferedFillAndReceive(&streamAxis[a], n, fill, &numReceived, received, &bytesFilled);
+	}
+	return stat;
+}
+
+static SM_STATUS benchBufferedStreamer(void) {
+	static smint32 position;
+	static smint32 fill[STREAM_AXES][30], received[STREAM_AXES][SM_BUFFERED_MAX_RETURN_POINTS];
+	smint32 *fillPtr[STREAM_AXES], *receivedPtr[STREAM_AXES], numReceived[STREAM_AXES], n;
+	SM_STATUS stat;
+	int a, i;
+	stat = smBufferedStreamerGetFree(&streamer, &n);
+	for (a = 0; a < STREAM_AXES; a++) {
+		for (i = 0; i < n; i++)
+			fill[a][i] = position++;
+		fillPtr[a] = fill[a];
+		receivedPtr[a] = received[a];
+	}
+	return stat | smBufferedStreamerFillAndReceive(&streamer, n, fillPtr, numReceived, receivedPtr);
+}
+
+// CRC over largest frame, over a firmware or capture sized block and byte by byte for comparison
+static SM_STATUS benchCRC16Frame(void) {
+	crcSink = calcCRC16BufWithInit(crcData, SM485_MAX_PAYLOAD_BYTES + 3, SM485_CRCINIT);
+	return SM_OK;
+}
+
+static SM_STATUS benchCRC16Block(void) {
+	crcSink = calcCRC16BufWithInit(crcData, CRC_BLOCK, SM485_CRCINIT);
+	return SM_OK;
+}
+
+static SM_STATUS benchCRC16Bytewise(void) {
+	smuint16 crc = SM485_CRCINIT;
+	int i;
+	for (i = 0; i < CRC_BLOCK; i++)
+		crc = calcCRC16(crcData[i], crc);
+	crcSink = crc;
+	return SM_OK;
+}
+
+// smWriteParameters encoding before it omitted repeated subpackets, for the bytes per parameter comparison:
+// status return length set in every packet and write address sent before every value
+static SM_STATUS writeParametersEveryAddress(const smint16 *ids, const smint32 *vals, int num) {
+	SM_STATUS stat = SM_OK;
+	smint32 ret;
+	int i = 0, first, r;
+	while (i < num) {
+		int txBytes = 2 + 3;
+		stat |= smAppendSMCommandToQueue(handle, SM_SET_WRITE_ADDRESS, SMP_RETURN_PARAM_LEN);
+		stat |= smAppendSMCommandToQueue(handle, SM_WRITE_VALUE_24B, SM_RETURN_STATUS);
+		for (first = i; i < num; i++) {
+			smbool fits24b = (vals[i] >= -(1L << 21) && vals[i] < (1L << 21)) ? smtrue : smfalse;
+			int needTx = 2 + (fits24b == smtrue ? 3 : 4);
+			if (txBytes + needTx > SM485_MAX_PAYLOAD_BYTES)
+				break;
+			stat |= smAppendSMCommandToQueue(handle, SM_SET_WRITE_ADDRESS, ids[i]);
+			stat |= smAppendSMCommandToQueue(handle, fits24b == smtrue ? SM_WRITE_VALUE_24B : SM_WRITE_VALUE_32B, vals[i]);
+			txBytes += needTx;
+		}
+		stat |= smExecuteCommandQueue(handle, 1);
+		stat |= smGetQueuedSMCommandReturnValue(handle, &ret);
+		for (r = first; r < i; r++) {
+			stat |= smGetQueuedSMCommandReturnValue(handle, &ret);
+			stat |= smGetQueuedSMCommandReturnValue(handle, &ret);
+		}
+	}
+	return stat;
+}
+
+// host to device bytes per parameter written, including packet headers
+static double writeBytesPerParameter(smbool everyAddress, const smint16 *ids, const smint32 *vals, int num) {
+	SM_STATUS stat;
+	simDevice.bytesWritten = 0;
+	if (everyAddress == smtrue)
+		stat = writeParametersEveryAddress(ids, vals, num);
+	else
+		stat = smWriteParameters(handle, 1, ids, vals, NULL, num);
+	if (stat != SM_OK) {
+		fprintf(stderr, "writing parameters failed (%d)\n", (int)getCumulativeStatus(handle));
+		exit(1);
+	}
+	return (double)simDevice.bytesWritten / num;
+}
+
+// compares smWriteParameters to the encoding above. consecutive addresses encode the same, as protocol has no
+// write address auto increment, savings come from repeated address and status preamble sent once per call
+static void writeParametersBytes(void) {
+	static const char *names[] = {"consecutive 260-269 x10", "distinct 3000-3031 x32", "same address x32"};
+	smint16 ids[BATCH];
+	int c, i, num;
+	printf("\n%-30s %12s %12s\n", "smWriteParameters bytes/param", "every addr", "current");
+	for (c = 0; c < 3; c++) {
+		num = c == 0 ? 10 : BATCH;
+		for (i = 0; i < num; i++)
+			ids[i] = c == 0 ? SMP_TORQUE_BIQUAD_FILTER1_B0 + i : c == 1 ? paramIds[i] : paramIds[0];
+		printf("%-30s %12.1f %12.1f\n", names[c], writeBytesPerParameter(smtrue, ids, paramVals, num),
+		       writeBytesPerParameter(smfalse, ids, paramVals, num));
+	}
+}
+
+typedef struct {
+	const char *name;
+	SM_STATUS (*call)(void);
+	int itemsPerCall;
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+	{"smRead1Parameter", benchRead1Parameter, 1},
+	{"smReadParameters x32", benchReadParameters, BATCH},
+	{"smWriteParameters x32", benchWriteParameters, BATCH},
+	{"smFastUpdateCycle", benchFastUpdateCycle, 1},
+	{"smFastUpdateCycleMultiple x8", benchFastUpdateCycleMultiple, AXES},
+	{"smBufferedFillAndReceive x40", benchBufferedFillAndReceive, 40},
+	{"buffered fill to ring x40", benchBufferedFillAndReceiveToRing, 40},
+	{"buffered 6 axes serially x30", benchBufferedAxesSerially, STREAM_AXES * 30},
+	{"smBufferedStreamer 6 axes x30", benchBufferedStreamer, STREAM_AXES * 30},
+	{"CRC16 123 bytes", benchCRC16Frame, SM485_MAX_PAYLOAD_BYTES + 3},
+	{"CRC16 4096 bytes", benchCRC16Block, CRC_BLOCK},
+	{"CRC16 4096 bytes bytewise", benchCRC16Bytewise, CRC_BLOCK},
+};
+
+static double seconds(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const Benchmark *b, double duration) {
+	double wallStart, cpuStart, wall, cpu;
+	long calls = 0, bytes;
+
+	simDevice.bytesRead = 0;
+	simDevice.bytesWritten = 0;
+	ptyDevice.masterReads = 0;
+	gatewayDevice.clientReads = 0;
+	wallStart = seconds(CLOCK_MONOTONIC);
+	cpuStart = seconds(CLOCK_PROCESS_CPUTIME_ID);
+	do {
+		int i;
+		for (i = 0; i < 64; i++, calls++) {
+			if (b->call() != SM_OK) {
+				fprintf(stderr, "%s failed (%d)\n", b->name, (int)getCumulativeStatus(handle));
+				exit(1);
+			}
+		}
+		wall = seconds(CLOCK_MONOTONIC) - wallStart;
+	} while (wall < duration);
+	cpu = seconds(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+	bytes = (long)simDevice.bytesRead + simDevice.bytesWritten;
+
+	printf("%-30s %12.0f %12.0f %12.0f %10.3f", b->name, calls / wall, calls * b->itemsPerCall / wall,
+	       bytes / wall, cpu / calls * 1e6);
+	if (usePty || useTcp)
+		printf(" %10.2f", (double)(ptyDevice.masterReads + gatewayDevice.clientReads) / calls);
+	printf("\n");
+}
+
+int main(int argc, char **argv) {
+	double duration = argc > 1 ? atof(argv[1]) : 1.0;
+	unsigned i;
+
+	usePty = argc > 2 && strcmp(argv[2], "pty") == 0;
+	useTcp = argc > 2 && strcmp(argv[2], "tcp") == 0;
+	if (usePty) {
+		if (ptyDeviceStart() != 0) {
+			fprintf(stderr, "no pseudo-terminals available\n");
+			return 1;
+		}
+		handle = smOpenBus(ptyDevice.slavePath);
+	} else if (useTcp) {
+		char name[32];
+		if (gatewayDeviceStart(0) != 0) {
+			fprintf(stderr, "no loopback networking available\n");
+			return 1;
+		}
+		snprintf(name, sizeof(name), "127.0.0.1:%d", gatewayDevice.port);
+		handle = smOpenBus(name);
+	} else {
+		handle = simOpenBus();
+	}
+	if (handle < 0 || duration <= 0) {
+		fprintf(stderr, "usage: bench [seconds per benchmark] [pty|tcp]\n");
+		return 1;
+	}
+	for (i = 0; i < BATCH; i++) {
+		paramIds[i] = 3000 + i;
+		paramVals[i] = i * 1000;
+	}
+	for (i = 0; i < CRC_BLOCK; i++)
+		crcData[i] = (smuint8)(i * 131 + 7);
+	smBufferedReturnRingInit(&captureRing, captureData, 1024);
+	// 16 bit return data so that return data of 40 points fits in a reply
+	if (smBufferedInit(&axis, handle, 9, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_16B) != SM_OK) {
+		fprintf(stderr, "smBufferedInit failed\n");
+		return 1;
+	}
+	axis.incrementalSetpoints = smtrue;
+	{
+		BufferedMotionAxis *axes[STREAM_AXES];
+		for (i = 0; i < STREAM_AXES; i++) {
+			if (smBufferedInit(&streamAxis[i], handle, 10 + i, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) != SM_OK) {
+				fprintf(stderr, "smBufferedInit failed\n");
+				return 1;
+			}
+			axes[i] = &streamAxis[i];
+		}
+		smBufferedStreamerInit(&streamer, STREAM_AXES, axes);
+	}
+
+	printf("%-30s %12s %12s %12s %10s%s\n", "benchmark", "calls/s", "items/s", "bytes/s", "cpu us",
+	       usePty || useTcp ? "     pieces" : "");
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+		run(&benchmarks[i], duration);
+	writeParametersBytes();
+
+	smBufferedDeinit(&axis);
+	for (i = 0; i < STREAM_AXES; i++)
+		smBufferedDeinit(&streamAxis[i]);
+	smCloseBus(handle);
+	if (usePty)
+		ptyDeviceStop();
+	if (useTcp)
+		gatewayDeviceStop();
+	return 0;
+}
@@ -0,0 +1,58 @@
+// Standalone simulated TCP/IP SimpleMotion gateway (tests/gatewaydevice.h) for
+// trying out applications and the TCP/IP driver without hardware. Listens on
+// 127.0.0.1 until interrupted and answers as nodes 1..nodes of a bus behind a
+// gateway. Connect with smOpenBus("127.0.0.1:4001").
+//
+// usage: gateway [-p port] [-n nodes] [-l latency us] [-j jitter us] [-s split bytes] [-g gap us]
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include "../tests/gatewaydevice.h"
+
+static volatile sig_atomic_t stop;
+
+static void onSignal(int sig) {
+	(void)sig;
+	stop = 1;
+}
+
+int main(int argc, char **argv) {
+	int port = 4001, nodes = 0, latency = 0, jitter = 0, split = 0, gap = 0, opt;
+
+	while ((opt = getopt(argc, argv, "p:n:l:j:s:g:")) != -1) {
+		switch (opt) {
+		case 'p': port = atoi(optarg); break;
+		case 'n': nodes = atoi(optarg); break;
+		case 'l': latency = atoi(optarg); break;
+		case 'j': jitter = atoi(optarg); break;
+		case 's': split = atoi(optarg); break;
+		case 'g': gap = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: gateway [-p port] [-n nodes] [-l latency us] [-j jitter us] [-s split bytes] [-g gap us]\n");
+			return 1;
+		}
+	}
+
+	if (gatewayDeviceStart((unsigned short)port) != 0) {
+		perror("gateway");
+		return 1;
+	}
+	simDevice.numNodes = nodes;
+	gatewayDevice.latencyUs = latency;
+	gatewayDevice.jitterUs = jitter;
+	gatewayDevice.maxChunk = split;
+	gatewayDevice.chunkGapUs = gap;
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	printf("listening on 127.0.0.1:%d\n", gatewayDevice.port);
+	fflush(stdout);
+	while (!stop)
+		pause();
+
+	gatewayDeviceStop();
+	printf("%d connections, %d frames\n", gatewayDevice.connections, simDevice.framesReceived);
+	return 0;
+}
@@ -1,9 +1,16 @@
+#include <string.h>
 #include "simplemotion.h"
 #include "user_options.h"
 #include "simplemotion_private.h"
 #include "bufferedmotion.h"
 #include "sm485.h"
 
+//range of SM_WRITE_VALUE_24B value
+#define SM_BUFFERED_INCREMENT_MIN (-(1<<21))
+#define SM_BUFFERED_INCREMENT_MAX ((1<<21)-1)
+//points in a row that must fit as increments before write address is changed to SMP_INCREMENTAL_SETPOINT
+#define SM_BUFFERED_INCREMENT_RUN 4
+
 /** initialize buffered motion for one axis with address and samplerate (Hz) */
 SM_STATUS smBufferedInit(BufferedMotionAxis *newAxis, smbus handle, smaddr deviceAddress, smint32 sampleRate, smint16 readParamAddr, smuint8 readDataLength )
 {
@@ -25,12 +32,25 @@ SM_STATUS smBufferedInit(BufferedMotionAxis *newAxis, smbus handle, smaddr devic
     newAxis->driveFlagsModifiedAtInit=smfalse;
     newAxis->deviceCapabilityFlags1=0;
     newAxis->deviceCapabilityFlags2=0;
+    newAxis->bufferBytesInUse=0;
+    newAxis->bufferReturnLagBytes=0;
+    newAxis->freeSpaceEstimateValid=smfalse;
+    newAxis->freeSpaceResyncInterval=SM_BUFFERED_FREE_SPACE_RESYNC_INTERVAL;
+    newAxis->cyclesSinceFreeSpaceResync=0;
+    newAxis->incrementalSetpoints=smfalse;
+    newAxis->writingIncrements=smfalse;
+    newAxis->writeAddressKnown=smfalse;
+    newAxis->lastSetpointKnown=smfalse;
+    newAxis->lastSetpoint=0;
+    newAxis->returnFifoHead=0;
+    newAxis->returnFifoLen=0;
 
     //discard any existing data in buffer, and to get correct reading of device buffer size
     smSetParameter( newAxis->bushandle, newAxis->deviceAddress, SMP_SYSTEM_CONTROL,SMP_SYSTEM_CONTROL_ABORTBUFFERED);
 
     //after abort, we can read the maximum size of data in device buffer
-    smRead2Parameters(newAxis->bushandle,newAxis->deviceAddress,SMP_BUFFER_FREE_BYTES,&newAxis->bufferLength,SMP_SM_VERSION,&newAxis->smProtocolVersion);
+    if(smRead2Parameters(newAxis->bushandle,newAxis->deviceAddress,SMP_BUFFER_FREE_BYTES,&newAxis->bufferLength,SMP_SM_VERSION,&newAxis->smProtocolVersion)==SM_OK)
+        newAxis->freeSpaceEstimateValid=smtrue;//buffer is empty now
     newAxis->bufferFreeBytes=newAxis->bufferLength;
 
     if(smRead1Parameter(handle,deviceAddress,SMP_DRIVE_FLAGS,&newAxis->driveFlagsBeforeInit)!=SM_OK)
@@ -99,6 +119,50 @@ SM_STATUS smBufferedRunAndSyncClocks(BufferedMotionAxis *axis)
     return smGetBufferClock( axis->bushandle, axis->deviceAddress, &axis->driveClock );
 }
 
+//set free space that was read from device and resync the free space estimate with it
+static void smBufferedSetFree( BufferedMotionAxis *axis, smint32 freebytes )
+{
+    smint32 used=axis->bufferLength-freebytes;
+
+    if(axis->freeSpaceEstimateValid==smtrue && used>axis->bufferBytesInUse)
+        smDebug(axis->bushandle,SMDebugLow,"Buffered motion: device %d has %d bytes in buffer, estimated at most %d\n",
+                (int)axis->deviceAddress,(int)used,(int)axis->bufferBytesInUse);
+
+    //commands that have been executed but whose return data hasn't been received make the difference. their return data must not reduce used bytes again
+    axis->bufferReturnLagBytes=axis->freeSpaceEstimateValid==smtrue && axis->bufferBytesInUse>used ? axis->bufferBytesInUse-used : 0;
+    axis->bufferBytesInUse=used;
+    axis->freeSpaceEstimateValid=smtrue;
+    axis->cyclesSinceFreeSpaceResync=0;
+
+    axis->bufferFreeBytes=freebytes;
+    axis->bufferFill=100*(axis->bufferLength-freebytes)/axis->bufferLength;//calc buffer fill 0-100%
+}
+
+//update estimate when return data of a command that used numBytes of buffer has been received
+static void smBufferedNoteExecuted( BufferedMotionAxis *axis, smint32 numBytes )
+{
+    if(axis->bufferReturnLagBytes>=numBytes)
+    {
+        axis->bufferReturnLagBytes-=numBytes;
+        return;
+    }
+    numBytes-=axis->bufferReturnLagBytes;
+    axis->bufferReturnLagBytes=0;
+
+    axis->bufferBytesInUse-=numBytes;
+    if(axis->bufferBytesInUse<0)//more return data than commands filled, something has been lost
+    {
+        axis->bufferBytesInUse=0;
+        axis->freeSpaceEstimateValid=smfalse;
+    }
+}
+
+//true if smBufferedGetFreeEstimate of axis would read free space from device
+static smbool smBufferedFreeSpaceResyncNeeded( BufferedMotionAxis *axis )
+{
+    return axis->freeSpaceEstimateValid==smfalse || axis->cyclesSinceFreeSpaceResync>=axis->freeSpaceResyncInterval;
+}
+
 SM_STATUS smBufferedGetFree(BufferedMotionAxis *axis, smint32 *numBytesFree )
 {
     smint32 freebytes;
@@ -106,17 +170,29 @@ SM_STATUS smBufferedGetFree(BufferedMotionAxis *axis, smint32 *numBytesFree )
     if(smRead1Parameter(axis->bushandle,axis->deviceAddress,SMP_BUFFER_FREE_BYTES,&freebytes)!=SM_OK)
     {
         *numBytesFree=0;//read has failed, assume 0
+        axis->freeSpaceEstimateValid=smfalse;
         return getCumulativeStatus(axis->bushandle);
     }
 
-    axis->bufferFreeBytes=freebytes;
-    axis->bufferFill=100*(axis->bufferLength-freebytes)/axis->bufferLength;//calc buffer fill 0-100%
-
+    smBufferedSetFree(axis,freebytes);
     *numBytesFree=freebytes;
 
     return getCumulativeStatus(axis->bushandle);
 }
 
+SM_STATUS smBufferedGetFreeEstimate(BufferedMotionAxis *axis, smint32 *numBytesFree )
+{
+    if(smBufferedFreeSpaceResyncNeeded(axis)==smtrue)
+        return smBufferedGetFree(axis,numBytesFree);
+
+    axis->cyclesSinceFreeSpaceResync++;
+    axis->bufferFreeBytes=axis->bufferLength-axis->bufferBytesInUse;
+    axis->bufferFill=100*axis->bufferBytesInUse/axis->bufferLength;
+    *numBytesFree=axis->bufferFreeBytes;
+
+    return getCumulativeStatus(axis->bushandle);
+}
+
 smint32 smBufferedGetMaxFillSize(BufferedMotionAxis *axis, smint32 numBytesFree )
 {
     //even if we have lots of free space in buffer, we can only send up to SM485_MAX_PAYLOAD_BYTES bytes at once in one SM transmission
@@ -125,8 +201,8 @@ smint32 smBufferedGetMaxFillSize(BufferedMotionAxis *axis, smint32 numBytesFree
 
     //calculate number of points that can be uploaded to buffer (max size SM485_MAX_PAYLOAD_BYTES bytes and fill consumption is 2+4+2+3*(n-1) bytes)
     if(axis->readParamInitialized==smtrue)
-        //*numPoints=(freebytes-2-4-2)/3+1;
-        return numBytesFree/4;
+        //worst case is that all points are absolute and write address must be changed back to absolute setpoint first
+        return (numBytesFree-(axis->writingIncrements==smtrue || axis->writeAddressKnown==smfalse ? 2 : 0))/4;
     else
         //*numPoints=(freebytes-2-4-2 -2-2-2-2)/3+1;//if read data uninitialized, it takes extra 8 bytes to init on next fill, so reduce it here
         return (numBytesFree-2-3-2-3-2)/4;//if read data uninitialized, it takes extra n bytes to init on next fill, so reduce it here
@@ -136,102 +212,488 @@ smint32 smBufferedGetBytesConsumed(BufferedMotionAxis *axis, smint32 numFillPoin
 {
     //calculate number of bytes that the number of fill points will consume from buffer
     if(axis->readParamInitialized==smtrue)
-        return numFillPoints*4;
+        return numFillPoints*4 + (numFillPoints>0 && (axis->writingIncrements==smtrue || axis->writeAddressKnown==smfalse) ? 2 : 0);
     else
         return numFillPoints*4 +2+3+2+3+2;//if read data uninitialized, it takes extra n bytes to init on next fill, so reduce it here
 }
 
+//add kind of command that was appended to device buffer to return data FIFO
+static void smBufferedPushReturnKind( BufferedMotionAxis *axis, smuint8 kind )
+{
+    int tail=(axis->returnFifoHead+axis->returnFifoLen-1)%SM_BUFFERED_RETURN_FIFO_LEN;
 
-SM_STATUS smBufferedFillAndReceive(BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *numReceivedPoints, smint32 *receivedPoints, smint32 *bytesFilled )
+    if(axis->returnFifoLen>0 && axis->returnFifoKind[tail]==kind && axis->returnFifoCount[tail]<0xffff)
+        axis->returnFifoCount[tail]++;
+    else if(axis->returnFifoLen<SM_BUFFERED_RETURN_FIFO_LEN)//encoder keeps enough entries free for this
+    {
+        tail=(tail+1)%SM_BUFFERED_RETURN_FIFO_LEN;
+        axis->returnFifoKind[tail]=kind;
+        axis->returnFifoCount[tail]=1;
+        axis->returnFifoLen++;
+    }
+
+    if(kind&SM_BUFFERED_RETURN_DISCARD)
+        axis->numberOfDiscardableReturnDataPackets++;
+    else
+        axis->numberOfPendingReadPackets++;
+}
+
+//get kind of commands whose return data arrived next. *numPackets is set to the number of consecutive packets of
+//that kind, at most maxPackets, and they are removed from FIFO
+static smuint8 smBufferedPopReturnKinds( BufferedMotionAxis *axis, smint32 maxPackets, smint32 *numPackets )
 {
-    smint32 bytesUsed=0;
+    smuint8 kind;
 
-    //if(freeBytesInDeviceBuffer>=cmdBufferSizeBytes)
-//        emit message(Warning,"Buffer underrun on axis "+QString::number(ax));
+    if(axis->returnFifoLen==0)
+    {
+        *numPackets=maxPackets;
+        return SM_BUFFERED_RETURN_VALUE_32B;//more return data than commands filled, pass it to user as before
+    }
 
-    //freeBytesInDeviceBuffer-=8;
-//      if(drives[ax].bufferedStreamInitialized==false)
-//            cmdBufferSizeBytes=freeBytesInDeviceBuffer;//get empty buffer size
+    kind=axis->returnFifoKind[axis->returnFifoHead];
+    if(axis->returnFifoCount[axis->returnFifoHead]>maxPackets)
+    {
+        axis->returnFifoCount[axis->returnFifoHead]-=maxPackets;
+        *numPackets=maxPackets;
+    }
+    else
+    {
+        *numPackets=axis->returnFifoCount[axis->returnFifoHead];
+        axis->returnFifoHead=(axis->returnFifoHead+1)%SM_BUFFERED_RETURN_FIFO_LEN;
+        axis->returnFifoLen--;
+    }
+    return kind;
+}
+
+//true if setpoint can be sent as increment from last one
+static smbool smBufferedIncrementFits( BufferedMotionAxis *axis, smint32 from, smint32 to )
+{
+    //difference is taken modulo 2^32 like device adds it
+    smint32 increment=(smint32)((smuint32)to-(smuint32)from);
+    return axis->incrementalSetpoints==smtrue && axis->lastSetpointKnown==smtrue &&
+            increment>=SM_BUFFERED_INCREMENT_MIN && increment<=SM_BUFFERED_INCREMENT_MAX;
+}
+
+//true if it pays off to change write address to SMP_INCREMENTAL_SETPOINT before fillPoints[0]. the 2 bytes of
+//address change are paid back if SM_BUFFERED_INCREMENT_RUN points fit as increments, or all remaining ones if there are
+//at least 2 of them. so points never take more than 4 bytes each in average, except when changing back to absolute
+static smbool smBufferedStartIncrements( BufferedMotionAxis *axis, smint32 numFillPoints, const smint32 *fillPoints )
+{
+    smint32 previous=axis->lastSetpoint;
+    int i;
+
+    if(numFillPoints>SM_BUFFERED_INCREMENT_RUN)
+        numFillPoints=SM_BUFFERED_INCREMENT_RUN;
+    //run of increments and change back to absolute take 4 entries from return data FIFO
+    if(numFillPoints<2 || SM_BUFFERED_RETURN_FIFO_LEN-axis->returnFifoLen<4)
+        return smfalse;
+
+    for(i=0;i<numFillPoints;i++)
+    {
+        if(smBufferedIncrementFits(axis,previous,fillPoints[i])==smfalse)
+            return smfalse;
+        previous=fillPoints[i];
+    }
+    return smtrue;
+}
+
+//encode stream initialization (if not done yet) and fill points of axis and append them to command queue of its bus if send
+//is smtrue. returns bytes used from device buffer. without send, this is used on a copy of axis to get size of the encoding
+static smint32 smBufferedEncodeFill( BufferedMotionAxis *axis, smint32 numFillPoints, const smint32 *fillPoints, smbool send )
+{
+    smint32 bytesUsed=0;
+    int i;
 
     //first initialize the stream if not done yet
     if(axis->readParamInitialized==smfalse)
     {
         //set acceleration to "infinite" to avoid modification of user supplied trajectory inside drive
-        smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_RETURN_PARAM_ADDR);
-        smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B,axis->readParamAddr);
-        smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_RETURN_PARAM_LEN);
-        smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B,axis->readParamLength);
-        smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_ABSOLUTE_SETPOINT);
+        if(send==smtrue)
+        {
+            smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_RETURN_PARAM_ADDR);
+            smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B,axis->readParamAddr);
+            smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_RETURN_PARAM_LEN);
+            smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B,axis->readParamLength);
+            smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_ABSOLUTE_SETPOINT);
+        }
         bytesUsed+=2+3+2+3+2;
 
-        //next time we read return data, we discard first 4 return packets to avoid unexpected read data to user
-        axis->numberOfDiscardableReturnDataPackets+=5;
+        //next time we read return data, we discard these return packets to avoid unexpected read data to user
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_ADDRESS|SM_BUFFERED_RETURN_DISCARD);
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_VALUE_24B|SM_BUFFERED_RETURN_DISCARD);
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_ADDRESS|SM_BUFFERED_RETURN_DISCARD);
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_VALUE_24B|SM_BUFFERED_RETURN_DISCARD);
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_ADDRESS|SM_BUFFERED_RETURN_DISCARD);
         axis->readParamInitialized=smtrue;
+        axis->writingIncrements=smfalse;
+        axis->writeAddressKnown=smtrue;
     }
 
-    if(numFillPoints>=1)//send first fill data
+    //device may have missed address changes of failed fill, set it again before next point
+    if(axis->writeAddressKnown==smfalse && numFillPoints>0)
     {
-        smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_32B,fillPoints[0]);
-        bytesUsed+=4;
-        axis->numberOfPendingReadPackets+=1;
+        if(send==smtrue)
+            smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_ABSOLUTE_SETPOINT);
+        smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_ADDRESS|SM_BUFFERED_RETURN_DISCARD);
+        bytesUsed+=SM_BUFFERED_RETURN_ADDRESS;
+        axis->writingIncrements=smfalse;
+        axis->writeAddressKnown=smtrue;
     }
 
-    //send rest of data as increments
-    if(numFillPoints>=2)
+    for(i=0;i<numFillPoints;i++)
     {
-        int i;
-        //smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_ABSOLUTE_SETPOINT);
-        //smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,SMP_INCREMENTAL_SETPOINT);
-        //axis->numberOfPendingReadPackets++;//FIXME ei toimi ihan oikein tää koska skippaa äskeisen writevaluen
+        smbool increment;
+
+        if(axis->writingIncrements==smtrue)
+            increment=smBufferedIncrementFits(axis,axis->lastSetpoint,fillPoints[i]);
+        else
+            increment=smBufferedStartIncrements(axis,numFillPoints-i,fillPoints+i);
 
-        for(i=1;i<numFillPoints;i++)
+        if(increment!=axis->writingIncrements)
+        {
+            if(send==smtrue)
+                smAppendSMCommandToQueue(axis->bushandle,SMPCMD_SETPARAMADDR,increment==smtrue ? SMP_INCREMENTAL_SETPOINT : SMP_ABSOLUTE_SETPOINT);
+            smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_ADDRESS|SM_BUFFERED_RETURN_DISCARD);
+            bytesUsed+=SM_BUFFERED_RETURN_ADDRESS;
+            axis->writingIncrements=increment;
+        }
+
+        if(increment==smtrue)
+        {
+            if(send==smtrue)
+                smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B,(smint32)((smuint32)fillPoints[i]-(smuint32)axis->lastSetpoint));
+            smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_VALUE_24B);
+            bytesUsed+=SM_BUFFERED_RETURN_VALUE_24B;
+        }
+        else
         {
-            //smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_24B, fillPoints[i]-fillPoints[i-1] );
-            smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_32B,fillPoints[i]);
-            bytesUsed+=4;
-            axis->numberOfPendingReadPackets++;
+            if(send==smtrue)
+                smAppendSMCommandToQueue(axis->bushandle,SM_WRITE_VALUE_32B,fillPoints[i]);
+            smBufferedPushReturnKind(axis,SM_BUFFERED_RETURN_VALUE_32B);
+            bytesUsed+=SM_BUFFERED_RETURN_VALUE_32B;
         }
+        axis->lastSetpoint=fillPoints[i];
+        axis->lastSetpointKnown=smtrue;
     }
 
-    //send the commands that were added with smAppendSMCommandToQueue. this also reads all return packets that are available (executed already)
-    smUploadCommandQueueToDeviceBuffer(axis->bushandle,axis->deviceAddress);
+    axis->bufferBytesInUse+=bytesUsed;
+    return bytesUsed;
+}
+
+smint32 smBufferedGetBytesConsumedForPoints(BufferedMotionAxis *axis, smint32 numFillPoints, const smint32 *fillPoints )
+{
+    BufferedMotionAxis encoder=*axis;
+    return smBufferedEncodeFill(&encoder,numFillPoints,fillPoints,smfalse);
+}
+
+smint32 smBufferedGetMaxFillSizeForPoints(BufferedMotionAxis *axis, smint32 numBytesFree, smint32 numFillPoints, const smint32 *fillPoints )
+{
+    //even if we have lots of free space in buffer, we can only send up to SM485_MAX_PAYLOAD_BYTES bytes at once in one SM transmission
+    if(numBytesFree>SM485_MAX_PAYLOAD_BYTES)
+        numBytesFree=SM485_MAX_PAYLOAD_BYTES;
+    if(numBytesFree<0)
+        numBytesFree=0;
+
+    //points take at least 3 bytes. encoding of the last points depends on how many points follow them, so try with fewer points until they fit
+    if(numFillPoints>numBytesFree/3)
+        numFillPoints=numBytesFree/3;
+    while(numFillPoints>0 && smBufferedGetBytesConsumedForPoints(axis,numFillPoints,fillPoints)>numBytesFree)
+        numFillPoints--;
+    return numFillPoints;
+}
 
-    //read all available return data from stream (commands that have been axecuted in drive so far)
-    //return data works like FIFO for all sent commands (each sent stream command will produce return data packet that we fetch here)
+//store numPoints points to ring, dropping the ones that don't fit
+static void smBufferedReturnRingWrite( BufferedReturnRing *ring, const smint32 *points, smint32 numPoints )
+{
+    smint32 tail, n;
+
+    if(numPoints>ring->size-ring->count)
     {
-        smint32 bufferedReturnBytesReceived,readval;
-        int n=0;
+        ring->overflows+=numPoints-(ring->size-ring->count);
+        numPoints=ring->size-ring->count;
+    }
 
-        //read return data buffer
-        smBytesReceived(axis->bushandle,&bufferedReturnBytesReceived);//get amount of data available
-        //qDebug()<<axis<<"return data bytes"<<bufferedReturnBytesReceived;
-        while(bufferedReturnBytesReceived>1)//loop until we have read it all
-        {
-            smGetQueuedSMCommandReturnValue(axis->bushandle, &readval);
-            smBytesReceived(axis->bushandle,&bufferedReturnBytesReceived);
+    //in at most two pieces, before and after wrap around
+    tail=(ring->head+ring->count)%ring->size;
+    n=numPoints<ring->size-tail ? numPoints : ring->size-tail;
+    memcpy(ring->data+tail,points,n*sizeof(smint32));
+    memcpy(ring->data,points+n,(numPoints-n)*sizeof(smint32));
+    ring->count+=numPoints;
+}
 
-            if(axis->numberOfDiscardableReturnDataPackets>0)
-            {
-                //discard this return data as it's intialization return packets
-                axis->numberOfDiscardableReturnDataPackets--;
-            }
-            else//its read data that user expects
-            {
-                receivedPoints[n]=readval;
-                n++;
-                axis->numberOfPendingReadPackets--;
-            }
+//read return data of axis from the reply that is selected in its bus (commands that have been executed in drive so far) to
+//receivedPoints, or to ring if it's not NULL. return data works like FIFO for all sent commands (each sent stream command will
+//produce return data packet that we fetch here). returns number of points received
+static smint32 smBufferedReadReturnData( BufferedMotionAxis *axis, smint32 *receivedPoints, BufferedReturnRing *ring )
+{
+    smint32 values[SM485_MAX_PAYLOAD_BYTES];
+    smint32 numValues, i=0, n=0;
+
+    //decode whole reply at once and then pass it on in runs of packets of same kind
+    numValues=smGetQueuedSMCommandReturnValues(axis->bushandle,values);
+    while(i<numValues)
+    {
+        smint32 run;
+        smuint8 kind=smBufferedPopReturnKinds(axis,numValues-i,&run);
+
+        //kind without discard flag is the number of bytes each command used from device buffer
+        smBufferedNoteExecuted(axis,run*(kind&~SM_BUFFERED_RETURN_DISCARD));
+        if(kind&SM_BUFFERED_RETURN_DISCARD)
+        {
+            //discard this return data as it's from stream intialization or write address change
+            axis->numberOfDiscardableReturnDataPackets-=run;
         }
-        *numReceivedPoints=n;
+        else//its read data that user expects
+        {
+            if(ring!=NULL)
+                smBufferedReturnRingWrite(ring,values+i,run);
+            else
+                memcpy(receivedPoints+n,values+i,run*sizeof(smint32));
+            n+=run;
+            axis->numberOfPendingReadPackets-=run;
+        }
+        i+=run;
     }
+    return n;
+}
+
+//device may or may not have received the fill that failed, so its write address and setpoint are not known anymore
+static void smBufferedFillFailed( BufferedMotionAxis *axis )
+{
+    axis->freeSpaceEstimateValid=smfalse;//return data may have been lost
+    axis->writeAddressKnown=smfalse;
+    axis->lastSetpointKnown=smfalse;
+}
+
+//fill points and read return data to receivedPoints, or to ring if it's not NULL
+static SM_STATUS smBufferedFillAndReceiveTo( BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *receivedPoints, BufferedReturnRing *ring, smint32 *numReceivedPoints, smint32 *bytesFilled )
+{
+    smint32 bytesUsed;
+
+    //queue is used over several calls, keep other threads out of this bus meanwhile
+    smLockBus(axis->bushandle);
+
+    bytesUsed=smBufferedEncodeFill(axis,numFillPoints,fillPoints,smtrue);
+
+    //send the commands that were added with smAppendSMCommandToQueue. this also reads all return packets that are available (executed already)
+    if(smUploadCommandQueueToDeviceBuffer(axis->bushandle,axis->deviceAddress)!=SM_OK)
+        smBufferedFillFailed(axis);
+
+    *numReceivedPoints=smBufferedReadReturnData(axis,receivedPoints,ring);
+    if(getCumulativeStatus(axis->bushandle)!=SM_OK)
+        axis->freeSpaceEstimateValid=smfalse;//return data may have been lost
+    smUnlockBus(axis->bushandle);
 
     *bytesFilled=bytesUsed;
     return getCumulativeStatus(axis->bushandle);
 }
 
+SM_STATUS smBufferedFillAndReceive(BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *numReceivedPoints, smint32 *receivedPoints, smint32 *bytesFilled )
+{
+    return smBufferedFillAndReceiveTo(axis,numFillPoints,fillPoints,receivedPoints,NULL,numReceivedPoints,bytesFilled);
+}
+
+SM_STATUS smBufferedReturnRingInit( BufferedReturnRing *ring, smint32 *data, smint32 size )
+{
+    if(data==NULL || size<1)
+        return SM_ERR_PARAMETER;
+
+    ring->data=data;
+    ring->size=size;
+    ring->head=0;
+    ring->count=0;
+    ring->overflows=0;
+    return SM_OK;
+}
+
+void smBufferedReturnRingConsume( BufferedReturnRing *ring, smint32 numPoints )
+{
+    if(numPoints>ring->count)
+        numPoints=ring->count;
+    ring->head=(ring->head+numPoints)%ring->size;
+    ring->count-=numPoints;
+}
+
+SM_STATUS smBufferedFillAndReceiveToRing( BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, BufferedReturnRing *ring, smint32 *numReceivedPoints, smint32 *bytesFilled )
+{
+    if(ring==NULL)
+        return recordStatus(axis->bushandle,SM_ERR_PARAMETER);
+    return smBufferedFillAndReceiveTo(axis,numFillPoints,fillPoints,NULL,ring,numReceivedPoints,bytesFilled);
+}
+
 /** this will stop executing buffered motion immediately and discard rest of already filled buffer on a given axis. May cause drive fault state such as tracking error if done at high speed because stop happens without deceleration.*/
 SM_STATUS smBufferedAbort(BufferedMotionAxis *axis)
 {
+    //return data of discarded commands will not arrive
+    axis->bufferBytesInUse=0;
+    axis->bufferReturnLagBytes=0;
+    axis->freeSpaceEstimateValid=smfalse;
+    axis->returnFifoLen=0;
+    axis->numberOfDiscardableReturnDataPackets=0;
+    axis->numberOfPendingReadPackets=0;
+    axis->lastSetpointKnown=smfalse;//device stays at last executed setpoint, so next one is sent as absolute
     return smSetParameter( axis->bushandle, axis->deviceAddress, SMP_SYSTEM_CONTROL,SMP_SYSTEM_CONTROL_ABORTBUFFERED);
 }
 
+
+//true if axis i is the first axis of its bus in streamer, so that each bus is handled once
+static smbool smBufferedStreamerFirstOfBus( BufferedMotionStreamer *streamer, int i )
+{
+    int j;
+    for(j=0;j<i;j++)
+    {
+        if(streamer->axes[j]->bushandle==streamer->axes[i]->bushandle)
+            return smfalse;
+    }
+    return smtrue;
+}
+
+SM_STATUS smBufferedStreamerInit( BufferedMotionStreamer *streamer, int numAxes, BufferedMotionAxis **axes )
+{
+    int i,j,onBus;
+
+    streamer->numAxes=0;
+    if(numAxes<1 || numAxes>SM_BUFFERED_STREAMER_MAX_AXES)
+        return SM_ERR_PARAMETER;
+
+    for(i=0;i<numAxes;i++)
+    {
+        if(axes[i]->initialized==smfalse || axes[i]->samplerate!=axes[0]->samplerate)
+            return recordStatus(axes[i]->bushandle,SM_ERR_PARAMETER);
+
+        onBus=0;
+        for(j=0;j<numAxes;j++)
+        {
+            if(axes[j]->bushandle==axes[i]->bushandle)
+                onBus++;
+        }
+        if(onBus>SM_MAX_PIPELINED_NODES)
+            return recordStatus(axes[i]->bushandle,SM_ERR_LENGTH);
+
+        streamer->axes[i]=axes[i];
+    }
+
+    streamer->numAxes=numAxes;
+    return SM_OK;
+}
+
+SM_STATUS smBufferedStreamerRunAndSyncClocks( BufferedMotionStreamer *streamer )
+{
+    SM_STATUS stat=SM_OK;
+    int i,j;
+
+    for(i=0;i<streamer->numAxes;i++)
+    {
+        BufferedMotionAxis *first=streamer->axes[i];
+        if(smBufferedStreamerFirstOfBus(streamer,i)==smfalse)
+            continue;
+
+        stat|=smBufferedRunAndSyncClocks(first);
+        for(j=i+1;j<streamer->numAxes;j++)
+        {
+            if(streamer->axes[j]->bushandle==first->bushandle)
+                streamer->axes[j]->driveClock=first->driveClock;
+        }
+    }
+
+    return stat;
+}
+
+SM_STATUS smBufferedStreamerGetFree( BufferedMotionStreamer *streamer, smint32 *maxFillPoints )
+{
+    SM_STATUS stat=SM_OK;
+    int i,j;
+
+    *maxFillPoints=SM_BUFFERED_MAX_RETURN_POINTS;
+
+    for(i=0;i<streamer->numAxes;i++)
+    {
+        smbus bus=streamer->axes[i]->bushandle;
+        int resyncs=0;
+        if(smBufferedStreamerFirstOfBus(streamer,i)==smfalse)
+            continue;
+
+        //query axes of bus that need resync with one pipeline, others use estimate
+        smLockBus(bus);
+        for(j=i;j<streamer->numAxes;j++)
+        {
+            if(streamer->axes[j]->bushandle!=bus || smBufferedFreeSpaceResyncNeeded(streamer->axes[j])==smfalse) continue;
+            smAppendGetParamCommandToQueue(bus,SMP_BUFFER_FREE_BYTES);
+            smAppendCommandQueueToPipeline(bus,streamer->axes[j]->deviceAddress);
+            resyncs++;
+        }
+        if(resyncs>0)
+            smExecutePipeline(bus);
+
+        for(j=i;j<streamer->numAxes;j++)
+        {
+            BufferedMotionAxis *axis=streamer->axes[j];
+            smint32 freebytes=0;
+
+            if(axis->bushandle!=bus) continue;
+            if(smBufferedFreeSpaceResyncNeeded(axis)==smfalse)
+                smBufferedGetFreeEstimate(axis,&freebytes);
+            else if(smSelectPipelinedReturnValues(bus,axis->deviceAddress)==SM_OK &&
+                    smGetQueuedGetParamReturnValue(bus,&freebytes)==SM_OK)
+                smBufferedSetFree(axis,freebytes);
+            else
+            {
+                freebytes=0;//read has failed, assume 0
+                axis->freeSpaceEstimateValid=smfalse;
+            }
+
+            if(smBufferedGetMaxFillSize(axis,freebytes)<*maxFillPoints)
+                *maxFillPoints=smBufferedGetMaxFillSize(axis,freebytes);
+        }
+        smUnlockBus(bus);
+
+        stat|=getCumulativeStatus(bus);
+    }
+
+    if(*maxFillPoints<0)
+        *maxFillPoints=0;
+    return stat;
+}
+
+SM_STATUS smBufferedStreamerFillAndReceive( BufferedMotionStreamer *streamer, smint32 numFillPoints, smint32 * const *fillPoints,
+                                            smint32 *numReceivedPoints, smint32 * const *receivedPoints )
+{
+    SM_STATUS stat=SM_OK;
+    int i,j;
+
+    for(i=0;i<streamer->numAxes;i++)
+    {
+        smbus bus=streamer->axes[i]->bushandle;
+        if(smBufferedStreamerFirstOfBus(streamer,i)==smfalse)
+            continue;
+
+        //fill all axes of bus with one pipeline
+        smLockBus(bus);
+        for(j=i;j<streamer->numAxes;j++)
+        {
+            BufferedMotionAxis *axis=streamer->axes[j];
+            if(axis->bushandle!=bus) continue;
+            axis->bufferFreeBytes-=smBufferedEncodeFill(axis,numFillPoints,fillPoints[j],smtrue);
+            smAppendBufferedCommandQueueToPipeline(bus,axis->deviceAddress);
+        }
+        smExecutePipeline(bus);
+
+        for(j=i;j<streamer->numAxes;j++)
+        {
+            BufferedMotionAxis *axis=streamer->axes[j];
+            if(axis->bushandle!=bus) continue;
+            if(smSelectPipelinedReturnValues(bus,axis->deviceAddress)==SM_OK)
+                numReceivedPoints[j]=smBufferedReadReturnData(axis,receivedPoints[j],NULL);
+            else
+            {
+                numReceivedPoints[j]=0;
+                smBufferedFillFailed(axis);
+            }
+        }
+        smUnlockBus(bus);
+
+        stat|=getCumulativeStatus(bus);
+    }
+
+    return stat;
+}
@@ -9,6 +9,13 @@ extern "C"{
 
 //typedef enum _smBufferedState {BufferedStop=0,BufferedRun=1} smBufferedState;
 
+#define SM_BUFFERED_RETURN_FIFO_LEN 32
+//kinds of commands in return data FIFO. value is the number of bytes command uses from device buffer
+#define SM_BUFFERED_RETURN_ADDRESS 2//SMPCMD_SETPARAMADDR
+#define SM_BUFFERED_RETURN_VALUE_24B 3//SM_WRITE_VALUE_24B
+#define SM_BUFFERED_RETURN_VALUE_32B 4//SM_WRITE_VALUE_32B
+#define SM_BUFFERED_RETURN_DISCARD 0x80//flag set in kind if return data of command is not passed to user
+
 typedef struct _BufferedMotionAxis {
     smbool initialized;
     smbool readParamInitialized;
@@ -29,8 +36,29 @@ typedef struct _BufferedMotionAxis {
     smint32 smProtocolVersion;//version of SM protocol of the target device. some internal functionality of API may use this info.
     smint32 deviceCapabilityFlags1;//value of SMP_DEVICE_CAPABILITIES1 if target device has SM protocol version 28 or later (if SM version<28, then value is 0)
     smint32 deviceCapabilityFlags2;//value of SMP_DEVICE_CAPABILITIES2 if target device has SM protocol version 28 or later (if SM version<28, then value is 0)
+
+    //free space tracking for smBufferedGetFreeEstimate, see there
+    smint32 bufferBytesInUse;//upper bound of bytes in device buffer: bytes filled minus bytes of commands whose return data has been received
+    smint32 bufferReturnLagBytes;//bytes that were already executed at last SMP_BUFFER_FREE_BYTES read but whose return data had not been received
+    smbool freeSpaceEstimateValid;//false if estimate needs to be resynced from device, i.e. after communication error or abort
+    smint32 freeSpaceResyncInterval;//estimate is resynced from device every this many smBufferedGetFreeEstimate calls, 0=every call. SM_BUFFERED_FREE_SPACE_RESYNC_INTERVAL after init
+    smint32 cyclesSinceFreeSpaceResync;
+
+    //setpoint encoding. points are sent as 24 bit increments to SMP_INCREMENTAL_SETPOINT when they fit, otherwise as absolute 32 bit values to SMP_ABSOLUTE_SETPOINT
+    smbool incrementalSetpoints;//smfalse after init (always absolute setpoints). set to smtrue to send increments when they fit
+    smbool writingIncrements;//smtrue if SMP_INCREMENTAL_SETPOINT is the current write address of device buffer
+    smbool writeAddressKnown;//smfalse before first fill and after failed fill, then next fill sets write address to SMP_ABSOLUTE_SETPOINT
+    smbool lastSetpointKnown;//smfalse until first point has been filled and after abort or failed fill, as then device setpoint is not known
+    smint32 lastSetpoint;//last point filled
+
+    //kinds of commands in device buffer in the order their return data will arrive. consecutive commands of same kind make one entry
+    smuint8 returnFifoKind[SM_BUFFERED_RETURN_FIFO_LEN];//SM_BUFFERED_RETURN_ADDRESS, _VALUE_24B or _VALUE_32B, SM_BUFFERED_RETURN_DISCARD set if command is not a fill point
+    smuint16 returnFifoCount[SM_BUFFERED_RETURN_FIFO_LEN];
+    int returnFifoHead, returnFifoLen;
 } BufferedMotionAxis;
 
+#define SM_BUFFERED_FREE_SPACE_RESYNC_INTERVAL 100
+
 /** initialize buffered motion for one axis with address and samplerate (Hz) */
 /* returnDataLenght must be one of following:
 #define SM_RETURN_STATUS 3
@@ -55,9 +83,51 @@ LIB SM_STATUS smBufferedDeinit( BufferedMotionAxis *axis );
 /* this also starts buffered motion when it's not running*/
 LIB SM_STATUS smBufferedRunAndSyncClocks( BufferedMotionAxis *axis );
 LIB SM_STATUS smBufferedGetFree(BufferedMotionAxis *axis, smint32 *numBytesFree );
+/** Like smBufferedGetFree but usually without bus traffic. Each command in device buffer produces one return data
+ * packet when executed, so the bytes in buffer are tracked from bytes filled and return data received. The estimate is
+ * never above the real free space because return data lags behind execution. It is resynced with smBufferedGetFree
+ * every freeSpaceResyncInterval calls and after communication errors or smBufferedAbort. */
+LIB SM_STATUS smBufferedGetFreeEstimate(BufferedMotionAxis *axis, smint32 *numBytesFree );
+/** Number of any points that fit in numBytesFree bytes of device buffer and in one fill. As points that are sent as
+ * increments take less space, this is a worst case. Use smBufferedGetMaxFillSizeForPoints to fit more. */
 LIB smint32 smBufferedGetMaxFillSize(BufferedMotionAxis *axis, smint32 numBytesFree );
+/** Bytes that numFillPoints points use at most from device buffer in next smBufferedFillAndReceive */
 LIB smint32 smBufferedGetBytesConsumed(BufferedMotionAxis *axis, smint32 numFillPoints );
+/** Number of first points of fillPoints (up to numFillPoints) that fit in numBytesFree bytes of device buffer and in one fill
+ * when encoded like next smBufferedFillAndReceive would encode them. */
+LIB smint32 smBufferedGetMaxFillSizeForPoints(BufferedMotionAxis *axis, smint32 numBytesFree, smint32 numFillPoints, const smint32 *fillPoints );
+/** Exact number of bytes that fillPoints use from device buffer in next smBufferedFillAndReceive */
+LIB smint32 smBufferedGetBytesConsumedForPoints(BufferedMotionAxis *axis, smint32 numFillPoints, const smint32 *fillPoints );
+/** Fill numFillPoints setpoints to device buffer and receive return data of executed commands. If fill fails (status other
+ * than SM_OK), its points may or may not have been executed. Next fill resyncs the device by setting the write address
+ * and sending an absolute setpoint, so the device never adds increments to a setpoint other than the one they were
+ * computed from. */
 LIB SM_STATUS smBufferedFillAndReceive( BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, smint32 *numReceivedPoints, smint32 *receivedPoints, smint32 *bytesFilled );
+
+/* Return data ring lets return data of buffered motion go directly to storage of the caller, i.e. for capturing
+ * feedback at full samplerate. Fills append received points to the ring, and the caller reads them in place:
+ *
+ * for(i=0;i<ring.count;i++) use(ring.data[(ring.head+i)%ring.size]);
+ * smBufferedReturnRingConsume(&ring,ring.count);
+ *
+ * If the ring is full, points that don't fit are dropped and counted in overflows.
+ */
+typedef struct _BufferedReturnRing {
+    smint32 *data;//storage of size values, provided by caller
+    smint32 size;
+    smint32 head;//index of oldest point in data
+    smint32 count;//number of points in ring
+    smuint32 overflows;//number of points dropped because ring was full
+} BufferedReturnRing;
+
+/** Initialize ring to use data that has room for size points */
+LIB SM_STATUS smBufferedReturnRingInit( BufferedReturnRing *ring, smint32 *data, smint32 size );
+/** Remove numPoints oldest points from ring after caller has used them */
+LIB void smBufferedReturnRingConsume( BufferedReturnRing *ring, smint32 numPoints );
+/** Like smBufferedFillAndReceive, but received points are appended to ring. numReceivedPoints is set to the number
+ * of points received, including dropped ones. */
+LIB SM_STATUS smBufferedFillAndReceiveToRing( BufferedMotionAxis *axis, smint32 numFillPoints, smint32 *fillPoints, BufferedReturnRing *ring, smint32 *numReceivedPoints, smint32 *bytesFilled );
+
 /** This will stop executing buffered motion immediately and discard rest of already filled buffer on a given axis. May cause drive fault state such as tracking error if done at high speed because stop happens without deceleration.
 Note: this will not stop motion, but just stop executing the sent buffered commands. The last executed motion point will be still followed by drive. So this is bad function
 for quick stopping stopping, for stop to the actual place consider using disable drive instead (prefferably phsyical input disable).
@@ -65,6 +135,42 @@ for quick stopping stopping, for stop to the actual place consider using disable
 LIB SM_STATUS smBufferedAbort(BufferedMotionAxis *axis);
 
 
+/** Multi-axis streamer fills buffers of several axes, possibly on several buses, with one round trip per bus instead
+ * of one per axis. Packets of all axes of a bus are pipelined (see smExecutePipeline in simplemotion.h, the same bus
+ * interface requirements apply). Every call gets the same number of points for each axis, so the axes stay aligned
+ * sample by sample as long as their buffered motion was started with smBufferedStreamerRunAndSyncClocks.
+ *
+ * Usage: initialize each axis with smBufferedInit (all with the same sample rate), then smBufferedStreamerInit with
+ * pointers to them. The axis structs must stay valid while the streamer is used. Start motion with
+ * smBufferedStreamerRunAndSyncClocks and each cycle call smBufferedStreamerGetFree followed by
+ * smBufferedStreamerFillAndReceive with at most the returned number of points. Deinit and abort axes as usual.
+ */
+#define SM_BUFFERED_STREAMER_MAX_AXES 16
+//return data of one fill fits in one packet, so at most this many points are received per axis per call (1 byte SM_RETURN_STATUS values)
+#define SM_BUFFERED_MAX_RETURN_POINTS 120
+
+typedef struct _BufferedMotionStreamer {
+    int numAxes;
+    BufferedMotionAxis *axes[SM_BUFFERED_STREAMER_MAX_AXES];
+} BufferedMotionStreamer;
+
+/** Returns SM_ERR_PARAMETER if numAxes is out of range, sample rates differ or an axis is not initialized and
+ * SM_ERR_LENGTH if one bus has more axes than can be pipelined. */
+LIB SM_STATUS smBufferedStreamerInit( BufferedMotionStreamer *streamer, int numAxes, BufferedMotionAxis **axes );
+/** Starts buffered motion and syncs clocks once per bus with the first axis on it. Devices on the same bus sync to
+ * the same clock reply, and driveClock of all axes of the bus is set to it. */
+LIB SM_STATUS smBufferedStreamerRunAndSyncClocks( BufferedMotionStreamer *streamer );
+/** Get free buffer space of all axes (bufferFreeBytes and bufferFill are updated) and store number of points that
+ * can be filled to every axis in next smBufferedStreamerFillAndReceive to maxFillPoints. Free space is estimated like
+ * with smBufferedGetFreeEstimate, and only axes that need resync are read from devices, with one pipeline per bus. */
+LIB SM_STATUS smBufferedStreamerGetFree( BufferedMotionStreamer *streamer, smint32 *maxFillPoints );
+/** Fill numFillPoints points from fillPoints[i] to axis i of streamer and receive return data of all axes.
+ * numReceivedPoints[i] is set to number of values stored to receivedPoints[i], which must have room for
+ * SM_BUFFERED_MAX_RETURN_POINTS values. Returns combined status of all buses. */
+LIB SM_STATUS smBufferedStreamerFillAndReceive( BufferedMotionStreamer *streamer, smint32 numFillPoints, smint32 * const *fillPoints,
+                                                smint32 *numReceivedPoints, smint32 * const *receivedPoints );
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,9 +9,16 @@
 #include <errno.h>
 #include <stdlib.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/select.h>
+#endif
+
 
-//how much bytes available in transmit buffer
-#define TANSMIT_BUFFER_LENGTH 128
+//how much bytes available in transmit buffer. holds several packets for pipelined transactions
+#define TANSMIT_BUFFER_LENGTH 512
+
+//how much bytes can be held in receive buffer. bus device driver is read in chunks of up to this size
+#define RECEIVE_BUFFER_LENGTH 512
 
 unsigned long SMBusBaudrate=SM_BAUDRATE; //the next opened port (with smOpenBus) will be opened with the PBS defined here (default 460800 BPS)
 
@@ -28,6 +35,10 @@ typedef struct _SMBusDevice
     smuint8 txBuffer[TANSMIT_BUFFER_LENGTH];
     smint32 txBufferUsed;//how many bytes in buffer currently
 
+    smuint8 rxBuffer[RECEIVE_BUFFER_LENGTH];
+    smint32 rxBufferUsed;//how many bytes have been read from driver into rxBuffer
+    smint32 rxBufferReadPos;//position of next byte to be returned from rxBuffer
+
     BusdeviceOpen busOpenCallback;
     BusdeviceReadBuffer busReadCallback;
     BusdeviceWriteBuffer busWriteCallback;
@@ -47,6 +58,8 @@ void smBDinit()
 	{
 		BusDevice[i].opened=smfalse;
         BusDevice[i].txBufferUsed=0;
+        BusDevice[i].rxBufferUsed=0;
+        BusDevice[i].rxBufferReadPos=0;
 	}
 	bdInitialized=smtrue;
 }
@@ -113,6 +126,8 @@ smbusdevicehandle smBDOpenWithCallbacks(const char *devicename, BusdeviceOpen bu
 
     BusDevice[handle].opened=smtrue;
     BusDevice[handle].txBufferUsed=0;
+    BusDevice[handle].rxBufferUsed=0;
+    BusDevice[handle].rxBufferReadPos=0;
     BusDevice[handle].cumulativeSmStatus=0;
 
     //purge
@@ -159,7 +174,6 @@ smbool smBDWrite(const smbusdevicehandle handle, const smuint8 byte )
         //append to buffer
         BusDevice[handle].txBuffer[BusDevice[handle].txBufferUsed]=byte;
         BusDevice[handle].txBufferUsed++;
-        smDebug(handle, SMDebugTrace, "  Sending byte %02x\n",byte);
         return smtrue;
     }
 
@@ -167,6 +181,26 @@ smbool smBDWrite(const smbusdevicehandle handle, const smuint8 byte )
     return smfalse;
 }
 
+//reserve len bytes at the end of transmit buffer so that caller can assemble data directly in it. data is sent later with smBDTransmit()
+//returns pointer to first reserved byte or NULL if handle is invalid or buffer would overflow
+smuint8 *smBDReserveTransmitBuffer( const smbusdevicehandle handle, const smint32 len )
+{
+    smuint8 *ptr;
+
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return NULL;
+
+    if(len<0 || BusDevice[handle].txBufferUsed+len>TANSMIT_BUFFER_LENGTH)
+    {
+        smDebug(handle, SMDebugMid, "  Reserving %d bytes failed, TX buffer overflown\n",len);
+        return NULL;
+    }
+
+    ptr=BusDevice[handle].txBuffer+BusDevice[handle].txBufferUsed;
+    BusDevice[handle].txBufferUsed+=len;
+    return ptr;
+}
+
 smbool smBDTransmit(const smbusdevicehandle handle)
 {
     //check if handle valid & open
@@ -184,23 +218,112 @@ smbool smBDTransmit(const smbusdevicehandle handle)
     }
 }
 
+//read up to size bytes from bus. bytes left in receive buffer from earlier reads are returned first without accessing the
+//driver, otherwise one chunk of up to size bytes is read from driver. if no data is immediately available, blocks up to SM_READ_TIMEOUT millisecs.
+//size should not exceed the number of bytes that are expected to arrive because some drivers (i.e. FTDI D2XX and Windows serial port)
+//return from read only after all requested bytes have been received or timeout has elapsed.
+//returns number of bytes read, 0 if timeouted and -1 on error
+smint32 smBDReadBuffer( const smbusdevicehandle handle, smuint8 *buf, smint32 size )
+{
+    smint32 n;
+
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return -1;
+
+    if(size<=0) return 0;
+
+    //buffer empty, fetch more from device
+    if(BusDevice[handle].rxBufferReadPos>=BusDevice[handle].rxBufferUsed)
+    {
+        BusDevice[handle].rxBufferReadPos=0;
+        BusDevice[handle].rxBufferUsed=0;
+
+        n=size;
+        if(n>RECEIVE_BUFFER_LENGTH) n=RECEIVE_BUFFER_LENGTH;
+
+        n=BusDevice[handle].busReadCallback(BusDevice[handle].busDevicePointer, BusDevice[handle].rxBuffer, n);
+        if( n<=0 )
+        {
+            smDebug(handle, SMDebugMid, "  Reading from bus failed\n");
+            return 0;
+        }
+        BusDevice[handle].rxBufferUsed=n;
+    }
+
+    n=BusDevice[handle].rxBufferUsed-BusDevice[handle].rxBufferReadPos;
+    if(n>size) n=size;
+
+    memcpy(buf,BusDevice[handle].rxBuffer+BusDevice[handle].rxBufferReadPos,n);
+    BusDevice[handle].rxBufferReadPos+=n;
+
+    return n;
+}
+
+//get file descriptor of bus device that becomes readable when data arrives, so that application may wait it with select/poll/epoll.
+//only available with built-in serial port (unix) and TCP/IP drivers.
+//returns smfalse if bus device has no file descriptor
+smbool smBDGetFileDescriptor( const smbusdevicehandle handle, smint32 *fd )
+{
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+
+#ifdef ENABLE_BUILT_IN_DRIVERS
+#if defined(__unix__) || defined(__APPLE__)
+    if( BusDevice[handle].busReadCallback==serialPortRead )
+    {
+        *fd=(smint32)(intptr_t)BusDevice[handle].busDevicePointer;
+        return smtrue;
+    }
+#endif
+    if( BusDevice[handle].busReadCallback==(BusdeviceReadBuffer)tcpipPortRead )
+    {
+        *fd=(smint32)(intptr_t)BusDevice[handle].busDevicePointer;
+        return smtrue;
+    }
+#endif
+    (void)fd;
+    return smfalse;
+}
+
+//check whether smBDReadBuffer would return data without blocking. if bus device has no file descriptor, this can't be known
+//and smtrue is returned, then reading blocks as long as the driver read does.
+smbool smBDReadReady( const smbusdevicehandle handle )
+{
+    //check if handle valid & open
+    if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
+
+    if(BusDevice[handle].rxBufferReadPos<BusDevice[handle].rxBufferUsed)
+        return smtrue;
+
+#if defined(__unix__) || defined(__APPLE__)
+    {
+        smint32 fd;
+        if( smBDGetFileDescriptor(handle,&fd)==smtrue )
+        {
+            fd_set input;
+            struct timeval timeout;
+            FD_ZERO(&input);
+            FD_SET(fd, &input);
+            timeout.tv_sec=0;
+            timeout.tv_usec=0;
+            return select(fd+1, &input, NULL, NULL, &timeout)>0 ? smtrue : smfalse;
+        }
+    }
+#endif
+    return smtrue;
+}
+
 //read one byte from bus. if byte not immediately available, block return up to SM_READ_TIMEOUT millisecs to wait data
 //returns true if byte read sucessfully
 smbool smBDRead( const smbusdevicehandle handle, smuint8 *byte )
 {
-	//check if handle valid & open
-	if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
-
-    int n;
-    n=BusDevice[handle].busReadCallback(BusDevice[handle].busDevicePointer, byte, 1);
-    if( n!=1 )
+    if( smBDReadBuffer(handle, byte, 1)!=1 )
     {
         smDebug(handle, SMDebugMid, "  Reading a byte from bus failed\n");
         return smfalse;
     }
     else
     {
-        smDebug(handle, SMDebugTrace, "  Got byte %02x \n",*byte);
         return smtrue;
     }
 }
@@ -212,6 +335,11 @@ smbool smBDMiscOperation(const smbusdevicehandle handle , BusDeviceMiscOperation
     if( smIsBDHandleOpen(handle)==smfalse ) return smfalse;
 
     BusDevice[handle].txBufferUsed=0;
+    if(operation==MiscOperationPurgeRX)
+    {
+        BusDevice[handle].rxBufferUsed=0;
+        BusDevice[handle].rxBufferReadPos=0;
+    }
 
     return BusDevice[handle].busMiscOperationCallback(BusDevice[handle].busDevicePointer,operation);
 }
@@ -23,6 +23,10 @@ smbool smBDClose( const smbusdevicehandle handle );
 //returns smtrue on success. smfalse could mean buffer full error if forgot to call smBDTransmit
 smbool smBDWrite( const smbusdevicehandle handle , const smuint8 byte );
 
+//reserve len bytes from transmit buffer for in-place data assembly. send data with smBDTransmit()
+//returns pointer to reserved bytes or NULL on error (i.e. buffer full)
+smuint8 *smBDReserveTransmitBuffer( const smbusdevicehandle handle, const smint32 len );
+
 //write transmit buffer to physical device
 //returns true on success
 smbool smBDTransmit(const smbusdevicehandle handle);
@@ -31,6 +35,18 @@ smbool smBDTransmit(const smbusdevicehandle handle);
 //returns true if byte read sucessfully
 smbool smBDRead( const smbusdevicehandle handle , smuint8 *byte );
 
+//read up to size bytes from bus with one driver call. if no bytes immediately available, block return up to SM_READ_TIMEOUT millisecs to wait data.
+//size should be the number of bytes that are known to be arriving, see notes at definition.
+//returns number of bytes read, 0 if timeouted and -1 on error
+smint32 smBDReadBuffer( const smbusdevicehandle handle, smuint8 *buf, smint32 size );
+
+//get file descriptor that becomes readable when data arrives (built-in unix serial port & TCP/IP drivers only)
+//returns smfalse if not available
+smbool smBDGetFileDescriptor( const smbusdevicehandle handle, smint32 *fd );
+
+//returns smtrue if smBDReadBuffer would not block, or if that can't be known because bus device has no file descriptor
+smbool smBDReadReady( const smbusdevicehandle handle );
+
 //see info at definition of BusDeviceMiscOperationType
 //returns true if sucessfully
 smbool smBDMiscOperation( const smbusdevicehandle handle, BusDeviceMiscOperationType operation );
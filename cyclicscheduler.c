@@ -0,0 +1,193 @@
+//needed for CPU affinity functions
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include "simplemotion.h"
+#include "user_options.h"
+#include "simplemotion_private.h"
+#include "cyclicscheduler.h"
+
+#if defined(__linux__)
+#include <time.h>
+#include <sched.h>
+#include <errno.h>
+#endif
+
+void smCyclicSchedulerInit( CyclicScheduler *scheduler, smint32 periodUs, smCyclicCallback callback, void *userdata )
+{
+    memset(scheduler,0,sizeof(*scheduler));
+    scheduler->periodUs=periodUs;
+    scheduler->replyDeadlineUs=periodUs/2;
+    scheduler->priority=0;
+    scheduler->cpu=-1;
+    scheduler->callback=callback;
+    scheduler->userdata=userdata;
+    scheduler->running=smfalse;
+}
+
+void smCyclicSchedulerResetStatistics( CyclicScheduler *scheduler )
+{
+    int i;
+    scheduler->cycles=0;
+    scheduler->overruns=0;
+    scheduler->lateReplies=0;
+    scheduler->failedCycles=0;
+    scheduler->maxWakeupLatencyUs=0;
+    scheduler->maxCallbackUs=0;
+    for(i=0;i<SM_CYCLIC_HISTOGRAM_BINS;i++)
+    {
+        scheduler->wakeupLatencyHistogram[i]=0;
+        scheduler->callbackHistogram[i]=0;
+    }
+}
+
+#if defined(__linux__)
+
+static void smTimespecAddUs( struct timespec *t, int64_t us )
+{
+    t->tv_sec+=us/1000000;
+    t->tv_nsec+=(us%1000000)*1000;
+    if(t->tv_nsec>=1000000000)
+    {
+        t->tv_nsec-=1000000000;
+        t->tv_sec++;
+    }
+}
+
+//microseconds from a to b
+static int64_t smTimespecDiffUs( const struct timespec *a, const struct timespec *b )
+{
+    return (int64_t)(b->tv_sec-a->tv_sec)*1000000+(b->tv_nsec-a->tv_nsec)/1000;
+}
+
+static void smCyclicHistogramAdd( const CyclicScheduler *scheduler, volatile smuint32 *histogram, int64_t us )
+{
+    int64_t bin=us*SM_CYCLIC_HISTOGRAM_BINS/scheduler->periodUs;
+    if(bin<0) bin=0;
+    if(bin>=SM_CYCLIC_HISTOGRAM_BINS) bin=SM_CYCLIC_HISTOGRAM_BINS-1;
+    histogram[bin]++;
+}
+
+static void *smCyclicSchedulerThread( void *arg )
+{
+    CyclicScheduler *scheduler=(CyclicScheduler*)arg;
+    struct timespec deadline, now;
+
+    clock_gettime(CLOCK_MONOTONIC,&deadline);
+    smTimespecAddUs(&deadline,scheduler->periodUs);
+
+    while(scheduler->running==smtrue)
+    {
+        int64_t latency, duration;
+        SM_STATUS stat;
+        int err;
+
+        //absolute deadline, restart if interrupted by signal
+        while((err=clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&deadline,NULL))==EINTR)
+            if(scheduler->running==smfalse) break;
+        if(scheduler->running==smfalse)
+            break;
+
+        //sleep failed, cycle is skipped without calling callback
+        if(err!=0)
+        {
+            scheduler->cycles++;
+            scheduler->failedCycles++;
+            smTimespecAddUs(&deadline,scheduler->periodUs);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        latency=smTimespecDiffUs(&deadline,&now);
+        stat=scheduler->callback(scheduler->userdata);
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        duration=smTimespecDiffUs(&deadline,&now)-latency;
+
+        scheduler->cycles++;
+        if(stat!=SM_OK)
+            scheduler->failedCycles++;
+        if(duration>scheduler->replyDeadlineUs)
+            scheduler->lateReplies++;
+        if(latency>(int64_t)scheduler->maxWakeupLatencyUs)
+            scheduler->maxWakeupLatencyUs=(smuint32)latency;
+        if(duration>(int64_t)scheduler->maxCallbackUs)
+            scheduler->maxCallbackUs=(smuint32)duration;
+        smCyclicHistogramAdd(scheduler,scheduler->wakeupLatencyHistogram,latency);
+        smCyclicHistogramAdd(scheduler,scheduler->callbackHistogram,duration);
+
+        //next deadline. if it has passed already, skip missed cycles instead of running them late back-to-back
+        smTimespecAddUs(&deadline,scheduler->periodUs);
+        if(smTimespecDiffUs(&deadline,&now)>=0)
+        {
+            int64_t missed=smTimespecDiffUs(&deadline,&now)/scheduler->periodUs+1;
+            scheduler->overruns++;
+            smTimespecAddUs(&deadline,missed*scheduler->periodUs);
+        }
+    }
+    return NULL;
+}
+
+SM_STATUS smCyclicSchedulerStart( CyclicScheduler *scheduler )
+{
+    pthread_attr_t attr;
+    int err;
+
+    if(scheduler->running==smtrue || scheduler->callback==NULL || scheduler->periodUs<=0)
+        return SM_ERR_PARAMETER;
+
+    pthread_attr_init(&attr);
+    if(scheduler->priority>0)
+    {
+        struct sched_param param;
+        memset(&param,0,sizeof(param));
+        param.sched_priority=scheduler->priority;
+        pthread_attr_setinheritsched(&attr,PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr,SCHED_FIFO);
+        pthread_attr_setschedparam(&attr,&param);
+    }
+    if(scheduler->cpu>=0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(scheduler->cpu,&cpus);
+        pthread_attr_setaffinity_np(&attr,sizeof(cpus),&cpus);
+    }
+
+    scheduler->running=smtrue;
+    err=pthread_create(&scheduler->thread,&attr,smCyclicSchedulerThread,scheduler);
+    pthread_attr_destroy(&attr);
+    if(err!=0)//i.e. no permission for SCHED_FIFO or invalid CPU
+    {
+        scheduler->running=smfalse;
+        return SM_ERR_PARAMETER;
+    }
+    return SM_OK;
+}
+
+SM_STATUS smCyclicSchedulerStop( CyclicScheduler *scheduler )
+{
+    if(scheduler->running==smfalse)
+        return SM_ERR_PARAMETER;
+
+    scheduler->running=smfalse;
+    pthread_join(scheduler->thread,NULL);
+    return SM_OK;
+}
+
+#else
+
+SM_STATUS smCyclicSchedulerStart( CyclicScheduler *scheduler )
+{
+    (void)scheduler;
+    return SM_ERR_PARAMETER;
+}
+
+SM_STATUS smCyclicSchedulerStop( CyclicScheduler *scheduler )
+{
+    (void)scheduler;
+    return SM_ERR_PARAMETER;
+}
+
+#endif
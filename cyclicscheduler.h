@@ -0,0 +1,79 @@
+#ifndef CYCLICSCHEDULER_H
+#define CYCLICSCHEDULER_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "simplemotion.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+/* Cyclic scheduler runs a user callback at fixed period in its own thread, i.e. to call smFastUpdateCycleWithStructs
+ * or smFastUpdateCycleMultiple for real time control. Wake ups use absolute deadlines (clock_nanosleep on
+ * CLOCK_MONOTONIC), so period errors don't accumulate. Thread may optionally run with SCHED_FIFO priority and be
+ * pinned to one CPU.
+ *
+ * Timing statistics are collected in the struct while the scheduler runs:
+ * -wake up latency: how late the thread woke up after the deadline
+ * -callback duration: how long the callback took, i.e. the round trip time of fast update cycle
+ * -overruns: callback didn't return before next deadline, missed cycles are skipped, not run late
+ * -late replies: callback took longer than replyDeadlineUs
+ * -failed cycles: callback returned other than SM_OK, or waiting for the deadline failed and callback wasn't called
+ * Histograms have SM_CYCLIC_HISTOGRAM_BINS bins that cover durations from 0 to periodUs, last bin counts also all
+ * longer durations.
+ *
+ * Scheduler is available only on Linux, elsewhere smCyclicSchedulerStart returns SM_ERR_PARAMETER.
+ */
+
+#define SM_CYCLIC_HISTOGRAM_BINS 32
+
+/** called once per period, return value other than SM_OK is counted as failed cycle */
+typedef SM_STATUS (*smCyclicCallback)( void *userdata );
+
+typedef struct _CyclicScheduler {
+    //settings, may be changed after smCyclicSchedulerInit before smCyclicSchedulerStart
+    smint32 periodUs;
+    smint32 replyDeadlineUs;//callback running longer than this is counted as late reply, default periodUs/2
+    smint32 priority;//SCHED_FIFO priority 1-99 (requires permission), 0=normal scheduling (default)
+    smint32 cpu;//CPU number to pin the thread on, -1=no pinning (default)
+    smCyclicCallback callback;
+    void *userdata;
+
+    //statistics, may be read while running
+    volatile smuint32 cycles;
+    volatile smuint32 overruns;
+    volatile smuint32 lateReplies;
+    volatile smuint32 failedCycles;
+    volatile smuint32 maxWakeupLatencyUs;
+    volatile smuint32 maxCallbackUs;
+    volatile smuint32 wakeupLatencyHistogram[SM_CYCLIC_HISTOGRAM_BINS];
+    volatile smuint32 callbackHistogram[SM_CYCLIC_HISTOGRAM_BINS];
+
+    //internal
+    volatile smbool running;
+#if defined(__linux__)
+    pthread_t thread;
+#endif
+} CyclicScheduler;
+
+/** initialize scheduler with default settings and zero statistics */
+LIB void smCyclicSchedulerInit( CyclicScheduler *scheduler, smint32 periodUs, smCyclicCallback callback, void *userdata );
+
+/** start calling the callback from new thread. first call is made one period after start.
+ * returns SM_ERR_PARAMETER if settings are invalid or thread can't be created with requested priority or CPU. */
+LIB SM_STATUS smCyclicSchedulerStart( CyclicScheduler *scheduler );
+
+/** stop scheduler and wait until the thread has ended, callback is not running after this returns */
+LIB SM_STATUS smCyclicSchedulerStop( CyclicScheduler *scheduler );
+
+/** zero statistics, may be called while running */
+LIB void smCyclicSchedulerResetStatistics( CyclicScheduler *scheduler );
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // CYCLICSCHEDULER_H
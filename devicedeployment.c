@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <simplemotion_private.h>
 #include <math.h>
 
@@ -368,6 +369,34 @@ LoadConfigurationStatus smLoadConfiguration(const smbus smhandle, const int smad
     return ret;
 }
 
+//max number of changed parameters collected before writing them to device
+#define PARAMETER_WRITE_BATCH 32
+
+//write collected parameter values to device, returns number of parameters that failed
+static int writePendingParameters( const smbus smhandle, const int smaddress, const smint16 *addresses, const smint32 *values, int count )
+{
+    smint32 statuses[PARAMETER_WRITE_BATCH];
+    SM_STATUS stat;
+    int i, errors=0;
+
+    if(count==0)
+        return 0;
+
+    resetCumulativeStatus( smhandle );
+    stat=smWriteParameters( smhandle, smaddress, addresses, values, statuses, count );
+
+    //check if above code succeed
+    for(i=0;i<count;i++)
+    {
+        if( (stat!=SM_OK && stat!=SM_ERR_PARAMETER) || statuses[i]!=SMP_CMD_STATUS_ACK )
+        {
+            errors++;
+            smDebug(smhandle,SMDebugLow,"Failed to write parameter value %d to address %d (status: %d %d)\n",values[i],addresses[i],(int)stat,statuses[i]);
+        }
+    }
+    return errors;
+}
+
 /**
  * @brief smConfigureParametersFromBuffer Same as smConfigureParameters but reads data from user specified memory address instead of file. Configures all target device parameters from file and performs device restart if necessary. This can take few seconds to complete. This may take 2-5 seconds to call.
  * @param smhandle SM bus handle, must be opened before call
@@ -395,6 +424,9 @@ LIB LoadConfigurationStatus smLoadConfigurationFromBuffer( const smbus smhandle,
     *skippedCount=-1;
     *errorCount=-1;
     smbool deviceDisabled=smfalse;
+    smint16 pendingAddresses[PARAMETER_WRITE_BATCH];
+    smint32 pendingValues[PARAMETER_WRITE_BATCH];
+    int numPending=0;
 
     //parse DRC header
     if(parseDRCInfo(drcData,drcDataLength,&DRCVersion,&numParams,&DRCFileFeatureBits,&DRCEssentialFileFeatureBits)!=smtrue)
@@ -436,6 +468,7 @@ LIB LoadConfigurationStatus smLoadConfigurationFromBuffer( const smbus smhandle,
 
         if( readOk==smfalse ) //corrupted file
         {
+            setErrors+=writePendingParameters(smhandle,smaddress,pendingAddresses,pendingValues,numPending);
             *skippedCount=ignoredCount;
             *errorCount=setErrors;
             return CFGInvalidFile;
@@ -466,29 +499,15 @@ LIB LoadConfigurationStatus smLoadConfigurationFromBuffer( const smbus smhandle,
                         deviceDisabled=smtrue;
                     }
 
-                    resetCumulativeStatus( smhandle );
-                    smint32 dummy;
-                    smint32 cmdSetAddressStatus;
-                    smint32 cmdSetValueStatus;
-
                     smDebug(smhandle,SMDebugMid,"Writing parameter addr %d value %d\n",param.address,configFileValue);
-                    //use low level SM commands so we can get execution status of each subpacet:
-                    smAppendSMCommandToQueue( smhandle, SM_SET_WRITE_ADDRESS, SMP_RETURN_PARAM_LEN );
-                    smAppendSMCommandToQueue( smhandle, SM_WRITE_VALUE_24B, SMPRET_CMD_STATUS );
-                    smAppendSMCommandToQueue( smhandle, SM_SET_WRITE_ADDRESS, param.address );
-                    smAppendSMCommandToQueue( smhandle, SM_WRITE_VALUE_32B, configFileValue );
-                    smExecuteCommandQueue( smhandle, smaddress );
-                    smGetQueuedSMCommandReturnValue( smhandle, &dummy );
-                    smGetQueuedSMCommandReturnValue( smhandle, &dummy );
-                    smGetQueuedSMCommandReturnValue( smhandle, &cmdSetAddressStatus );
-                    smGetQueuedSMCommandReturnValue( smhandle, &cmdSetValueStatus );
-
-                    //check if above code succeed
-                    if( getCumulativeStatus(smhandle)!=SM_OK || cmdSetAddressStatus!=SMP_CMD_STATUS_ACK || cmdSetValueStatus!=SMP_CMD_STATUS_ACK )
+                    //collect changed parameters and write them in batches, smWriteParameters gives execution status of each
+                    pendingAddresses[numPending]=param.address;
+                    pendingValues[numPending]=configFileValue;
+                    numPending++;
+                    if(numPending==PARAMETER_WRITE_BATCH)
                     {
-                        SM_STATUS stat=getCumulativeStatus(smhandle);
-                        setErrors++;
-                        smDebug(smhandle,SMDebugLow,"Failed to write parameter value %d to address %d (status: %d %d %d)\n",configFileValue,param.address,(int)stat,cmdSetAddressStatus,cmdSetValueStatus);
+                        setErrors+=writePendingParameters(smhandle,smaddress,pendingAddresses,pendingValues,numPending);
+                        numPending=0;
                     }
 
                     changed++;
@@ -502,6 +521,8 @@ LIB LoadConfigurationStatus smLoadConfigurationFromBuffer( const smbus smhandle,
         }
     }
 
+    setErrors+=writePendingParameters(smhandle,smaddress,pendingAddresses,pendingValues,numPending);
+
     *skippedCount=ignoredCount;
     *errorCount=setErrors;
 
@@ -627,6 +648,75 @@ smuint32 bufferGet32( smuint8 **buf )
 }
 
 
+//bytes of .gdf file needed by checkFirmwareFileHeader
+#define GDF_HEADER_SIZE 16
+
+//check .gdf file type, version and that sizes given in header fit in file. needs only the first GDF_HEADER_SIZE bytes
+//so that invalid files can be rejected before reading them. returns FWComplete if file may be valid
+static FirmwareUploadStatus checkFirmwareFileHeader( const smuint8 *header, smuint32 filesize )
+{
+    smuint32 filetype, primaryMCUSize, secondaryMCUSize;
+    smuint16 filever;
+
+    if(filesize<GDF_HEADER_SIZE)
+        return FWInvalidFile;
+
+    memcpy(&filetype,header,4);
+    if(filetype!=0x57464447) //check header string "GDFW"
+        return FWInvalidFile;
+
+    memcpy(&filever,header+4,2);
+    if(filever==300)
+    {
+        memcpy(&primaryMCUSize,header+8,4);
+        memcpy(&secondaryMCUSize,header+12,4);
+        if(secondaryMCUSize==0xffffffff)
+            secondaryMCUSize=0;//it is not present
+        //data is followed by 4 byte checksum
+        if((uint64_t)GDF_HEADER_SIZE+primaryMCUSize+secondaryMCUSize+4>filesize)
+            return FWInvalidFile;
+    }
+    else if(filever>=400 && filever<500)
+    {
+        //header is followed by number of chunks and file ends with CRC-32
+        if(filesize<GDF_HEADER_SIZE+4+4)
+            return FWInvalidFile;
+    }
+    else
+        return FWIncompatibleFW;//unsupported file version
+
+    return FWComplete;
+}
+
+//sum of bytes, used as checksum of GDF version 300 files. 8 bytes are summed at a time in four 16 bit
+//lanes of a 64 bit word. each step adds at most 2*255 to a lane, so lanes are folded every 128 steps
+static smuint32 byteSum( const smuint8 *data, smuint32 len )
+{
+    const uint64_t mask=0x00ff00ff00ff00ffULL;
+    smuint32 sum=0;
+
+    while(len>=8)
+    {
+        uint64_t lanes=0, word;
+        smuint32 steps=len/8>128 ? 128 : len/8;
+        smuint32 i;
+
+        for(i=0;i<steps;i++)
+        {
+            memcpy(&word,data,8);
+            lanes+=(word&mask)+((word>>8)&mask);
+            data+=8;
+        }
+        len-=steps*8;
+        sum+=(smuint32)(lanes&0xffff)+(smuint32)((lanes>>16)&0xffff)+
+             (smuint32)((lanes>>32)&0xffff)+(smuint32)(lanes>>48);
+    }
+    while(len-->0)
+        sum+=*data++;
+
+    return sum;
+}
+
 FirmwareUploadStatus parseFirmwareFile(smuint8 *data, smuint32 numbytes, smuint32 connectedDeviceTypeId,
                                         smuint32 *primaryMCUDataOffset, smuint32 *primaryMCUDataLenth,
                                         smuint32 *secondaryMCUDataOffset,smuint32 *secondaryMCUDataLength,
@@ -636,10 +726,9 @@ FirmwareUploadStatus parseFirmwareFile(smuint8 *data, smuint32 numbytes, smuint3
 
     //see https://granitedevices.com/wiki/Firmware_file_format_(.gdf)
 
-    smuint32 filetype;
-    filetype=((smuint32*)data)[0];
-    if(filetype!=0x57464447) //check header string "GDFW"
-        return FWInvalidFile;
+    FirmwareUploadStatus headerStatus=checkFirmwareFileHeader(data,numbytes);
+    if(headerStatus!=FWComplete)
+        return headerStatus;
 
     smuint32 filever, deviceid;
     *FWUniqueID=0;//updated later if available
@@ -660,17 +749,13 @@ FirmwareUploadStatus parseFirmwareFile(smuint8 *data, smuint32 numbytes, smuint3
             return FWIncompatibleFW;
 
         //get checksum and check it
-        smuint32 cksum,cksumcalc=0;
-        smuint32 i;
+        smuint32 cksum,cksumcalc;
         smuint32 cksumOffset=4+2+2+4+4+primaryMCUSize+secondaryMCUSize;
         if(cksumOffset>numbytes-4)
             return FWInvalidFile;
-        cksum=((smuint32*)(data+cksumOffset))[0];
+        memcpy(&cksum,data+cksumOffset,4);//may be unaligned
 
-        for(i=0;i< numbytes-4;i++)
-        {
-            cksumcalc+=data[i];
-        }
+        cksumcalc=byteSum(data,numbytes-4);
 
         if(cksum!=cksumcalc)
             return FWIncompatibleFW;
@@ -822,6 +907,20 @@ FirmwareUploadStatus parseFirmwareFile(smuint8 *data, smuint32 numbytes, smuint3
     return FWComplete;
 }
 
+/* table for converting enums to strings */
+const FirmwareUploadStatusToStringType FirmwareUploadStatusToString[]=
+{
+    {FWComplete,"FW install complete or given FW was already installed"},
+    {FWInvalidFile,"Invalid FW file"},
+    {FWConnectionError,"Connection error"},
+    {FWIncompatibleFW,"Incompatible FW file"},
+    {FWConnectionLoss,"Connection loss during upgrade"},
+    {FWUnsupportedTargetDevice,"Unsupported target device"},
+    {FWFileNotReadable,"FW file not readable"},
+    {FWConnectingDFUModeFailed,"Failed to connect in device DFU mode"},
+    {FWAlreadyInstalled,"Given firmware already installed in the target device"},
+};
+
 /**
  * @brief smFirmwareUploadStatusToString converts FirmwareUploadStatus enum to string.
  * @param string user supplied pointer where string will be stored. must have writable space for at least 100 characters.
@@ -896,6 +995,39 @@ smbool loadBinaryFile(const char *filename, smuint8 **data, int *numbytes , smbo
 
 
 
+//load .gdf file for smFirmwareUploadFromBuffer. header is read and checked first, so that invalid files are
+//rejected without reading them. the file is copied to memory, so it may change on disk during the upload that takes
+//many smFirmwareUpload calls. free data when done. returns FWComplete on success
+static FirmwareUploadStatus loadFirmwareFile( const char *filename, smuint8 **data, int *numbytes )
+{
+    smuint8 header[GDF_HEADER_SIZE];
+    FirmwareUploadStatus stat;
+    FILE *f=fopen(filename,"rb");
+    long length;
+    if(f==NULL)
+        return FWFileNotReadable;
+
+    fseek(f,0,SEEK_END);
+    length=ftell(f);
+    fseek(f,0,SEEK_SET);
+    if(length<0 || length>INT_MAX || (length>=GDF_HEADER_SIZE && fread(header,1,GDF_HEADER_SIZE,f)!=GDF_HEADER_SIZE))
+    {
+        fclose(f);
+        return FWFileNotReadable;
+    }
+    fclose(f);
+    stat=checkFirmwareFileHeader(header,(smuint32)length);
+    if(stat!=FWComplete)
+    {
+        smDebug(-1,SMDebugLow,"Firmware file header check failed\n");
+        return stat;
+    }
+
+    if(loadBinaryFile(filename,data,numbytes,smfalse)!=smtrue)
+        return FWFileNotReadable;
+    return FWComplete;
+}
+
 //flashing STM32 (host side mcu)
 smbool flashFirmwarePrimaryMCU( smbus smhandle, int deviceaddress, const smuint8 *data, smint32 size, int *progress )
 {
@@ -951,6 +1083,7 @@ smbool flashFirmwarePrimaryMCU( smbus smhandle, int deviceaddress, const smuint8
         //upload data in 32=BL_CHUNK_LEN word chunks
         for(;uploadIndex<size;)
         {
+            smLockBus( smhandle );
             smAppendSMCommandToQueue( smhandle, SMPCMD_SETPARAMADDR, SMP_BOOTLOADER_UPLOAD );
             for(c=0;c<BL_CHUNK_LEN;c++)
             {
@@ -975,10 +1108,12 @@ smbool flashFirmwarePrimaryMCU( smbus smhandle, int deviceaddress, const smuint8
 
                 if(getCumulativeStatus(smhandle)!=SM_OK)
                 {
+                    smUnlockBus( smhandle );
                     state=Init;
                     return smfalse;
                 }
             }
+            smUnlockBus( smhandle );
 
             *progress=5+90*uploadIndex/size;//gives value 5-95
             if(*progress>=94)//95 will indicate that progress is complete. dont let it indicate that yet.
@@ -1068,8 +1203,9 @@ FirmwareUploadStatus smFirmwareUpload( const smbus smhandle, const int smaddress
     //load file to buffer if not loaded yet
     if(fileLoaded==smfalse)
     {
-        if(loadBinaryFile(firmware_filename,&fwData,&fwDataLength,smfalse)!=smtrue)
-            return FWFileNotReadable;
+        FirmwareUploadStatus loadStatus=loadFirmwareFile(firmware_filename,&fwData,&fwDataLength);
+        if(loadStatus!=FWComplete)
+            return loadStatus;
         fileLoaded=smtrue;
     }
 
@@ -56,18 +56,7 @@ typedef struct
 } FirmwareUploadStatusToStringType;
 
 /* table for converting enums to strings */
-const FirmwareUploadStatusToStringType FirmwareUploadStatusToString[]=
-{
-    {FWComplete,"FW install complete or given FW was already installed"},
-    {FWInvalidFile,"Invalid FW file"},
-    {FWConnectionError,"Connection error"},
-    {FWIncompatibleFW,"Incompatible FW file"},
-    {FWConnectionLoss,"Connection loss during upgrade"},
-    {FWUnsupportedTargetDevice,"Unsupported target device"},
-    {FWFileNotReadable,"FW file not readable"},
-    {FWConnectingDFUModeFailed,"Failed to connect in device DFU mode"},
-    {FWAlreadyInstalled,"Given firmware already installed in the target device"},
-};
+extern const FirmwareUploadStatusToStringType FirmwareUploadStatusToString[];
 
 /**
  * @brief smFirmwareUpload Sets drive in firmware upgrade mode if necessary and uploads a new firmware. Call this many until it returns value 100 (complete) or a negative value (error).
@@ -48,8 +48,8 @@ smBusdevicePointer serialPortOpen(const char * port_device_name, smint32 baudrat
     int customBaudRate = 0;
     *success=smfalse;
 
-    //check if devicename is correct format
-    if( strncmp(port_device_name,"/dev/tty",8) != 0 && strncmp(port_device_name,"/dev/cu.",8) != 0)
+    //check if devicename is correct format. /dev/pts/ is a pseudo terminal, i.e. a simulated device or a serial port forwarded over network
+    if( strncmp(port_device_name,"/dev/tty",8) != 0 && strncmp(port_device_name,"/dev/cu.",8) != 0 && strncmp(port_device_name,"/dev/pts/",9) != 0)
         return SMBUSDEVICE_RETURN_ON_OPEN_FAIL;
 
     port_handle = open(port_device_name, O_RDWR | O_NOCTTY | O_NONBLOCK);
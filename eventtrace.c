@@ -0,0 +1,170 @@
+#include <string.h>
+#include "simplemotion_private.h"
+#include "eventtrace.h"
+#include "sm485.h"
+
+#ifdef ENABLE_EVENT_TRACE
+
+#if (SM_TRACE_EVENTS & (SM_TRACE_EVENTS-1))!=0
+#error SM_TRACE_EVENTS must be a power of two
+#endif
+
+//ring slot. sequence is the event number + 1 when event is complete, 0 while it's being written
+typedef struct
+{
+    smuint32 sequence;
+    SM_TRACE_EVENT event;
+} SM_TRACE_SLOT;
+
+//events of one bus. events may be recorded by any thread (i.e. recordStatus is called also without bus lock), so slots
+//are reserved with atomic add. reader detects events overwritten during copying from the sequence numbers
+typedef struct
+{
+    smuint32 reserved;//number of events reserved so far
+    smuint32 readPos;//number of the next event to read
+    SM_TRACE_SLOT slots[SM_TRACE_EVENTS];
+} SM_TRACE_RING;
+
+static SM_TRACE_RING smTraceRings[SM_MAX_BUSES];
+static smbool smTraceEnabled=smtrue;
+
+void smTraceEvent( const smbus handle, const smuint8 type, const smuint8 address, const smint32 arg0, const smint32 arg1 )
+{
+    SM_TRACE_RING *ring;
+    SM_TRACE_SLOT *slot;
+    smuint32 number, timestamp;
+
+    if(smTraceEnabled==smfalse || handle<0 || handle>=SM_MAX_BUSES) return;
+
+    timestamp=smGetMonotonicUs();
+    ring=&smTraceRings[handle];
+    number=smAtomicAdd(&ring->reserved,1);
+    slot=&ring->slots[number&(SM_TRACE_EVENTS-1)];
+
+    smAtomicStore(&slot->sequence,0);
+    smAtomicFenceRelease();
+    slot->event.timestampUs=timestamp;
+    slot->event.type=type;
+    slot->event.bus=(smuint8)handle;
+    slot->event.address=address;
+    slot->event.reserved=0;
+    slot->event.args[0]=arg0;
+    slot->event.args[1]=arg1;
+    smAtomicFenceRelease();
+    smAtomicStore(&slot->sequence,number+1);
+}
+
+//discard events recorded before bus was opened
+void smTraceReset( const smbus handle )
+{
+    if(handle<0 || handle>=SM_MAX_BUSES) return;
+
+    smTraceRings[handle].readPos=smAtomicLoad(&smTraceRings[handle].reserved);
+}
+
+void smSetTraceEnabled( smbool enabled )
+{
+    smTraceEnabled=enabled;
+}
+
+smint32 smReadTraceEvents( const smbus handle, SM_TRACE_EVENT *events, smint32 maxEvents, smuint32 *lostEvents )
+{
+    SM_TRACE_RING *ring;
+    smuint32 pos, end, lost=0;
+    smint32 n=0;
+
+    if(lostEvents!=NULL) *lostEvents=0;
+    if(handle<0 || handle>=SM_MAX_BUSES || events==NULL) return 0;
+
+    ring=&smTraceRings[handle];
+    pos=ring->readPos;
+    end=smAtomicLoad(&ring->reserved);
+    if(end-pos>SM_TRACE_EVENTS)
+    {
+        lost=end-pos-SM_TRACE_EVENTS;
+        pos=end-SM_TRACE_EVENTS;
+    }
+
+    while(n<maxEvents && pos!=end)
+    {
+        SM_TRACE_SLOT *slot=&ring->slots[pos&(SM_TRACE_EVENTS-1)];
+        smuint32 sequence=smAtomicLoad(&slot->sequence);
+
+        smAtomicFenceAcquire();
+        if(sequence!=pos+1)
+        {
+            //slot has not been completed yet, read it next time
+            if(sequence==0 || (smint32)(sequence-(pos+1))<0)
+                break;
+            //overwritten by newer event
+            lost++;
+            pos++;
+            continue;
+        }
+
+        events[n]=slot->event;
+        smAtomicFenceAcquire();
+        if(smAtomicLoad(&slot->sequence)!=sequence)
+            lost++;//overwritten while copying
+        else
+            n++;
+        pos++;
+    }
+
+    ring->readPos=pos;
+    if(lostEvents!=NULL) *lostEvents=lost;
+    return n;
+}
+
+#else
+
+void smSetTraceEnabled( smbool enabled )
+{
+    (void)enabled;
+}
+
+smint32 smReadTraceEvents( const smbus handle, SM_TRACE_EVENT *events, smint32 maxEvents, smuint32 *lostEvents )
+{
+    (void)handle;
+    (void)events;
+    (void)maxEvents;
+    if(lostEvents!=NULL) *lostEvents=0;
+    return 0;
+}
+
+#endif
+
+smint32 smFormatTraceEvent( const SM_TRACE_EVENT *event, char *buf, smint32 bufsize )
+{
+    static const char *returnTypes[4]={"RET32B","RET24B","RET16B","RET_OTHER"};
+    int len;
+
+    len=snprintf(buf,bufsize,"%u us bus %d: ",(unsigned)event->timestampUs,(int)event->bus);
+    if(len<0 || len>=bufsize)
+        return len;
+    buf+=len;
+    bufsize-=len;
+
+    switch(event->type)
+    {
+    case SMTraceFrameOut:
+    case SMTraceFrameIn:
+        if(event->args[0]==SMCMD_FAST_UPDATE_CYCLE || event->args[0]==SMCMD_FAST_UPDATE_CYCLE_RET)
+            return len+snprintf(buf,bufsize,"%s %s (addr=%d, %s1=%d, %s2=%d)",event->type==SMTraceFrameOut ? ">" : "<",
+                                cmdidToStr((smuint8)event->args[0]),(int)event->address,
+                                event->type==SMTraceFrameOut ? "w" : "r",(int)(event->args[1]&0xffff),
+                                event->type==SMTraceFrameOut ? "w" : "r",(int)((smuint32)event->args[1]>>16));
+        return len+snprintf(buf,bufsize,"%s %s (addr=%d, payload=%d)",event->type==SMTraceFrameOut ? ">" : "<",
+                            cmdidToStr((smuint8)event->args[0]),(int)event->address,(int)event->args[1]);
+    case SMTraceTransmit:
+        return len+snprintf(buf,bufsize,"transmit %s",event->args[0] ? "ok" : "failed");
+    case SMTraceReturnValue:
+        return len+snprintf(buf,bufsize,"  %s: %d",returnTypes[event->args[0]&3],(int)event->args[1]);
+    case SMTraceReceiveError:
+        return len+snprintf(buf,bufsize,"receive error");
+    case SMTraceStatus:
+        return len+snprintf(buf,bufsize,"status error %d",(int)event->args[0]);
+    default:
+        return len+snprintf(buf,bufsize,"unknown event %d (%d, %d)",(int)event->type,(int)event->args[0],(int)event->args[1]);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef EVENTTRACE_H
+#define EVENTTRACE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "simplemotion.h"
+#include "user_options.h"
+
+/* Binary protocol trace. Library records sent and received packets, return values and errors of each bus as small
+ * fixed size events into a per-bus ring of SM_TRACE_EVENTS events. Recording an event takes a clock read and a few
+ * stores, no formatting or locking, so tracing can be left on in production unlike SMDebugTrace level debug prints.
+ * When the ring is full, oldest events are overwritten.
+ *
+ * Events are read out with smReadTraceEvents, i.e. periodically from a background thread or after a failure, and
+ * turned into text with smFormatTraceEvent only then. Only one thread at a time may read events of one bus.
+ *
+ * Tracing is available when library is compiled with ENABLE_EVENT_TRACE (see user_options.h).
+ */
+
+/* Event types
+ * SMTraceFrameOut=packet assembled for sending, args[0]=cmdid, args[1]=payload bytes
+ *   (fast update cycle: args[1]=write1|write2<<16)
+ * SMTraceTransmit=transmit buffer written to bus device, args[0]=1 on success, 0 on failure
+ * SMTraceFrameIn=valid packet received, address=sender or receiver depending on cmdid, args[0]=cmdid,
+ *   args[1]=payload bytes (fast update cycle: args[1]=read1|read2<<16)
+ * SMTraceReturnValue=return value decoded from packet payload, args[0]=SM_RETURN_* type, args[1]=value
+ * SMTraceReceiveError=corrupt packet or timeout, receiver was reset
+ * SMTraceStatus=error recorded to cumulative status, args[0]=SM_STATUS bits
+ */
+typedef enum _smTraceEventType {SMTraceFrameOut,SMTraceTransmit,SMTraceFrameIn,SMTraceReturnValue,SMTraceReceiveError,SMTraceStatus} smTraceEventType;
+
+typedef struct
+{
+    smuint32 timestampUs;//monotonic clock in microseconds, wraps around every ~71 minutes
+    smuint8 type;//smTraceEventType
+    smuint8 bus;//smbus handle
+    smuint8 address;//SM node address if known, 0 otherwise
+    smuint8 reserved;
+    smint32 args[2];//type specific
+} SM_TRACE_EVENT;
+
+/** enable or disable recording of events on all buses, enabled by default */
+LIB void smSetTraceEnabled( smbool enabled );
+
+/** copy up to maxEvents oldest unread events of bus to events in the order they were recorded and mark them read.
+ * if lostEvents is not NULL, number of events that were overwritten before this call could read them is stored there.
+ * returns number of events copied, 0 if there are none or library is compiled without ENABLE_EVENT_TRACE. */
+LIB smint32 smReadTraceEvents( const smbus handle, SM_TRACE_EVENT *events, smint32 maxEvents, smuint32 *lostEvents );
+
+/** write event as one line of text (without newline) to buf, i.e.
+ *   "123456789 us bus 0: > SMCMD_INSTANT_CMD (addr=1, payload=6)"
+ * returns the length of text like snprintf */
+LIB smint32 smFormatTraceEvent( const SM_TRACE_EVENT *event, char *buf, smint32 bufsize );
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // EVENTTRACE_H
@@ -0,0 +1,192 @@
+#include "simplemotion.h"
+#include "user_options.h"
+#include "simplemotion_private.h"
+#include "paramcache.h"
+
+//drop known values if device may have changed them
+static void smParamCacheCheckGeneration( ParamCache *cache )
+{
+    smuint32 generation=smGetBusGeneration(cache->bushandle);
+    int i, n=0;
+
+    if(generation==cache->busGeneration)
+        return;
+
+    smDebug(cache->bushandle,SMDebugMid,"smParamCache: bus generation changed, dropping known values of SM address %d\n",(int)cache->deviceAddress);
+
+    //keep pending writes, they still need to be written
+    for(i=0;i<cache->numEntries;i++)
+        if(cache->entries[i].dirty==smtrue)
+            cache->entries[n++]=cache->entries[i];
+    cache->numEntries=n;
+    cache->nextEvicted=0;
+    cache->busGeneration=generation;
+}
+
+static ParamCacheEntry *smParamCacheFind( ParamCache *cache, smint16 paramId )
+{
+    int i;
+    for(i=0;i<cache->numEntries;i++)
+        if(cache->entries[i].address==paramId)
+            return &cache->entries[i];
+    return NULL;
+}
+
+//get free entry for new parameter, returns NULL if all are pending writes
+static ParamCacheEntry *smParamCacheNewEntry( ParamCache *cache, smint16 paramId )
+{
+    ParamCacheEntry *e=NULL;
+    int i;
+
+    if(cache->numEntries<SM_PARAM_CACHE_SIZE)
+        e=&cache->entries[cache->numEntries++];
+    else
+    {
+        //replace a known value
+        for(i=0;i<SM_PARAM_CACHE_SIZE && e==NULL;i++)
+        {
+            ParamCacheEntry *candidate=&cache->entries[cache->nextEvicted];
+            cache->nextEvicted=(cache->nextEvicted+1)%SM_PARAM_CACHE_SIZE;
+            if(candidate->dirty==smfalse)
+                e=candidate;
+        }
+        if(e==NULL)
+            return NULL;
+    }
+
+    e->address=paramId;
+    e->dirty=smfalse;
+    return e;
+}
+
+static void smParamCacheRemove( ParamCache *cache, ParamCacheEntry *e )
+{
+    *e=cache->entries[--cache->numEntries];
+    cache->nextEvicted=0;
+}
+
+SM_STATUS smParamCacheInit( ParamCache *cache, smbus handle, smaddr deviceAddress )
+{
+    cache->bushandle=handle;
+    cache->deviceAddress=deviceAddress;
+    cache->busGeneration=smGetBusGeneration(handle);
+    cache->numEntries=0;
+    cache->nextEvicted=0;
+    return SM_OK;
+}
+
+void smParamCacheInvalidate( ParamCache *cache )
+{
+    cache->numEntries=0;
+    cache->nextEvicted=0;
+}
+
+SM_STATUS smParamCacheGet( ParamCache *cache, smint16 paramId, smint32 *paramVal )
+{
+    ParamCacheEntry *e;
+    SM_STATUS stat;
+    smint32 value;
+
+    smParamCacheCheckGeneration(cache);
+
+    e=smParamCacheFind(cache,paramId);
+    if(e!=NULL)
+    {
+        *paramVal=e->value;
+        return SM_OK;
+    }
+
+    stat=smRead1Parameter(cache->bushandle,cache->deviceAddress,paramId,&value);
+    if(stat!=SM_OK)
+        return stat;
+
+    *paramVal=value;
+    //read may have been done after device restart, so value is valid only if generation is still the same
+    if(smGetBusGeneration(cache->bushandle)==cache->busGeneration)
+    {
+        e=smParamCacheNewEntry(cache,paramId);
+        if(e!=NULL)
+            e->value=value;
+    }
+    return SM_OK;
+}
+
+SM_STATUS smParamCacheSet( ParamCache *cache, smint16 paramId, smint32 paramVal )
+{
+    ParamCacheEntry *e;
+
+    if(paramId==SMP_SYSTEM_CONTROL)
+    {
+        SM_STATUS stat=smParamCacheFlush(cache,NULL);
+        stat|=smSetParameter(cache->bushandle,cache->deviceAddress,paramId,paramVal);
+        return stat;
+    }
+
+    smParamCacheCheckGeneration(cache);
+
+    e=smParamCacheFind(cache,paramId);
+    if(e!=NULL)
+    {
+        if(e->value!=paramVal)
+        {
+            e->value=paramVal;
+            e->dirty=smtrue;
+        }
+        else
+            smDebug(cache->bushandle,SMDebugHigh,"smParamCache: parameter %d already has value %d, not written\n",(int)paramId,(int)paramVal);
+        return SM_OK;
+    }
+
+    e=smParamCacheNewEntry(cache,paramId);
+    if(e==NULL)//full of pending writes
+    {
+        SM_STATUS stat=smParamCacheFlush(cache,NULL);
+        if(stat!=SM_OK && stat!=SM_ERR_PARAMETER)
+            return stat;
+        e=smParamCacheNewEntry(cache,paramId);
+    }
+    e->value=paramVal;
+    e->dirty=smtrue;
+    return SM_OK;
+}
+
+SM_STATUS smParamCacheFlush( ParamCache *cache, smint32 *numWritten )
+{
+    smint16 addresses[SM_PARAM_CACHE_SIZE];
+    smint32 values[SM_PARAM_CACHE_SIZE];
+    smint32 statuses[SM_PARAM_CACHE_SIZE];
+    ParamCacheEntry *entries[SM_PARAM_CACHE_SIZE];
+    SM_STATUS stat;
+    int i, n=0;
+
+    smParamCacheCheckGeneration(cache);
+
+    for(i=0;i<cache->numEntries;i++)
+    {
+        if(cache->entries[i].dirty==smtrue)
+        {
+            entries[n]=&cache->entries[i];
+            addresses[n]=cache->entries[i].address;
+            values[n]=cache->entries[i].value;
+            n++;
+        }
+    }
+    if(numWritten!=NULL)
+        *numWritten=n;
+    if(n==0)
+        return SM_OK;
+
+    stat=smWriteParameters(cache->bushandle,cache->deviceAddress,addresses,values,statuses,n);
+
+    //go backwards because removing an entry moves the last one in its place
+    for(i=n-1;i>=0;i--)
+    {
+        if(statuses[i]==SMP_CMD_STATUS_ACK)
+            entries[i]->dirty=smfalse;
+        else if(stat==SM_OK || stat==SM_ERR_PARAMETER)//rejected by device, value is unknown
+            smParamCacheRemove(cache,entries[i]);
+        //otherwise communication failed and value stays pending
+    }
+
+    return stat;
+}
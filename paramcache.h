@@ -0,0 +1,62 @@
+#ifndef PARAMCACHE_H
+#define PARAMCACHE_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "simplemotion.h"
+#include "user_options.h"
+
+/* Host side cache of parameter values of one device. Values read or written through the cache are remembered, so
+ * that writing a value the device is already known to have sends nothing, and several writes into same parameter
+ * before smParamCacheFlush are sent as one. Written values are kept in the cache (dirty) until smParamCacheFlush
+ * writes all of them in as few packets as possible with smWriteParameters.
+ *
+ * Cache forgets all known values when bus generation changes (see smGetBusGeneration), i.e. after the device is
+ * restarted through SMP_SYSTEM_CONTROL or the bus is purged. Values written into the device by other means than the
+ * cache are not seen, so call smParamCacheInvalidate after that.
+ *
+ * Parameters that act as commands (i.e. SMP_SYSTEM_CONTROL) must not be written through the cache because repeated
+ * writes of same value are suppressed. For SMP_SYSTEM_CONTROL smParamCacheSet flushes pending writes and writes it
+ * immediately without caching.
+ */
+
+typedef struct _ParamCacheEntry {
+    smint16 address;
+    smint32 value;
+    smbool dirty;//value is not yet written into device
+} ParamCacheEntry;
+
+typedef struct _ParamCache {
+    smbus bushandle;
+    smaddr deviceAddress;
+    smuint32 busGeneration;//smGetBusGeneration when values were known
+    smint32 numEntries;
+    smint32 nextEvicted;//round robin index of entry to be replaced when cache is full
+    ParamCacheEntry entries[SM_PARAM_CACHE_SIZE];
+} ParamCache;
+
+/** initialize empty cache for device at deviceAddress */
+LIB SM_STATUS smParamCacheInit( ParamCache *cache, smbus handle, smaddr deviceAddress );
+
+/** forget all known and pending values */
+LIB void smParamCacheInvalidate( ParamCache *cache );
+
+/** get parameter value from cache, or read it from device if not known */
+LIB SM_STATUS smParamCacheGet( ParamCache *cache, smint16 paramId, smint32 *paramVal );
+
+/** set parameter value to be written at next smParamCacheFlush. nothing is written if device is known to have the
+ * value already. if cache is full, pending writes are flushed first. */
+LIB SM_STATUS smParamCacheSet( ParamCache *cache, smint16 paramId, smint32 paramVal );
+
+/** write all pending values into device. Returns SM_OK if all were acknowledged and SM_ERR_PARAMETER if device
+ * rejected some of them, rejected values are dropped from the cache. numWritten (may be NULL) is set to number of
+ * parameters sent. On communication error unwritten values stay pending. */
+LIB SM_STATUS smParamCacheFlush( ParamCache *cache, smint32 *numWritten );
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif // PARAMCACHE_H
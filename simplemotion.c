@@ -1,6 +1,11 @@
 
 //Copyright (c) Granite Devices Oy
 
+//usleep and recursive pthread mutexes are not declared in strict C standard modes (i.e. -std=c11) without this
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
@@ -32,6 +37,52 @@ FILE *smDebugOut=NULL;
 smbool smIsHandleOpen( const smbus handle );
 
 SM_STATUS smReceiveReturnPacket( smbus bushandle );
+SM_STATUS smDecodeSMCommandReturnValue( smbus bushandle, const smuint8 *buf, smint16 *readpos, smint16 size, smint32 *retValue );
+void smWaitSubmittedTransaction( const smbus bushandle );
+smint32 smReceiveBytesPending( smbus bushandle );
+void smNoteParameterWrite( const smbus handle, const smint16 paramAddress, const smint32 paramValue );
+void smRecordLatency( const smbus handle, const smLatencyType type );
+
+//one target node of pipelined transaction. payload holds the queued commands until the pipeline is executed
+//and the reply payload after that
+typedef struct
+{
+    smaddr address;
+    smuint8 cmdid;//SMCMD_INSTANT_CMD or SMCMD_BUFFERED_CMD
+    smbool replyReceived;
+    smint16 payloadsize;
+    smuint8 payload[SM485_MAX_PAYLOAD_BYTES];
+} SM_PIPELINE_SLOT;
+
+//bus command queue (unsent commands and unread return values) saved while transaction reply is received in the same
+//buffer, see smSaveCommandQueue
+typedef struct
+{
+    smint16 bytes;//bytes of buf in use
+    smint16 payloadsize;
+    smint16 readpos;
+    smuint8 buf[SM485_RSBUFSIZE];
+} SM_QUEUE_STATE;
+
+//transaction object with own command and return value buffers, see smAllocateTransaction
+typedef struct
+{
+    smbool allocated;
+    smbool executed;//true after smExecuteTransaction, next append starts a new command queue
+    smint16 txBytes;//queued command bytes in txBuf
+    smint16 rxBytes;//received return value bytes in rxBuf
+    smint16 rxReadPos;//return values before this position have been read
+    smbool txBufFull;//like transmitBufFull of bus, set if append didn't fit. then execute sends nothing
+    smuint8 txBuf[SM485_MAX_PAYLOAD_BYTES];
+    smuint8 rxBuf[SM485_MAX_PAYLOAD_BYTES];
+
+    //for smSubmitTransaction
+    smbool submitted;//true from submit until completion callback
+    SM_STATUS status;//result of last submitted execution, SM_NONE while pending
+    smaddr target;
+    smTransactionCallback callback;
+    void *userdata;
+} SM_TRANSACTION;
 
 typedef struct SM_BUS_
 {
@@ -45,7 +96,8 @@ typedef struct SM_BUS_
     smuint8 recv_rsbuf[SM485_RSBUFSIZE];
     smuint8 recv_cmdid;
     smuint8 recv_addr;
-    smuint16 recv_crc;
+    smuint8 recv_header[3];//cmdid, size and addr bytes of packet being received. CRC is checked over header and payload at once
+    smint16 recv_headerlen;
     smuint16 recv_read_crc_hi;
     smbool receiveComplete;
     smbool transmitBufFull;//set true if user uploads too much commands in one SM transaction. if true, on execute commands, nothing will be sent to bus to prevent unvanted clipped commands and buffer will be cleared
@@ -55,6 +107,26 @@ typedef struct SM_BUS_
     smint16 cmd_recv_queue_bytes;//recv_queue_bytes counted upwards at every smGetQueued.. and compared to payload size
 
 
+    SM_PIPELINE_SLOT pipeline[SM_MAX_PIPELINED_NODES];//for smAppendCommandQueueToPipeline and smExecutePipeline
+    smint16 pipelineNodes;//number of used pipeline slots
+    smbool pipelineExecuted;//true after smExecutePipeline, next append starts a new pipeline
+
+    SM_TRANSACTION transactions[SM_MAX_TRANSACTIONS];
+
+    //submitted transactions in execution order, first one is being executed if asyncInFlight is true
+    smint16 asyncQueue[SM_MAX_TRANSACTIONS];
+    smint16 asyncQueueLen;
+    smbool asyncInFlight;
+    SM_QUEUE_STATE asyncSavedQueue;//bus command queue while in flight transaction reply is received
+    smuint32 asyncDeadline;//smGetMonotonicMs time when reply of in flight transaction timeouts
+
+    smuint32 generation;//see smGetBusGeneration
+
+#ifdef ENABLE_LATENCY_STATISTICS
+    smuint32 transmitTimeUs;//smGetMonotonicUs time of last smTransmitBuffer
+    SM_BUS_STATISTICS statistics;//written under bus lock, read without locking by smGetBusStatistics
+#endif
+
     SM_STATUS cumulativeSmStatus;
 } SM_BUS;
 
@@ -70,32 +142,116 @@ smVerbosityLevel smDebugThreshold=SMDebugTrace;
 
 #if defined(__unix__) || defined(__APPLE__)
 #include <unistd.h>
+#include <time.h>
 void smSleepMs(int millisecs)
 {
     usleep(millisecs*1000);
 }
 
+smuint32 smGetMonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (smuint32)ts.tv_sec*1000+(smuint32)(ts.tv_nsec/1000000);
+}
+
+smuint32 smGetMonotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (smuint32)ts.tv_sec*1000000+(smuint32)(ts.tv_nsec/1000);
+}
+
 #elif defined(_WIN32) || defined(WIN32)
 #include <windows.h>
 void smSleepMs(int millisecs)
 {
     Sleep(millisecs);
 }
+
+smuint32 smGetMonotonicMs()
+{
+    return (smuint32)GetTickCount();
+}
+
+smuint32 smGetMonotonicUs()
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if(frequency.QuadPart==0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (smuint32)((now.QuadPart/frequency.QuadPart)*1000000+(now.QuadPart%frequency.QuadPart)*1000000/frequency.QuadPart);
+}
+#else
+#warning Make sure to implement own smSleepMs, smGetMonotonicMs and smGetMonotonicUs functions for your platform as it is not one of supported ones (unix/win). For more info, see simplemotion_private.h.
+#endif
+
+
+#ifdef ENABLE_BUS_LOCKING
+//each bus has own recursive lock, and a global lock protects opening & closing of buses
+#if defined(_WIN32) || defined(WIN32)
+#include <windows.h>
+static SRWLOCK smGlobalLock=SRWLOCK_INIT;
+static CRITICAL_SECTION smBusLock[SM_MAX_BUSES];
+#define smGlobalLockAcquire() AcquireSRWLockExclusive(&smGlobalLock)
+#define smGlobalLockRelease() ReleaseSRWLockExclusive(&smGlobalLock)
+#define smBusLockInit(i) InitializeCriticalSection(&smBusLock[i])
+#define smBusLockAcquire(i) EnterCriticalSection(&smBusLock[i])
+#define smBusLockRelease(i) LeaveCriticalSection(&smBusLock[i])
+#else
+#include <pthread.h>
+static pthread_mutex_t smGlobalLock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t smBusLock[SM_MAX_BUSES];
+#define smGlobalLockAcquire() pthread_mutex_lock(&smGlobalLock)
+#define smGlobalLockRelease() pthread_mutex_unlock(&smGlobalLock)
+static void smBusLockInit(int i)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr,PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&smBusLock[i],&attr);
+    pthread_mutexattr_destroy(&attr);
+}
+#define smBusLockAcquire(i) pthread_mutex_lock(&smBusLock[i])
+#define smBusLockRelease(i) pthread_mutex_unlock(&smBusLock[i])
+#endif
 #else
-#warning Make sure to implement own smSleepMs function for your platform as it is not one of supported ones (unix/win). For more info, see simplemotion_private.h.
+#define smGlobalLockAcquire() {}
+#define smGlobalLockRelease() {}
 #endif
 
 
+SM_STATUS smLockBus( const smbus handle )
+{
+    if(handle<0 || handle>=SM_MAX_BUSES || smInitialized==smfalse) return SM_ERR_NODEVICE;
+#ifdef ENABLE_BUS_LOCKING
+    smBusLockAcquire(handle);
+#endif
+    return SM_OK;
+}
+
+SM_STATUS smUnlockBus( const smbus handle )
+{
+    if(handle<0 || handle>=SM_MAX_BUSES || smInitialized==smfalse) return SM_ERR_NODEVICE;
+#ifdef ENABLE_BUS_LOCKING
+    smBusLockRelease(handle);
+#endif
+    return SM_OK;
+}
+
 extern const char *smDebugPrefixString;
 extern const char *smDebugSuffixString;
 
 #ifdef ENABLE_DEBUG_PRINTS
-void smDebug( smbus handle, smVerbosityLevel verbositylevel, char *format, ...)
+//called through smDebug macro which has checked the verbosity level already
+void smDebugPrint( smbus handle, smVerbosityLevel verbositylevel, char *format, ...)
 {
     va_list fmtargs;
     char buffer[1024];
 
-    if(smDebugOut!=NULL && verbositylevel <= smDebugThreshold )
+    (void)verbositylevel;
+    if(smDebugOut!=NULL)
     {
         #ifdef SM_ENABLE_DEBUG_PREFIX_STRING //user app may define this macro if need to write custom prefix, if defined, then define also "const char *smDebugPrefixString="my string";" somewhere in your app.
         fprintf(smDebugOut, smDebugPrefixString);
@@ -137,7 +293,7 @@ void smResetSM485variables(smbus handle)
     smBus[handle].recv_storepos=0;//number of bytes to expect data in cmd, -1=wait cmd header
     smBus[handle].recv_cmdid=0;// cmdid=0 kun ed komento suoritettu
     smBus[handle].recv_addr=255;
-    smBus[handle].recv_crc=SM485_CRCINIT;
+    smBus[handle].recv_headerlen=0;
     smBus[handle].recv_read_crc_hi=0xffff;//bottom bits will be contains only 1 byte when read
     smBus[handle].receiveComplete=smfalse;
     smBus[handle].transmitBufFull=smfalse;
@@ -155,20 +311,40 @@ smuint16 calcCRC16(smuint8 data, smuint16 crc)
     return crc;
 }
 
-smuint16 calcCRC16Buf(const char *buffer, smuint16 buffer_length)
+//slicing-by-8 version of calcCRC16. CRC register is kept internally in byte swapped order
+//so that table_crc16_slice entries can be XORed together without shifting bytes around.
+smuint16 calcCRC16BufWithInit( const smuint8 *buf, smint32 len, smuint16 crcinit )
 {
-    smuint8 crc_hi = 0xFF; /* high CRC byte initialized */
-    smuint8 crc_lo = 0xFF; /* low CRC byte initialized */
-    unsigned int i; /* will index into CRC lookup */
+    smuint16 crc=(smuint16)((crcinit>>8)|(crcinit<<8));
+    smuint16 x;
 
-    /* pass through message buffer */
-    while (buffer_length--) {
-        i = crc_hi ^ *buffer++; /* calculate the CRC  */
-        crc_hi = crc_lo ^ table_crc16_hi[i];
-        crc_lo = table_crc16_lo[i];
+    while(len>=8)
+    {
+        x=crc^(buf[0]|(buf[1]<<8));
+        crc=table_crc16_slice[7][x&0xff] ^ table_crc16_slice[6][x>>8] ^
+            table_crc16_slice[5][buf[2]] ^ table_crc16_slice[4][buf[3]] ^
+            table_crc16_slice[3][buf[4]] ^ table_crc16_slice[2][buf[5]] ^
+            table_crc16_slice[1][buf[6]] ^ table_crc16_slice[0][buf[7]];
+        buf+=8;
+        len-=8;
+    }
+    if(len>=4)
+    {
+        x=crc^(buf[0]|(buf[1]<<8));
+        crc=table_crc16_slice[3][x&0xff] ^ table_crc16_slice[2][x>>8] ^
+            table_crc16_slice[1][buf[2]] ^ table_crc16_slice[0][buf[3]];
+        buf+=4;
+        len-=4;
     }
+    while(len-->0)
+        crc=(crc>>8) ^ table_crc16_slice[0][(crc^*buf++)&0xff];
+
+    return (smuint16)((crc>>8)|(crc<<8));
+}
 
-    return (crc_hi << 8 | crc_lo);
+smuint16 calcCRC16Buf(const char *buffer, smuint16 buffer_length)
+{
+    return calcCRC16BufWithInit((const smuint8*)buffer,buffer_length,0xFFFF);
 }
 
 smuint8 calcCRC8Buf( smuint8 *buf, int len, int crcinit )
@@ -207,6 +383,12 @@ void smBusesInit()
     for(i=0;i<SM_MAX_BUSES;i++)
     {
         smBus[i].opened=smfalse;;
+#ifdef ENABLE_BUS_LOCKING
+        smBusLockInit(i);
+#endif
+        smBus[i].generation=0;
+        smBus[i].pipelineNodes=0;
+        smBus[i].pipelineExecuted=smfalse;
         smResetSM485variables(i);
     }
     smInitialized=smtrue;
@@ -228,6 +410,8 @@ smbus smOpenBus( const char * devicename )
 {
     int handle;
 
+    smGlobalLockAcquire();
+
     //true on first call
     if(smInitialized==smfalse)
         smBusesInit();
@@ -238,16 +422,36 @@ smbus smOpenBus( const char * devicename )
         if(smBus[handle].opened==smfalse) break;//choose this
     }
     //all handles in use
-    if(handle>=SM_MAX_BUSES) return -1;
+    if(handle>=SM_MAX_BUSES)
+    {
+        smGlobalLockRelease();
+        return -1;
+    }
 
     //open bus device
     smBus[handle].bdHandle=smBDOpen(devicename);
-    if(smBus[handle].bdHandle==-1) return -1;
+    if(smBus[handle].bdHandle==-1)
+    {
+        smGlobalLockRelease();
+        return -1;
+    }
 
     //success
     strncpy( smBus[handle].busDeviceName, devicename, SM_BUSDEVICENAME_LEN );
     smBus[handle].busDeviceName[SM_BUSDEVICENAME_LEN-1]=0;//null terminate string
+    smBus[handle].pipelineNodes=0;
+    smBus[handle].pipelineExecuted=smfalse;
+    memset(smBus[handle].transactions,0,sizeof(smBus[handle].transactions));
+    smBus[handle].asyncQueueLen=0;
+    smBus[handle].asyncInFlight=smfalse;
+    smBus[handle].generation++;
+    smTraceReset(handle);
+#ifdef ENABLE_LATENCY_STATISTICS
+    memset(&smBus[handle].statistics,0,sizeof(smBus[handle].statistics));
+#endif
     smBus[handle].opened=smtrue;
+
+    smGlobalLockRelease();
     return handle;
 }
 
@@ -256,6 +460,8 @@ smbus smOpenBusWithCallbacks( const char *devicename, BusdeviceOpen busOpenCallb
 {
     int handle;
 
+    smGlobalLockAcquire();
+
     //true on first call
     if(smInitialized==smfalse)
         smBusesInit();
@@ -266,16 +472,36 @@ smbus smOpenBusWithCallbacks( const char *devicename, BusdeviceOpen busOpenCallb
         if(smBus[handle].opened==smfalse) break;//choose this
     }
     //all handles in use
-    if(handle>=SM_MAX_BUSES) return -1;
+    if(handle>=SM_MAX_BUSES)
+    {
+        smGlobalLockRelease();
+        return -1;
+    }
 
     //open bus device
     smBus[handle].bdHandle=smBDOpenWithCallbacks(devicename, busOpenCallback, busCloseCallback, busReadCallback, busWriteCallback, busMiscOperationCallback );
-    if(smBus[handle].bdHandle==-1) return -1;
+    if(smBus[handle].bdHandle==-1)
+    {
+        smGlobalLockRelease();
+        return -1;
+    }
 
     //success
     strncpy( smBus[handle].busDeviceName, devicename, SM_BUSDEVICENAME_LEN );
     smBus[handle].busDeviceName[SM_BUSDEVICENAME_LEN-1]=0;//null terminate string
+    smBus[handle].pipelineNodes=0;
+    smBus[handle].pipelineExecuted=smfalse;
+    memset(smBus[handle].transactions,0,sizeof(smBus[handle].transactions));
+    smBus[handle].asyncQueueLen=0;
+    smBus[handle].asyncInFlight=smfalse;
+    smBus[handle].generation++;
+    smTraceReset(handle);
+#ifdef ENABLE_LATENCY_STATISTICS
+    memset(&smBus[handle].statistics,0,sizeof(smBus[handle].statistics));
+#endif
     smBus[handle].opened=smtrue;
+
+    smGlobalLockRelease();
     return handle;
 }
 
@@ -306,12 +532,27 @@ LIB void smSetBaudrate( unsigned long pbs )
 */
 LIB SM_STATUS smCloseBus( const smbus bushandle )
 {
+    smbool success;
+
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
+    //wait until other threads have finished using the bus
+    smGlobalLockAcquire();
+    smLockBus(bushandle);
+    //another thread may have closed the bus while this one waited for the locks
+    if(smBus[bushandle].opened==smfalse)
+    {
+        smUnlockBus(bushandle);
+        smGlobalLockRelease();
+        return recordStatus(bushandle,SM_ERR_NODEVICE);
+    }
     smBus[bushandle].opened=smfalse;
+    success=smBDClose(smBus[bushandle].bdHandle);
+    smUnlockBus(bushandle);
+    smGlobalLockRelease();
 
-    if( smBDClose(smBus[bushandle].bdHandle) == smfalse ) return recordStatus(bushandle,SM_ERR_BUS);
+    if( success == smfalse ) return recordStatus(bushandle,SM_ERR_BUS);
 
     return SM_OK;
 }
@@ -321,10 +562,17 @@ LIB SM_STATUS smCloseBus( const smbus bushandle )
 */
 LIB SM_STATUS smPurge( const smbus bushandle )
 {
+    smbool success;
+
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    if(smBDMiscOperation( bushandle, MiscOperationPurgeRX )==smtrue)
+    smLockBus(bushandle);
+    success=smBDMiscOperation( bushandle, MiscOperationPurgeRX );
+    smBus[bushandle].generation++;//purge is typically done after device restart
+    smUnlockBus(bushandle);
+
+    if(success==smtrue)
         return recordStatus(bushandle,SM_OK);
     else
         return recordStatus(bushandle,SM_ERR_BUS);
@@ -335,10 +583,16 @@ LIB SM_STATUS smPurge( const smbus bushandle )
 */
 LIB SM_STATUS smFlushTX( const smbus bushandle )
 {
+    smbool success;
+
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
 
-    if(smBDMiscOperation( bushandle, MiscOperationFlushTX )==smtrue)
+    smLockBus(bushandle);
+    success=smBDMiscOperation( bushandle, MiscOperationFlushTX );
+    smUnlockBus(bushandle);
+
+    if(success==smtrue)
         return recordStatus(bushandle,SM_OK);
     else
         return recordStatus(bushandle,SM_ERR_BUS);
@@ -370,20 +624,6 @@ char *cmdidToStr(smuint8 cmdid )
     return str;
 }
 
-//write one byte to tx buffer
-//returns true on success
-smbool smWriteByte( const smbus handle, const smuint8 byte, smuint16 *crc )
-{
-    //check if bus handle is valid & opened
-    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
-
-    smbool success=smBDWrite(smBus[handle].bdHandle,byte);
-    if(crc!=NULL)
-        *crc = calcCRC16(byte,*crc);
-
-    return success;
-}
-
 //write tx buffer to bus
 //returns true on success
 smbool smTransmitBuffer( const smbus handle )
@@ -391,49 +631,74 @@ smbool smTransmitBuffer( const smbus handle )
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
+#ifdef ENABLE_LATENCY_STATISTICS
+    smBus[handle].transmitTimeUs=smGetMonotonicUs();
+#endif
     smbool success=smBDTransmit(smBus[handle].bdHandle);
+    smTraceEvent(handle,SMTraceTransmit,0,success==smtrue,0);
     return success;
 }
 
-SM_STATUS smSendSMCMD( smbus handle, smuint8 cmdid, smuint8 addr, smuint8 datalen, smuint8 *cmddata )
+//assemble packet to bus device transmit buffer without sending it. packets are sent with smTransmitBuffer.
+//returns SM_ERR_LENGTH without recording it to cumulative status if packet doesn't fit in transmit buffer
+SM_STATUS smAssembleSMCMD( smbus handle, smuint8 cmdid, smuint8 addr, smuint8 datalen, smuint8 *cmddata )
 {
-    int i;
+    int i, headerlen;
     smuint16 sendcrc;
+    smuint8 *frame;
 
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    sendcrc=SM485_CRCINIT;
-
     smDebug(handle, SMDebugHigh, "> %s (id=%d, addr=%d, payload=%d)\n",cmdidToStr(cmdid),cmdid,
             addr,
             datalen);
+    smTraceEvent(handle,SMTraceFrameOut,addr,cmdid,datalen);
+
+    //assemble whole packet directly into bus device transmit buffer: header, payload and CRC
+    headerlen=(cmdid&SMCMD_MASK_N_PARAMS) ? 3 : 2;
+    frame=smBDReserveTransmitBuffer(smBus[handle].bdHandle,headerlen+datalen+2);
+    if(frame==NULL) return SM_ERR_LENGTH;
+
+    frame[0]=cmdid;
+    if(headerlen==3)
+        frame[1]=datalen;
+    frame[headerlen-1]=addr;
+    if(datalen>0)
+        memcpy(frame+headerlen,cmddata,datalen);
+    sendcrc=calcCRC16BufWithInit(frame,headerlen+datalen,SM485_CRCINIT);
+    frame[headerlen+datalen]=sendcrc>>8;
+    frame[headerlen+datalen+1]=sendcrc&0xff;
+
+    if(smDebugEnabled(SMDebugHigh))
+    {
+        smDebug(handle,SMDebugHigh,"  Outbound packet raw data: CMDID (%d) ",cmdid);
+        if(headerlen==3)
+            smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"SIZE (%d bytes) ", datalen);
+        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"ADDR (%d) ",addr);
+        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"PAYLOAD (");
+        for(i=0;i<datalen;i++)
+            smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"%02x ",cmddata[i]);
+        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,") ");
+        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"CRC (%02x %02x)\n",sendcrc>>8, sendcrc&0xff);
+    }
 
+    return recordStatus(handle,SM_OK);
+}
 
-    smDebug(handle,SMDebugHigh,"  Outbound packet raw data: CMDID (%d) ",cmdid);
-    if( smWriteByte(handle,cmdid, &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
+SM_STATUS smSendSMCMD( smbus handle, smuint8 cmdid, smuint8 addr, smuint8 datalen, smuint8 *cmddata )
+{
+    SM_STATUS stat;
 
-    if(cmdid&SMCMD_MASK_N_PARAMS)
-    {
-        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"SIZE (%d bytes) ", datalen);
-        if( smWriteByte(handle,datalen, &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
-    }
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"ADDR (%d) ",addr);
-    if( smWriteByte(handle,addr, &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
+    smWaitSubmittedTransaction(handle);
 
-    smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"PAYLOAD (");
-    for(i=0;i<datalen;i++)
-    {
-        smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"%02x ",cmddata[i]);
-        if( smWriteByte(handle,cmddata[i], &sendcrc) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
-    }
-    smDebug(DEBUG_PRINT_RAW,SMDebugHigh,") ");
-    smDebug(DEBUG_PRINT_RAW,SMDebugHigh,"CRC (%02x %02x)\n",sendcrc>>8, sendcrc&0xff);
-    if( smWriteByte(handle,sendcrc>>8, NULL)  != smtrue ) return recordStatus(handle,SM_ERR_BUS);
-    if( smWriteByte(handle,sendcrc&0xff,NULL) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
+    stat=smAssembleSMCMD(handle,cmdid,addr,datalen,cmddata);
+    if(stat!=SM_OK) return recordStatus(handle,stat);
 
-    //transmit bytes to bus that were written in buffer by smWriteByte calls
+    //transmit the packet that was assembled in transmit buffer
     if( smTransmitBuffer(handle) != smtrue ) return recordStatus(handle,SM_ERR_BUS);
 
     return recordStatus(handle,SM_OK);
@@ -445,7 +710,8 @@ LIB SM_STATUS smFastUpdateCycleWithStructs( smbus handle, smuint8 nodeAddress, F
 }
 
 
-SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1, smuint16 write2, smuint16 *read1, smuint16 *read2)
+//caller must hold bus lock
+SM_STATUS smFastUpdateCycleUnlocked( smbus handle, smuint8 nodeAddress, smuint16 write1, smuint16 write2, smuint16 *read1, smuint16 *read2)
 {
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
@@ -455,35 +721,36 @@ SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1,
             write1,write2);
 
 
-    //form the tx packet
+    //form the tx packet directly in transmit buffer
     smuint8 cmd[8];
+    smuint8 *frame;
     int i;
-    cmd[0]=SMCMD_FAST_UPDATE_CYCLE;
-    cmd[1]=nodeAddress;
-    bufput16bit(cmd,2,write1);
-    bufput16bit(cmd,4,write2);
-    cmd[6]=calcCRC8Buf(cmd,6,0x52);
+    smWaitSubmittedTransaction(handle);
+    frame=smBDReserveTransmitBuffer(smBus[handle].bdHandle,7);
+    if(frame==NULL)
+        return recordStatus(handle,SM_ERR_BUS);
+    frame[0]=SMCMD_FAST_UPDATE_CYCLE;
+    frame[1]=nodeAddress;
+    bufput16bit(frame,2,write1);
+    bufput16bit(frame,4,write2);
+    frame[6]=calcCRC8Buf(frame,6,0x52);
+    smTraceEvent(handle,SMTraceFrameOut,nodeAddress,SMCMD_FAST_UPDATE_CYCLE,(smint32)(write1|((smuint32)write2<<16)));
 
     //send
-    for(i=0;i<7;i++)
-    {
-        if( smWriteByte(handle,cmd[i], NULL) != smtrue )
-            return recordStatus(handle,SM_ERR_BUS);
-    }
-    smTransmitBuffer(handle);//this sends the bytes entered with smWriteByte
+    if( smTransmitBuffer(handle) != smtrue )
+        return recordStatus(handle,SM_ERR_BUS);
 
     smDebug(handle, SMDebugHigh, "  Reading reply packet\n");
-    for(i=0;i<6;i++)
+    for(i=0;i<6;)
     {
-        smbool success;
-        smuint8 rx;
-        success=smBDRead(smBus[handle].bdHandle,&rx);
-        cmd[i]=rx;
-        if(success!=smtrue)
+        smint32 n;
+        n=smBDReadBuffer(smBus[handle].bdHandle,cmd+i,6-i);
+        if(n<=0)
         {
             smDebug(handle,SMDebugLow,"Not enough data received on smFastUpdateCycle");
             return recordStatus(handle,SM_ERR_BUS|SM_ERR_LENGTH);//no enough data received
         }
+        i+=n;
     }
 
     //parse
@@ -497,6 +764,14 @@ SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1,
         *read1=bufget16bit(cmd,1);
     if(read2!=NULL)
         *read2=bufget16bit(cmd,3);
+    smRecordLatency(handle,SMLatencyFastUpdateCycle);
+#ifdef ENABLE_EVENT_TRACE
+    {
+        smuint16 r[2];
+        memcpy(r,cmd+1,sizeof(r));//not 16 bit aligned
+        smTraceEvent(handle,SMTraceFrameIn,nodeAddress,SMCMD_FAST_UPDATE_CYCLE_RET,(smint32)(r[0]|((smuint32)r[1]<<16)));
+    }
+#endif
 
     //return data read complete
     smDebug(handle,SMDebugHigh, "< %s (id=%d, r1=%d, r2=%d)\n",
@@ -506,6 +781,99 @@ SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1,
     return recordStatus(handle,SM_OK);
 }
 
+SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1, smuint16 write2, smuint16 *read1, smuint16 *read2)
+{
+    SM_STATUS stat;
+
+    smLockBus(handle);
+    stat=smFastUpdateCycleUnlocked(handle,nodeAddress,write1,write2,read1,read2);
+    smUnlockBus(handle);
+    return stat;
+}
+
+SM_STATUS smFastUpdateCycleMultiple( smbus handle, int numNodes, const smuint8 *nodeAddresses, const FastUpdateCycleWriteData *write, FastUpdateCycleReadData *read, SM_STATUS *nodeStatuses )
+{
+    smuint8 rx[SM_MAX_PIPELINED_NODES*6];
+    smuint8 *frame;
+    smint32 received=0, expected=numNodes*6;
+    SM_STATUS stat=SM_OK;
+    int i;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+    if(numNodes<1 || numNodes>SM_MAX_PIPELINED_NODES) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    smDebug(handle, SMDebugHigh, "> %s to %d nodes\n",cmdidToStr(SMCMD_FAST_UPDATE_CYCLE),numNodes);
+
+    smLockBus(handle);
+    smWaitSubmittedTransaction(handle);
+
+    //form all tx packets directly in transmit buffer so they go out in one write
+    frame=smBDReserveTransmitBuffer(smBus[handle].bdHandle,numNodes*7);
+    if(frame==NULL)
+    {
+        smUnlockBus(handle);
+        return recordStatus(handle,SM_ERR_BUS);
+    }
+    for(i=0;i<numNodes;i++,frame+=7)
+    {
+        frame[0]=SMCMD_FAST_UPDATE_CYCLE;
+        frame[1]=nodeAddresses[i];
+        //packets are not 16 bit aligned
+        memcpy(frame+2,&write[i].U16[0],sizeof(smuint16));
+        memcpy(frame+4,&write[i].U16[1],sizeof(smuint16));
+        frame[6]=calcCRC8Buf(frame,6,0x52);
+        smTraceEvent(handle,SMTraceFrameOut,nodeAddresses[i],SMCMD_FAST_UPDATE_CYCLE,(smint32)(write[i].U16[0]|((smuint32)write[i].U16[1]<<16)));
+    }
+    if( smTransmitBuffer(handle) != smtrue )
+    {
+        smUnlockBus(handle);
+        return recordStatus(handle,SM_ERR_BUS);
+    }
+
+    //replies arrive in same order as packets were sent
+    while(received<expected)
+    {
+        smint32 n=smBDReadBuffer(smBus[handle].bdHandle,rx+received,expected-received);
+        if(n<=0)
+            break;
+        received+=n;
+    }
+    if(received==expected)
+        smRecordLatency(handle,SMLatencyFastUpdateCycle);
+    smUnlockBus(handle);
+
+    //replies don't contain node address, so if one is missing, it's not known which ones belong to which node
+    if(received<expected)
+        smDebug(handle,SMDebugLow,"Not enough data received on smFastUpdateCycleMultiple (%d of %d bytes)\n",(int)received,(int)expected);
+
+    for(i=0;i<numNodes;i++)
+    {
+        smuint8 *cmd=rx+i*6;
+        SM_STATUS nodeStat=SM_OK;
+
+        if(received<expected)
+            nodeStat=SM_ERR_BUS|SM_ERR_LENGTH;
+        else if( cmd[5]!=calcCRC8Buf(cmd,5,0x52) || cmd[0]!=SMCMD_FAST_UPDATE_CYCLE_RET )
+        {
+            smDebug(handle,SMDebugLow,"Corrupt data received on smFastUpdateCycleMultiple from SM address %d\n",(int)nodeAddresses[i]);
+            nodeStat=SM_ERR_COMMUNICATION;
+        }
+        else
+        {
+            memcpy(&read[i].U16[0],cmd+1,sizeof(smuint16));
+            memcpy(&read[i].U16[1],cmd+3,sizeof(smuint16));
+            smTraceEvent(handle,SMTraceFrameIn,nodeAddresses[i],SMCMD_FAST_UPDATE_CYCLE_RET,(smint32)(read[i].U16[0]|((smuint32)read[i].U16[1]<<16)));
+        }
+
+        if(nodeStatuses!=NULL)
+            nodeStatuses[i]=nodeStat;
+        if(nodeStat!=SM_OK)
+            stat|=nodeStat;
+    }
+
+    return recordStatus(handle,stat);
+}
 
 
 SM_STATUS smReceiveErrorHandler( smbus handle, smbool flushrx )
@@ -517,25 +885,25 @@ SM_STATUS smReceiveErrorHandler( smbus handle, smbool flushrx )
     //empty pending rx buffer to avoid further parse errors
     if(flushrx==smtrue)
     {
-        smbool success;
+        smint32 n;
         do{
-            smuint8 rx;
-            success=smBDRead(smBus[handle].bdHandle,&rx);
-        }while(success==smtrue);
+            smuint8 rx[SM485_BUFSIZE];
+            n=smBDReadBuffer(smBus[handle].bdHandle,rx,sizeof(rx));
+        }while(n>0);
     }
     smResetSM485variables(handle);
     smBus[handle].receiveComplete=smtrue;
+    smTraceEvent(handle,SMTraceReceiveError,0,0,0);
     return recordStatus(handle,SM_ERR_COMMUNICATION);
 }
 
 
-SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType,smint32 paramvalue  )
+//encode one SM command to end of buf that already contains *bytes bytes. used for both bus command queue and transactions.
+//returns SM_ERR_LENGTH if it doesn't fit in one packet payload
+SM_STATUS smEncodeSMCommand( smuint8 *buf, smint16 *bytes, int smpCmdType, smint32 paramvalue )
 {
     int cmdlength;
 
-    //check if bus handle is valid & opened
-    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
-
     switch(smpCmdType)
     {
     case SMPCMD_SETPARAMADDR:
@@ -548,47 +916,60 @@ SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType,smint32 paramva
         cmdlength=4;
         break;
     default:
-        return recordStatus(handle,SM_ERR_PARAMETER);
+        return SM_ERR_PARAMETER;
         break;
     }
 
     //check if space if buffer
-    if(smBus[handle].cmd_send_queue_bytes>(SM485_MAX_PAYLOAD_BYTES-cmdlength) )
-    {
-        smBus[handle].transmitBufFull=smtrue; //when set true, smExecute will do nothing but clear transmit buffer. so this prevents any of overflowed commands getting thru
-        return recordStatus(handle,SM_ERR_LENGTH); //overflow, too many commands in buffer
-    }
+    if(*bytes>(SM485_MAX_PAYLOAD_BYTES-cmdlength) )
+        return SM_ERR_LENGTH; //overflow, too many commands in buffer
 
     if(smpCmdType==SMPCMD_SETPARAMADDR)
     {
         SMPayloadCommand16 newcmd;
         newcmd.ID=SMPCMD_SETPARAMADDR;
         newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[1]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[0]);
     }
     if(smpCmdType==SMPCMD_24B)
     {
         SMPayloadCommand24 newcmd;
         newcmd.ID=SMPCMD_24B;
         newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[2]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[2]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[1]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[0]);
     }
     if(smpCmdType==SMPCMD_32B)
     {
         SMPayloadCommand32 newcmd;
         newcmd.ID=SMPCMD_32B;
         newcmd.param=paramvalue;
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[3]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[2]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[1]);
-        bufput8bit( smBus[handle].recv_rsbuf, smBus[handle].cmd_send_queue_bytes++, ((unsigned char*)&newcmd)[0]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[3]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[2]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[1]);
+        bufput8bit( buf, (*bytes)++, ((unsigned char*)&newcmd)[0]);
     }
 
+    return SM_OK;
+}
+
+SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType,smint32 paramvalue  )
+{
+    SM_STATUS stat;
 
-    return recordStatus(handle,SM_OK);
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+    //queue is built in receive buffer, so reply of in flight transaction must be received before
+    smWaitSubmittedTransaction(handle);
+
+    stat=smEncodeSMCommand(smBus[handle].recv_rsbuf,&smBus[handle].cmd_send_queue_bytes,smpCmdType,paramvalue);
+    if(stat==SM_ERR_LENGTH)
+        smBus[handle].transmitBufFull=smtrue; //when set true, smExecute will do nothing but clear transmit buffer. so this prevents any of overflowed commands getting thru
+
+    return recordStatus(handle,stat);
 }
 
 
@@ -639,134 +1020,776 @@ SM_STATUS smExecuteCommandQueue( const smbus bushandle, const smaddr targetaddre
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
 
-    return recordStatus(bushandle,smTransmitReceiveCommandQueue(bushandle,targetaddress,SMCMD_INSTANT_CMD));
-}
+    SM_STATUS stat;
 
-SM_STATUS smUploadCommandQueueToDeviceBuffer( const smbus bushandle, const smaddr targetaddress )
-{
-    return recordStatus(bushandle,smTransmitReceiveCommandQueue(bushandle,targetaddress,SMCMD_BUFFERED_CMD));
+    smLockBus(bushandle);
+    stat=recordStatus(bushandle,smTransmitReceiveCommandQueue(bushandle,targetaddress,SMCMD_INSTANT_CMD));
+    smUnlockBus(bushandle);
+    return stat;
 }
 
-//return number of how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
-SM_STATUS smBytesReceived( const smbus bushandle, smint32 *bytesinbuffer )
+SM_STATUS smUploadCommandQueueToDeviceBuffer( const smbus bushandle, const smaddr targetaddress )
 {
-    if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
-
-    smint32 bytes=smBus[bushandle].recv_payloadsize - smBus[bushandle].cmd_recv_queue_bytes;//how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
-    *bytesinbuffer=bytes;
+    SM_STATUS stat;
 
-    return recordStatus(bushandle,SM_OK);
+    smLockBus(bushandle);
+    stat=recordStatus(bushandle,smTransmitReceiveCommandQueue(bushandle,targetaddress,SMCMD_BUFFERED_CMD));
+    smUnlockBus(bushandle);
+    return stat;
 }
 
-SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retValue )
+static SM_STATUS smAppendQueueToPipeline( const smbus bushandle, const smaddr targetaddress, const smuint8 cmdid )
 {
-    smuint8 rxbyte, rettype;
+    SM_PIPELINE_SLOT *slot;
+    int i;
 
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
 
-
-    //if get called so many times that receive queue buffer is already empty, return error
-    if(smBus[bushandle].cmd_recv_queue_bytes>=smBus[bushandle].recv_payloadsize)
+    //first append after execution starts a new pipeline
+    if(smBus[bushandle].pipelineExecuted==smtrue)
     {
-
-        smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
-
-        //return 0
-        if(retValue!=NULL) *retValue=0;//check every time if retValue is set NULL by caller -> don't store anything to it if its NULL
-
-        return recordStatus(bushandle,SM_ERR_LENGTH);//not a single byte left
+        smBus[bushandle].pipelineNodes=0;
+        smBus[bushandle].pipelineExecuted=smfalse;
     }
 
-    //get first byte to deterime packet length
-    rxbyte=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-    rettype=rxbyte>>6; //extract ret packet header 2 bits
-
-    //read rest of data based on packet header:
-
-    if(rettype == SMPRET_16B)
+    //queue overflowed by user error, discard it like smExecuteCommandQueue does
+    if(smBus[bushandle].transmitBufFull==smtrue)
     {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet16 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[1]=rxbyte;
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET16B: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
+        smBus[bushandle].cmd_send_queue_bytes=0;
+        smBus[bushandle].transmitBufFull=smfalse;
+        return recordStatus(bushandle,SM_ERR_LENGTH);
     }
-    if(rettype == SMPRET_24B)
-    {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet24 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[2]=rxbyte;
-        readBuf[1]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET24B: %d\n",read.retData);
 
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
-    }
-    if(rettype == SMPRET_32B)
+    //replies are identified by node address so each node may appear only once
+    for(i=0;i<smBus[bushandle].pipelineNodes;i++)
     {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet32 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[3]=rxbyte;
-        readBuf[2]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[1]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        readBuf[0]=bufget8bit(smBus[bushandle].recv_rsbuf, smBus[bushandle].cmd_recv_queue_bytes++);
-        smDebug(bushandle,SMDebugTrace,"  RET32B: %d\n",read.retData);
-
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
+        if(smBus[bushandle].pipeline[i].address==targetaddress)
+            return recordStatus(bushandle,SM_ERR_PARAMETER);
     }
-    if(rettype == SMPRET_OTHER) //8bit
-    {
-        //extract return packet and convert to 32 bit and return
-        SMPayloadCommandRet8 read;
-        smuint8 *readBuf=(smuint8*)&read;
-        readBuf[0]=rxbyte;
-        smDebug(bushandle,SMDebugTrace,"  RET_OTHER: %d\n",read.retData);
+    if(smBus[bushandle].pipelineNodes>=SM_MAX_PIPELINED_NODES)
+        return recordStatus(bushandle,SM_ERR_LENGTH);
 
-        if(retValue!=NULL) *retValue=read.retData;
-        return recordStatus(bushandle,SM_OK);
-    }
+    slot=&smBus[bushandle].pipeline[smBus[bushandle].pipelineNodes++];
+    slot->address=targetaddress;
+    slot->cmdid=cmdid;
+    slot->replyReceived=smfalse;
+    slot->payloadsize=smBus[bushandle].cmd_send_queue_bytes;
+    memcpy(slot->payload,smBus[bushandle].recv_rsbuf,slot->payloadsize);
+
+    smBus[bushandle].cmd_send_queue_bytes=0;
+    return recordStatus(bushandle,SM_OK);
+}
 
-    return recordStatus(bushandle,SM_ERR_PARAMETER); //something went wrong, rettype not known
+SM_STATUS smAppendCommandQueueToPipeline( const smbus bushandle, const smaddr targetaddress )
+{
+    return smAppendQueueToPipeline(bushandle,targetaddress,SMCMD_INSTANT_CMD);
 }
 
+SM_STATUS smAppendBufferedCommandQueueToPipeline( const smbus bushandle, const smaddr targetaddress )
+{
+    return smAppendQueueToPipeline(bushandle,targetaddress,SMCMD_BUFFERED_CMD);
+}
 
-SM_STATUS smReceiveReturnPacket( smbus bushandle )
+//caller must hold bus lock
+SM_STATUS smExecutePipelineUnlocked( const smbus bushandle )
 {
+    SM_STATUS stat;
+    int i, repliesPending=0;
+
     //check if bus handle is valid & opened
     if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
 
-    smDebug(bushandle, SMDebugHigh, "  Reading reply packet\n");
-    do
-    {
-        smuint8 ret;
-        SM_STATUS stat;
+    if(smBus[bushandle].pipelineExecuted==smtrue || smBus[bushandle].pipelineNodes==0)
+        return recordStatus(bushandle,SM_ERR_PARAMETER);//nothing appended
+    smBus[bushandle].pipelineExecuted=smtrue;
 
-        smbool succ=smBDRead(smBus[bushandle].bdHandle,&ret);
+    smDebug(bushandle,SMDebugMid,"smExecutePipeline: sending to %d nodes\n",(int)smBus[bushandle].pipelineNodes);
+    smWaitSubmittedTransaction(bushandle);
 
-        if(succ==smfalse)
+    //assemble all packets back-to-back in transmit buffer. if they don't fit, send buffer and continue
+    for(i=0;i<smBus[bushandle].pipelineNodes;i++)
+    {
+        SM_PIPELINE_SLOT *slot=&smBus[bushandle].pipeline[i];
+
+        stat=smAssembleSMCMD(bushandle,slot->cmdid,slot->address,slot->payloadsize,slot->payload);
+        if(stat==SM_ERR_LENGTH)
         {
-            smReceiveErrorHandler(bushandle,smfalse);
-            return recordStatus(bushandle,SM_ERR_COMMUNICATION);
+            if( smTransmitBuffer(bushandle) != smtrue ) return recordStatus(bushandle,SM_ERR_BUS);
+            stat=smAssembleSMCMD(bushandle,slot->cmdid,slot->address,slot->payloadsize,slot->payload);
         }
-
-        stat=smParseReturnData( bushandle, ret );
         if(stat!=SM_OK) return recordStatus(bushandle,stat);
-    } while(smBus[bushandle].receiveComplete==smfalse); //loop until complete packaget has been read
+        if(slot->address!=0)
+            repliesPending++;
+    }
+    if( smTransmitBuffer(bushandle) != smtrue ) return recordStatus(bushandle,SM_ERR_BUS);
 
-    //return data read complete
-    smDebug(bushandle,SMDebugHigh, "< %s (id=%d, addr=%d, payload=%d)\n",
-            cmdidToStr( smBus[bushandle].recv_cmdid ),
-            smBus[bushandle].recv_cmdid,
-            smBus[bushandle].recv_addr,
+    if(repliesPending==0)
+    {
+        //only broadcast, see smTransmitReceiveCommandQueue
+        smFlushTX(bushandle);
+        return recordStatus(bushandle,SM_OK);
+    }
+
+    //collect replies in whatever order they arrive and store them to slot of sender
+    stat=SM_OK;
+    while(repliesPending>0)
+    {
+        SM_PIPELINE_SLOT *slot=NULL;
+
+        if(smReceiveReturnPacket(bushandle)!=SM_OK)
+            return recordStatus(bushandle,SM_ERR_COMMUNICATION);//timeout, nodes without reply remain unreceived
+        repliesPending--;
+
+        for(i=0;i<smBus[bushandle].pipelineNodes;i++)
+        {
+            if(smBus[bushandle].pipeline[i].address==smBus[bushandle].recv_addr && smBus[bushandle].pipeline[i].replyReceived==smfalse)
+                slot=&smBus[bushandle].pipeline[i];
+        }
+        if(slot==NULL || smBus[bushandle].recv_cmdid!=(slot->cmdid==SMCMD_BUFFERED_CMD ? SMCMD_BUFFERED_CMD_RET : SMCMD_INSTANT_CMD_RET))
+        {
+            smDebug(bushandle,SMDebugLow,"smExecutePipeline: unexpected reply (id=%d, addr=%d)\n",smBus[bushandle].recv_cmdid,smBus[bushandle].recv_addr);
+            stat=SM_ERR_COMMUNICATION;
+            continue;
+        }
+
+        slot->payloadsize=smBus[bushandle].recv_payloadsize;
+        memcpy(slot->payload,smBus[bushandle].recv_rsbuf,slot->payloadsize);
+        slot->replyReceived=smtrue;
+    }
+
+    smBus[bushandle].recv_payloadsize=0;
+    smBus[bushandle].cmd_recv_queue_bytes=0;
+    return recordStatus(bushandle,stat);
+}
+
+SM_STATUS smExecutePipeline( const smbus bushandle )
+{
+    SM_STATUS stat;
+
+    smLockBus(bushandle);
+    stat=smExecutePipelineUnlocked(bushandle);
+    smUnlockBus(bushandle);
+    return stat;
+}
+
+SM_STATUS smSelectPipelinedReturnValues( const smbus bushandle, const smaddr targetaddress )
+{
+    int i;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    if(smBus[bushandle].pipelineExecuted==smfalse)
+        return recordStatus(bushandle,SM_ERR_PARAMETER);
+
+    for(i=0;i<smBus[bushandle].pipelineNodes;i++)
+    {
+        SM_PIPELINE_SLOT *slot=&smBus[bushandle].pipeline[i];
+        if(slot->address!=targetaddress) continue;
+
+        if(slot->replyReceived==smfalse)
+        {
+            smBus[bushandle].recv_payloadsize=0;
+            smBus[bushandle].cmd_recv_queue_bytes=0;
+            return recordStatus(bushandle,SM_ERR_COMMUNICATION);
+        }
+
+        //make reply readable with smGetQueued* functions
+        memcpy(smBus[bushandle].recv_rsbuf,slot->payload,slot->payloadsize);
+        smBus[bushandle].recv_payloadsize=slot->payloadsize;
+        smBus[bushandle].cmd_recv_queue_bytes=0;
+        return recordStatus(bushandle,SM_OK);
+    }
+
+    return recordStatus(bushandle,SM_ERR_PARAMETER);//not in pipeline
+}
+
+//return transaction struct of handle or NULL if handle is not allocated transaction of open bus
+SM_TRANSACTION *smGetTransaction( const smtransaction transaction, smbus *bushandle )
+{
+    smbus handle;
+    SM_TRANSACTION *t;
+
+    if(transaction<0) return NULL;
+    handle=transaction/SM_MAX_TRANSACTIONS;
+    if(smIsHandleOpen(handle)==smfalse) return NULL;
+
+    t=&smBus[handle].transactions[transaction%SM_MAX_TRANSACTIONS];
+    if(t->allocated==smfalse) return NULL;
+    *bushandle=handle;
+    return t;
+}
+
+smtransaction smAllocateTransaction( const smbus bushandle )
+{
+    int i;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return -1;
+
+    smLockBus(bushandle);
+    for(i=0;i<SM_MAX_TRANSACTIONS;i++)
+    {
+        SM_TRANSACTION *t=&smBus[bushandle].transactions[i];
+        if(t->allocated==smfalse)
+        {
+            t->allocated=smtrue;
+            t->executed=smfalse;
+            t->txBufFull=smfalse;
+            t->txBytes=0;
+            t->rxBytes=0;
+            t->rxReadPos=0;
+            smUnlockBus(bushandle);
+            return bushandle*SM_MAX_TRANSACTIONS+i;
+        }
+    }
+    smUnlockBus(bushandle);
+
+    smDebug(bushandle,SMDebugLow,"smAllocateTransaction: all %d transactions in use\n",SM_MAX_TRANSACTIONS);
+    recordStatus(bushandle,SM_ERR_LENGTH);
+    return -1;
+}
+
+SM_STATUS smFreeTransaction( const smtransaction transaction )
+{
+    smbus bushandle;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL) return SM_ERR_PARAMETER;
+
+    //checked under lock so that transaction can't be freed while another thread submits it
+    smLockBus(bushandle);
+    if(t->submitted==smtrue)
+    {
+        smUnlockBus(bushandle);
+        return SM_ERR_PARAMETER;
+    }
+    t->allocated=smfalse;
+    smUnlockBus(bushandle);
+    return SM_OK;
+}
+
+SM_STATUS smAppendSMCommandToTransaction( const smtransaction transaction, int smpCmdType, smint32 paramvalue )
+{
+    smbus bushandle;
+    SM_STATUS stat;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL || t->submitted==smtrue) return SM_ERR_PARAMETER;
+
+    //first append after execution starts a new command queue
+    if(t->executed==smtrue)
+    {
+        t->executed=smfalse;
+        t->txBufFull=smfalse;
+        t->txBytes=0;
+        t->rxBytes=0;
+        t->rxReadPos=0;
+    }
+
+    stat=smEncodeSMCommand(t->txBuf,&t->txBytes,smpCmdType,paramvalue);
+    if(stat==SM_ERR_LENGTH)
+        t->txBufFull=smtrue;//partially appended command groups would shift return values, so nothing is sent
+    return recordStatus(bushandle,stat);
+}
+
+SM_STATUS smAppendGetParamCommandToTransaction( const smtransaction transaction, smint16 paramAddress )
+{
+    SM_STATUS stat=SM_NONE;
+
+    //see smAppendGetParamCommandToQueue
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_SETPARAMADDR, SMP_RETURN_PARAM_LEN );
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_24B, SMPRET_32B );
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_SETPARAMADDR, SMP_RETURN_PARAM_ADDR );
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_24B, paramAddress );
+    return stat;
+}
+
+SM_STATUS smAppendSetParamCommandToTransaction( const smtransaction transaction, smint16 paramAddress, smint32 paramValue )
+{
+    SM_STATUS stat=SM_NONE;
+    smbus bushandle;
+
+    if(smGetTransaction(transaction,&bushandle)!=NULL)
+        smNoteParameterWrite(bushandle,paramAddress,paramValue);
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_SETPARAMADDR, paramAddress );
+    stat|=smAppendSMCommandToTransaction( transaction, SMPCMD_32B, paramValue );
+    return stat;
+}
+
+//bus receive buffer holds also the bus command queue. save it before transaction reply is received there, so that
+//transactions don't disturb commands appended to queue or return values not read yet. caller must hold bus lock
+static void smSaveCommandQueue( const smbus bushandle, SM_QUEUE_STATE *state )
+{
+    state->bytes=smBus[bushandle].cmd_send_queue_bytes;
+    if(smBus[bushandle].recv_payloadsize>state->bytes)
+        state->bytes=smBus[bushandle].recv_payloadsize;
+    if(state->bytes>SM485_RSBUFSIZE)
+        state->bytes=SM485_RSBUFSIZE;
+    state->payloadsize=smBus[bushandle].recv_payloadsize;
+    state->readpos=smBus[bushandle].cmd_recv_queue_bytes;
+    memcpy(state->buf,smBus[bushandle].recv_rsbuf,state->bytes);
+}
+
+static void smRestoreCommandQueue( const smbus bushandle, const SM_QUEUE_STATE *state )
+{
+    memcpy(smBus[bushandle].recv_rsbuf,state->buf,state->bytes);
+    smBus[bushandle].recv_payloadsize=state->payloadsize;
+    smBus[bushandle].cmd_recv_queue_bytes=state->readpos;
+}
+
+//caller must hold bus lock
+SM_STATUS smExecuteTransactionUnlocked( const smtransaction transaction, const smaddr targetaddress )
+{
+    SM_STATUS stat;
+    smbus bushandle;
+    SM_QUEUE_STATE queue;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL || t->submitted==smtrue) return SM_ERR_PARAMETER;
+
+    t->executed=smtrue;
+    t->rxBytes=0;
+    t->rxReadPos=0;
+
+    //dont send commands if transaction was overflowed by user error, see smTransmitReceiveCommandQueue
+    if(t->txBufFull==smtrue)
+        return recordStatus(bushandle,SM_ERR_LENGTH);
+
+    //commands are sent straight from transaction buffer, bus receive buffer is used only while reply is being received
+    stat=smSendSMCMD(bushandle,SMCMD_INSTANT_CMD,targetaddress,t->txBytes,t->txBuf);
+    if(stat!=SM_OK) return recordStatus(bushandle,stat);
+
+    if(targetaddress==0)
+    {
+        //broadcast, no reply. see smTransmitReceiveCommandQueue
+        smFlushTX(bushandle);
+        return recordStatus(bushandle,SM_OK);
+    }
+
+    smSaveCommandQueue(bushandle,&queue);
+    stat=smReceiveReturnPacket(bushandle);
+    if(stat==SM_OK)
+    {
+        t->rxBytes=smBus[bushandle].recv_payloadsize;
+        memcpy(t->rxBuf,smBus[bushandle].recv_rsbuf,t->rxBytes);
+    }
+    smRestoreCommandQueue(bushandle,&queue);
+    return recordStatus(bushandle,stat);
+}
+
+SM_STATUS smExecuteTransaction( const smtransaction transaction, const smaddr targetaddress )
+{
+    SM_STATUS stat;
+    smbus bushandle;
+
+    if(smGetTransaction(transaction,&bushandle)==NULL) return SM_ERR_PARAMETER;
+
+    smLockBus(bushandle);
+    stat=smExecuteTransactionUnlocked(transaction,targetaddress);
+    smUnlockBus(bushandle);
+    return stat;
+}
+
+SM_STATUS smGetTransactionSMCommandReturnValue( const smtransaction transaction, smint32 *retValue )
+{
+    smbus bushandle;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL || t->submitted==smtrue) return SM_ERR_PARAMETER;
+
+    return recordStatus(bushandle,smDecodeSMCommandReturnValue(bushandle,t->rxBuf,&t->rxReadPos,t->rxBytes,retValue));
+}
+
+SM_STATUS smGetTransactionGetParamReturnValue( const smtransaction transaction, smint32 *retValue )
+{
+    smint32 retVal=0;
+    SM_STATUS stat=SM_NONE;
+
+    //must get all inserted commands from buffer, see smGetQueuedGetParamReturnValue
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );  //the real return value is here
+    if(retValue!=NULL) *retValue=retVal;
+    return stat;
+}
+
+SM_STATUS smGetTransactionSetParamReturnValue( const smtransaction transaction, smint32 *retValue )
+{
+    smint32 retVal=0;
+    SM_STATUS stat=SM_NONE;
+
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );
+    stat|=smGetTransactionSMCommandReturnValue( transaction, &retVal );  //the real return value is here
+    if(retValue!=NULL) *retValue=retVal;
+    return stat;
+}
+
+SM_STATUS smSubmitTransaction( const smtransaction transaction, const smaddr targetaddress, smTransactionCallback callback, void *userdata )
+{
+    smbus bushandle;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL) return SM_ERR_PARAMETER;
+
+    //checked under lock so that concurrent submits of the same handle can't queue it twice and overflow asyncQueue
+    smLockBus(bushandle);
+    if(t->submitted==smtrue)
+    {
+        smUnlockBus(bushandle);
+        return SM_ERR_PARAMETER;
+    }
+    t->submitted=smtrue;
+    t->executed=smtrue;
+    t->status=SM_NONE;
+    t->target=targetaddress;
+    t->callback=callback;
+    t->userdata=userdata;
+    t->rxBytes=0;
+    t->rxReadPos=0;
+    //queue has room for every transaction of the pool
+    smBus[bushandle].asyncQueue[smBus[bushandle].asyncQueueLen++]=(smint16)(transaction%SM_MAX_TRANSACTIONS);
+    smUnlockBus(bushandle);
+
+    smDebug(bushandle,SMDebugHigh,"smSubmitTransaction: transaction %d to SM address %d\n",(int)transaction,(int)targetaddress);
+    return SM_OK;
+}
+
+SM_STATUS smGetTransactionStatus( const smtransaction transaction )
+{
+    smbus bushandle;
+    SM_TRANSACTION *t=smGetTransaction(transaction,&bushandle);
+    if(t==NULL) return SM_ERR_PARAMETER;
+
+    return t->submitted==smtrue ? SM_NONE : t->status;
+}
+
+//finish first transaction of async queue and notify user. caller must hold bus lock
+void smCompleteSubmittedTransaction( const smbus bushandle, SM_STATUS status )
+{
+    SM_TRANSACTION *t=&smBus[bushandle].transactions[smBus[bushandle].asyncQueue[0]];
+    smtransaction transaction=bushandle*SM_MAX_TRANSACTIONS+smBus[bushandle].asyncQueue[0];
+
+    if(status==SM_OK && t->target!=0)
+    {
+        smRecordLatency(bushandle,SMLatencyInstantCmd);
+        t->rxBytes=smBus[bushandle].recv_payloadsize;
+        memcpy(t->rxBuf,smBus[bushandle].recv_rsbuf,t->rxBytes);
+    }
+    smRestoreCommandQueue(bushandle,&smBus[bushandle].asyncSavedQueue);
+
+    smBus[bushandle].asyncQueueLen--;
+    memmove(smBus[bushandle].asyncQueue,smBus[bushandle].asyncQueue+1,smBus[bushandle].asyncQueueLen*sizeof(smBus[bushandle].asyncQueue[0]));
+    smBus[bushandle].asyncInFlight=smfalse;
+
+    t->status=recordStatus(bushandle,status);
+    t->submitted=smfalse;
+    if(t->callback!=NULL)
+        t->callback(transaction,status,t->userdata);
+}
+
+SM_STATUS smPoll( const smbus bushandle )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    smLockBus(bushandle);
+    for(;;)
+    {
+        smuint8 rx[SM485_BUFSIZE];
+        smint32 n,i;
+        SM_STATUS stat=SM_OK;
+
+        //start next transaction
+        if(smBus[bushandle].asyncInFlight==smfalse)
+        {
+            SM_TRANSACTION *t;
+
+            if(smBus[bushandle].asyncQueueLen==0) break;
+            t=&smBus[bushandle].transactions[smBus[bushandle].asyncQueue[0]];
+            smSaveCommandQueue(bushandle,&smBus[bushandle].asyncSavedQueue);
+
+            if(t->txBufFull==smtrue)
+                stat=SM_ERR_LENGTH;
+            else
+                stat=smAssembleSMCMD(bushandle,SMCMD_INSTANT_CMD,t->target,t->txBytes,t->txBuf);
+            if(stat==SM_OK && smTransmitBuffer(bushandle)!=smtrue)
+                stat=SM_ERR_BUS;
+            if(stat!=SM_OK || t->target==0)//no reply from broadcast
+            {
+                smCompleteSubmittedTransaction(bushandle,stat);
+                continue;
+            }
+            smBus[bushandle].asyncInFlight=smtrue;
+            smBus[bushandle].asyncDeadline=smGetMonotonicMs()+readTimeoutMs;
+            smBus[bushandle].receiveComplete=smfalse;//may be left true by previous reply
+        }
+
+        //receive what has arrived so far
+        if(smBDReadReady(smBus[bushandle].bdHandle)==smtrue)
+        {
+            n=smReceiveBytesPending(bushandle);
+            if(n>(smint32)sizeof(rx)) n=sizeof(rx);
+            n=smBDReadBuffer(smBus[bushandle].bdHandle,rx,n);
+            for(i=0;i<n && stat==SM_OK;i++)
+                stat=smParseReturnData(bushandle,rx[i]);
+
+            if(stat!=SM_OK || (n>0 && smBus[bushandle].receiveComplete==smtrue))
+            {
+                smCompleteSubmittedTransaction(bushandle,stat==SM_OK ? SM_OK : SM_ERR_COMMUNICATION);
+                continue;
+            }
+            if(n>0)
+                continue;//maybe more is available already
+        }
+
+        if((smint32)(smGetMonotonicMs()-smBus[bushandle].asyncDeadline)>=0)
+        {
+            smDebug(bushandle,SMDebugLow,"smPoll: reply timeout\n");
+            smReceiveErrorHandler(bushandle,smfalse);
+            smCompleteSubmittedTransaction(bushandle,SM_ERR_COMMUNICATION);
+            continue;
+        }
+        break;//nothing to do until more data arrives
+    }
+    smUnlockBus(bushandle);
+
+    return SM_OK;
+}
+
+//complete in flight submitted transaction before bus is used for blocking communication. caller must hold bus lock
+void smWaitSubmittedTransaction( const smbus bushandle )
+{
+    while(smBus[bushandle].asyncInFlight==smtrue)
+    {
+        smint32 fd;
+        smPoll(bushandle);
+        //avoid busy loop when waiting reply from device that has file descriptor
+        if(smBus[bushandle].asyncInFlight==smtrue && smBDGetFileDescriptor(smBus[bushandle].bdHandle,&fd)==smtrue)
+            smSleepMs(1);
+    }
+}
+
+SM_STATUS smGetBusFileDescriptor( const smbus bushandle, smint32 *fd )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    if(smBDGetFileDescriptor(smBus[bushandle].bdHandle,fd)==smtrue)
+        return SM_OK;
+    return SM_ERR_PARAMETER;
+}
+
+//return number of how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
+SM_STATUS smBytesReceived( const smbus bushandle, smint32 *bytesinbuffer )
+{
+    if(smIsHandleOpen(bushandle)==smfalse) return recordStatus(bushandle,SM_ERR_NODEVICE);
+
+    smint32 bytes=smBus[bushandle].recv_payloadsize - smBus[bushandle].cmd_recv_queue_bytes;//how many bytes waiting to be read with smGetQueuedSMCommandReturnValue
+    *bytesinbuffer=bytes;
+
+    return recordStatus(bushandle,SM_OK);
+}
+
+//decode one return value from buf of size bytes starting at *readpos, and advance *readpos past it.
+//returns SM_ERR_LENGTH if there is no return value left
+SM_STATUS smDecodeSMCommandReturnValue( smbus bushandle, const smuint8 *buf, smint16 *readpos, smint16 size, smint32 *retValue )
+{
+    smuint8 rxbyte, rettype;
+
+    //if get called so many times that receive queue buffer is already empty, return error
+    if(*readpos>=size)
+    {
+
+        smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
+
+        //return 0
+        if(retValue!=NULL) *retValue=0;//check every time if retValue is set NULL by caller -> don't store anything to it if its NULL
+
+        return SM_ERR_LENGTH;//not a single byte left
+    }
+
+    //get first byte to deterime packet length
+    rxbyte=bufget8bit(buf, (*readpos)++);
+    rettype=rxbyte>>6; //extract ret packet header 2 bits
+
+    //read rest of data based on packet header:
+
+    if(rettype == SMPRET_16B)
+    {
+        //extract return packet and convert to 32 bit and return
+        SMPayloadCommandRet16 read;
+        smuint8 *readBuf=(smuint8*)&read;
+        readBuf[1]=rxbyte;
+        readBuf[0]=bufget8bit(buf, (*readpos)++);
+        smTraceEvent(bushandle,SMTraceReturnValue,0,SM_RETURN_VALUE_16B,read.retData);
+
+        if(retValue!=NULL) *retValue=read.retData;
+        return SM_OK;
+    }
+    if(rettype == SMPRET_24B)
+    {
+        //extract return packet and convert to 32 bit and return
+        SMPayloadCommandRet24 read;
+        smuint8 *readBuf=(smuint8*)&read;
+        readBuf[2]=rxbyte;
+        readBuf[1]=bufget8bit(buf, (*readpos)++);
+        readBuf[0]=bufget8bit(buf, (*readpos)++);
+        smTraceEvent(bushandle,SMTraceReturnValue,0,SM_RETURN_VALUE_24B,read.retData);
+
+        if(retValue!=NULL) *retValue=read.retData;
+        return SM_OK;
+    }
+    if(rettype == SMPRET_32B)
+    {
+        //extract return packet and convert to 32 bit and return
+        SMPayloadCommandRet32 read;
+        smuint8 *readBuf=(smuint8*)&read;
+        readBuf[3]=rxbyte;
+        readBuf[2]=bufget8bit(buf, (*readpos)++);
+        readBuf[1]=bufget8bit(buf, (*readpos)++);
+        readBuf[0]=bufget8bit(buf, (*readpos)++);
+        smTraceEvent(bushandle,SMTraceReturnValue,0,SM_RETURN_VALUE_32B,read.retData);
+
+        if(retValue!=NULL) *retValue=read.retData;
+        return SM_OK;
+    }
+    if(rettype == SMPRET_OTHER) //8bit
+    {
+        //extract return packet and convert to 32 bit and return
+        SMPayloadCommandRet8 read;
+        smuint8 *readBuf=(smuint8*)&read;
+        readBuf[0]=rxbyte;
+        smTraceEvent(bushandle,SMTraceReturnValue,0,SM_RETURN_STATUS,read.retData);
+
+        if(retValue!=NULL) *retValue=read.retData;
+        return SM_OK;
+    }
+
+    return SM_ERR_PARAMETER; //something went wrong, rettype not known
+}
+
+SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retValue )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    return recordStatus(bushandle,smDecodeSMCommandReturnValue(bushandle,smBus[bushandle].recv_rsbuf,&smBus[bushandle].cmd_recv_queue_bytes,
+                                                                smBus[bushandle].recv_payloadsize,retValue));
+}
+
+smint32 smGetQueuedSMCommandReturnValues( const smbus bushandle, smint32 *retValues )
+{
+    //packet length and number of value bits by 2 bit header: SMPRET_32B, SMPRET_24B, SMPRET_16B, SMPRET_OTHER
+    static const smuint8 retLength[4]={4,3,2,1};
+    static const smuint8 retShift[4]={32-30,32-22,32-14,32-6};
+    const smuint8 *buf;
+    smint16 pos, size;
+    smint32 n=0;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return 0;
+
+    buf=smBus[bushandle].recv_rsbuf;
+    pos=smBus[bushandle].cmd_recv_queue_bytes;
+    size=smBus[bushandle].recv_payloadsize;
+
+    //take 4 bytes big endian, shift header bits out to the left and the bytes of next packets out to the right. right
+    //shift of signed value extends the sign of value bits
+    while(pos+4<=size)
+    {
+        smuint32 raw=((smuint32)buf[pos]<<24)|((smuint32)buf[pos+1]<<16)|((smuint32)buf[pos+2]<<8)|buf[pos+3];
+        smuint8 rettype=buf[pos]>>6;
+        retValues[n]=((smint32)(raw<<2))>>retShift[rettype];
+        smTraceEvent(bushandle,SMTraceReturnValue,0,rettype,retValues[n]);
+        pos+=retLength[rettype];
+        n++;
+    }
+
+    //last packets byte by byte so that nothing is read past the payload
+    while(pos<size)
+    {
+        smuint8 rettype=buf[pos]>>6;
+        smuint32 raw=0;
+        int i;
+        if(pos+retLength[rettype]>size)
+        {
+            smDebug(bushandle,SMDebugTrace, "Packet receive error, return data coudn't be parsed\n");
+            recordStatus(bushandle,SM_ERR_LENGTH);
+            break;
+        }
+        for(i=0;i<retLength[rettype];i++)
+            raw=(raw<<8)|buf[pos+i];
+        raw<<=8*(4-retLength[rettype]);
+        retValues[n]=((smint32)(raw<<2))>>retShift[rettype];
+        smTraceEvent(bushandle,SMTraceReturnValue,0,rettype,retValues[n]);
+        pos+=retLength[rettype];
+        n++;
+    }
+
+    smBus[bushandle].cmd_recv_queue_bytes=size;
+    return n;
+}
+
+
+//return number of bytes that are at least needed to complete the packet that is being received. used to size bus reads
+//so that reading never goes past the end of the packet
+smint32 smReceiveBytesPending( smbus bushandle )
+{
+    smint32 payloadleft=smBus[bushandle].recv_payloadsize-smBus[bushandle].recv_storepos;
+
+    switch(smBus[bushandle].recv_state_next)
+    {
+    case WaitCmdId: return 4; //shortest possible packet: cmdid, addr and 2 bytes crc
+    case WaitPayloadSize: return 1+1+2; //size, addr and crc, payload may be empty
+    case WaitAddr: return 1+payloadleft+2;
+    case WaitPayload: return payloadleft+2;
+    case WaitCrcHi: return 2;
+    case WaitCrcLo: return 1;
+    }
+    return 1;
+}
+
+SM_STATUS smReceiveReturnPacket( smbus bushandle )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(bushandle)==smfalse) return SM_ERR_NODEVICE;
+
+    smDebug(bushandle, SMDebugHigh, "  Reading reply packet\n");
+    do
+    {
+        smuint8 rx[SM485_BUFSIZE];
+        smint32 n,i;
+        SM_STATUS stat;
+
+        //read as much as we know to be coming, so a typical reply takes only 2 reads from bus device
+        n=smReceiveBytesPending(bushandle);
+        if(n>(smint32)sizeof(rx)) n=sizeof(rx);
+        n=smBDReadBuffer(smBus[bushandle].bdHandle,rx,n);
+
+        if(n<=0)
+        {
+            smReceiveErrorHandler(bushandle,smfalse);
+            return recordStatus(bushandle,SM_ERR_COMMUNICATION);
+        }
+
+        for(i=0;i<n;i++)
+        {
+            stat=smParseReturnData( bushandle, rx[i] );
+            if(stat!=SM_OK) return recordStatus(bushandle,stat);
+        }
+    } while(smBus[bushandle].receiveComplete==smfalse); //loop until complete packaget has been read
+
+    switch(smBus[bushandle].recv_cmdid)
+    {
+    case SMCMD_INSTANT_CMD_RET: smRecordLatency(bushandle,SMLatencyInstantCmd); break;
+    case SMCMD_BUFFERED_CMD_RET: smRecordLatency(bushandle,SMLatencyBufferedCmd); break;
+    case SMCMD_GET_CLOCK_RET: smRecordLatency(bushandle,SMLatencyGetClock); break;
+    default: break;
+    }
+
+    //return data read complete
+    smDebug(bushandle,SMDebugHigh, "< %s (id=%d, addr=%d, payload=%d)\n",
+            cmdidToStr( smBus[bushandle].recv_cmdid ),
+            smBus[bushandle].recv_cmdid,
+            smBus[bushandle].recv_addr,
             smBus[bushandle].recv_payloadsize);
 
     return recordStatus(bushandle,SM_OK);
@@ -794,8 +1817,6 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
 
     if(smBus[handle].recv_state==WaitPayload)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
-
         //normal handling for all payload data
         if(smBus[handle].recv_storepos<SM485_MAX_PAYLOAD_BYTES)
             smBus[handle].recv_rsbuf[smBus[handle].recv_storepos++]=data;
@@ -814,7 +1835,8 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
 
     if(smBus[handle].recv_state==WaitCmdId)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
+        smBus[handle].recv_header[0]=data;
+        smBus[handle].recv_headerlen=1;
         smBus[handle].recv_cmdid=data;
         switch(data&SMCMD_MASK_PARAMS_BITS)//commands with fixed payload size
         {
@@ -832,7 +1854,7 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
     //no data payload size known yet
     if(smBus[handle].recv_state==WaitPayloadSize)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
+        smBus[handle].recv_header[smBus[handle].recv_headerlen++]=data;
         smBus[handle].recv_payloadsize=data;
         smBus[handle].recv_state_next=WaitAddr;
         return recordStatus(handle,SM_OK);
@@ -840,7 +1862,7 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
 
     if(smBus[handle].recv_state==WaitAddr)
     {
-        smBus[handle].recv_crc=calcCRC16(data,smBus[handle].recv_crc);
+        smBus[handle].recv_header[smBus[handle].recv_headerlen++]=data;
         smBus[handle].recv_addr=data;//can be receiver or sender addr depending on cmd
         if(smBus[handle].recv_payloadsize>smBus[handle].recv_storepos)
             smBus[handle].recv_state_next=WaitPayload;
@@ -859,7 +1881,10 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
     //get crc_lsb, check crc and execute
     if(smBus[handle].recv_state==WaitCrcLo)
     {
-        if(((smBus[handle].recv_read_crc_hi<<8)|data)!=smBus[handle].recv_crc)
+        smuint16 crc=calcCRC16BufWithInit(smBus[handle].recv_header,smBus[handle].recv_headerlen,SM485_CRCINIT);
+        crc=calcCRC16BufWithInit(smBus[handle].recv_rsbuf,smBus[handle].recv_storepos,crc);
+
+        if(((smBus[handle].recv_read_crc_hi<<8)|data)!=crc)
         {
             //CRC error
             return recordStatus(handle,(smReceiveErrorHandler(handle,smtrue)));
@@ -869,11 +1894,12 @@ SM_STATUS smParseReturnData( smbus handle, smuint8 data )
             //CRC ok
             //if(smBus[handle].recv_addr==config.deviceAddress || smBus[handle].recv_cmdid==SMCMD_GET_CLOCK_RET || smBus[handle].recv_cmdid==SMCMD_PROCESS_IMAGE ) executeSMcmd();
             smBus[handle].receiveComplete=smtrue;
+            smTraceEvent(handle,SMTraceFrameIn,smBus[handle].recv_addr,smBus[handle].recv_cmdid,smBus[handle].recv_payloadsize);
         }
 
         //smResetSM485variables(handle);
         smBus[handle].recv_storepos=0;
-        smBus[handle].recv_crc=SM485_CRCINIT;
+        smBus[handle].recv_headerlen=0;
         smBus[handle].recv_state_next=WaitCmdId;
         return recordStatus(handle,SM_OK);
     }
@@ -925,6 +1951,7 @@ SM_STATUS smAppendSetParamCommandToQueue( smbus handle, smint16 paramAddress, sm
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
+    smNoteParameterWrite(handle,paramAddress,paramValue);
     stat|=smAppendSMCommandToQueue( handle, SMPCMD_SETPARAMADDR, paramAddress );//2b
     stat|=smAppendSMCommandToQueue( handle, SMPCMD_32B, paramValue );//4b
     return recordStatus(handle,stat);
@@ -948,7 +1975,8 @@ SM_STATUS smGetQueuedSetParamReturnValue(  const smbus bushandle, smint32 *retVa
 }
 
 
-SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smuint16 *clock )
+//caller must hold bus lock
+SM_STATUS smGetBufferClockUnlocked( const smbus handle, const smaddr targetaddr, smuint16 *clock )
 {
     SM_STATUS stat;
 
@@ -971,6 +1999,119 @@ SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smuint1
     return recordStatus(handle,SM_OK);
 }
 
+SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smuint16 *clock )
+{
+    SM_STATUS stat;
+
+    smLockBus(handle);
+    stat=smGetBufferClockUnlocked(handle,targetaddr,clock);
+    smUnlockBus(handle);
+    return stat;
+}
+
+//payload bytes of one return value of type SM_RETURN_VALUE_*
+static int smReturnValueBytes( int returnType )
+{
+    switch(returnType)
+    {
+    case SM_RETURN_VALUE_16B: return 2;
+    case SM_RETURN_VALUE_24B: return 3;
+    case SM_RETURN_STATUS: return 1;
+    default: return 4;
+    }
+}
+
+SM_STATUS smReadParametersWithWidths( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, const smuint8 *returnWidths, smint32 *paramVals, const int numParams )
+{
+    static const smuint8 widthOrder[3]={SM_RETURN_VALUE_32B,SM_RETURN_VALUE_24B,SM_RETURN_VALUE_16B};
+    SM_STATUS smStat=SM_NONE;
+    smint16 order[SM485_MAX_PAYLOAD_BYTES];
+    int i, w, n, pos;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return recordStatus(handle,SM_ERR_NODEVICE);
+    if(numParams<0 || paramIds==NULL || paramVals==NULL) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    smDebug(handle,SMDebugMid,"smReadParameters: reading %d parameters from SM address %d.\n",numParams,(int)nodeAddress);
+
+    for(pos=0;pos<numParams;pos+=n)
+    {
+        //group parameters by return width so that width is changed as few times as possible.
+        //process at most sizeof(order) parameters at a time, that's more than fits in one packet anyway
+        n=numParams-pos;
+        if(n>(int)(sizeof(order)/sizeof(order[0]))) n=sizeof(order)/sizeof(order[0]);
+        {
+            int k=0;
+            for(w=0;w<3;w++)
+                for(i=pos;i<pos+n;i++)
+                    if((returnWidths==NULL ? SM_RETURN_VALUE_32B : returnWidths[i])==widthOrder[w])
+                        order[k++]=(smint16)i;
+            if(k!=n) return recordStatus(handle,SM_ERR_PARAMETER);//invalid width given
+        }
+
+        //fill as many packets as needed for this group
+        for(i=0;i<n;)
+        {
+            //destination parameter index of each return value of the packet, -1 if return value is discarded
+            smint16 dest[SM485_MAX_PAYLOAD_BYTES/2];
+            int numReturns=0, txBytes=0, rxBytes=0, curWidth=-1, r;
+
+            smLockBus(handle);
+            while(i<n)
+            {
+                int idx=order[i];
+                int width=(returnWidths==NULL ? SM_RETURN_VALUE_32B : returnWidths[idx]);
+                int needTx=3, needRx=smReturnValueBytes(width);
+
+                if(width!=curWidth)
+                {
+                    //return width is not known before first change, so assume the widest
+                    needTx+=2+3+2;
+                    needRx+=(curWidth<0 ? 4 : smReturnValueBytes(curWidth))+2*smReturnValueBytes(width);
+                }
+                if(txBytes+needTx>SM485_MAX_PAYLOAD_BYTES || rxBytes+needRx>SM485_MAX_PAYLOAD_BYTES)
+                    break;//next packet
+
+                if(width!=curWidth)
+                {
+                    smStat|=smAppendSMCommandToQueue( handle, SM_SET_WRITE_ADDRESS, SMP_RETURN_PARAM_LEN );
+                    smStat|=smAppendSMCommandToQueue( handle, SM_WRITE_VALUE_24B, width );
+                    smStat|=smAppendSMCommandToQueue( handle, SM_SET_WRITE_ADDRESS, SMP_RETURN_PARAM_ADDR );
+                    dest[numReturns++]=-1;
+                    dest[numReturns++]=-1;
+                    dest[numReturns++]=-1;
+                    curWidth=width;
+                }
+                smStat|=smAppendSMCommandToQueue( handle, SM_WRITE_VALUE_24B, paramIds[idx] );
+                dest[numReturns++]=(smint16)idx;
+                txBytes+=needTx;
+                rxBytes+=needRx;
+                i++;
+            }
+
+            smStat|=smExecuteCommandQueue(handle,nodeAddress);
+            for(r=0;r<numReturns;r++)
+            {
+                smint32 val=0;
+                smStat|=smGetQueuedSMCommandReturnValue(handle,&val);
+                if(dest[r]>=0)
+                    paramVals[dest[r]]=val;
+            }
+            smUnlockBus(handle);
+        }
+    }
+
+    if(smStat!=SM_OK && smStat!=SM_NONE)
+        smDebug(handle,SMDebugLow,"smReadParameters failed (SM_STATUS=%d).",(int)smStat);
+
+    return recordStatus(handle,smStat==SM_NONE ? SM_OK : smStat);
+}
+
+SM_STATUS smReadParameters( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, smint32 *paramVals, const int numParams )
+{
+    return smReadParametersWithWidths(handle,nodeAddress,paramIds,NULL,paramVals,numParams);
+}
+
 /** Simple read & write of parameters with internal queueing, so only one call needed.
 Use these for non-time critical operations. */
 SM_STATUS smRead1Parameter( const smbus handle, const smaddr nodeAddress, const smint16 paramId1, smint32 *paramVal1 )
@@ -979,6 +2120,8 @@ SM_STATUS smRead1Parameter( const smbus handle, const smaddr nodeAddress, const
 
     smDebug(handle,SMDebugMid,"smRead1Parameter: reading parameter address %hu from SM address %d.\n",(unsigned short)paramId1,(int)nodeAddress);
 
+    smLockBus(handle);
+
     smStat|=smAppendGetParamCommandToQueue(handle,paramId1);
     smStat|=smExecuteCommandQueue(handle,nodeAddress);
     smStat|=smGetQueuedGetParamReturnValue(handle,paramVal1);
@@ -988,6 +2131,7 @@ SM_STATUS smRead1Parameter( const smbus handle, const smaddr nodeAddress, const
     if(smStat!=SM_OK)
         smDebug(handle,SMDebugLow,"smRead1Parameter failed (SM_STATUS=%d)",(int)smStat);
 
+    smUnlockBus(handle);
     return recordStatus(handle,smStat);
 }
 
@@ -997,17 +2141,18 @@ SM_STATUS smRead2Parameters( const smbus handle, const smaddr nodeAddress, const
 
     smDebug(handle,SMDebugMid,"smRead2Parameters: reading parameter addresses %hu and %hu from SM address %d.\n",(unsigned short)paramId1,(unsigned short)paramId2,(int)nodeAddress);
 
-    smStat|=smAppendGetParamCommandToQueue(handle,paramId1);
-    smStat|=smAppendGetParamCommandToQueue(handle,paramId2);
-    smStat|=smExecuteCommandQueue(handle,nodeAddress);
-    smStat|=smGetQueuedGetParamReturnValue(handle,paramVal1);
-    smStat|=smGetQueuedGetParamReturnValue(handle,paramVal2);
+    {
+        smint16 ids[2]={paramId1,paramId2};
+        smint32 vals[2]={0,0};
+        smStat=smReadParameters(handle,nodeAddress,ids,vals,2);
+        *paramVal1=vals[0];
+        *paramVal2=vals[1];
+    }
 
     smDebug(handle,SMDebugMid,"  ^^ got values %d and %d\n",(int)*paramVal1,(int)*paramVal2);
 
     if(smStat!=SM_OK)
         smDebug(handle,SMDebugLow,"smRead2Parameters failed (SM_STATUS=%d).",(int)smStat);
-
     return recordStatus(handle,smStat);
 }
 
@@ -1017,19 +2162,19 @@ SM_STATUS smRead3Parameters( const smbus handle, const smaddr nodeAddress, const
 
     smDebug(handle,SMDebugMid,"smRead3Parameters: reading parameter addresses %hu, %hu and %hu from SM address %d.\n",(unsigned short)paramId1,(unsigned short)paramId2,(unsigned short)paramId3,(int)nodeAddress);
 
-    smStat|=smAppendGetParamCommandToQueue(handle,paramId1);
-    smStat|=smAppendGetParamCommandToQueue(handle,paramId2);
-    smStat|=smAppendGetParamCommandToQueue(handle,paramId3);
-    smStat|=smExecuteCommandQueue(handle,nodeAddress);
-    smStat|=smGetQueuedGetParamReturnValue(handle,paramVal1);
-    smStat|=smGetQueuedGetParamReturnValue(handle,paramVal2);
-    smStat|=smGetQueuedGetParamReturnValue(handle,paramVal3);
+    {
+        smint16 ids[3]={paramId1,paramId2,paramId3};
+        smint32 vals[3]={0,0,0};
+        smStat=smReadParameters(handle,nodeAddress,ids,vals,3);
+        *paramVal1=vals[0];
+        *paramVal2=vals[1];
+        *paramVal3=vals[2];
+    }
 
     smDebug(handle,SMDebugMid,"  ^^ got values %d, %d and %d\n",(int)*paramVal1,(int)*paramVal2,(int)*paramVal3);
 
     if(smStat!=SM_OK)
         smDebug(handle,SMDebugLow,"smRead3Parameters failed (SM_STATUS=%d). ",(int)smStat);
-
     return recordStatus(handle,smStat);
 }
 
@@ -1040,6 +2185,8 @@ SM_STATUS smSetParameter( const smbus handle, const smaddr nodeAddress, const sm
 
     smDebug(handle,SMDebugMid,"smSetParameter: writing parameter [%hu]=%d into SM address %d.\n",(unsigned short)paramId,(int)paramVal,(int)nodeAddress);
 
+    smLockBus(handle);
+
     smStat|=smAppendSetParamCommandToQueue( handle, paramId, paramVal );
     smStat|=smExecuteCommandQueue(handle,nodeAddress);
     if(nodeAddress!=0)//don't attempt to read if target address was broadcast address where no slave device will respond
@@ -1048,20 +2195,261 @@ SM_STATUS smSetParameter( const smbus handle, const smaddr nodeAddress, const sm
     if(smStat!=SM_OK)
         smDebug(handle,SMDebugLow,"smSetParameter failed (SM_STATUS=%d).",(int)smStat);
 
+    smUnlockBus(handle);
+    return recordStatus(handle,smStat);
+}
+
+
+SM_STATUS smWriteParameters( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, const smint32 *paramVals, smint32 *paramStatuses, const int numParams )
+{
+    SM_STATUS smStat=SM_NONE;
+    smbool rejected=smfalse;
+    //device state known from previous packets of this call. return length and write address persist in device
+    //between packets, so they're sent only when changed. after failed packet nothing is assumed.
+    smbool returnsStatus=smfalse;
+    smint32 writeAddress=-1;
+    int i=0;
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return recordStatus(handle,SM_ERR_NODEVICE);
+    if(numParams<0 || paramIds==NULL || paramVals==NULL) return recordStatus(handle,SM_ERR_PARAMETER);
+
+    smDebug(handle,SMDebugMid,"smWriteParameters: writing %d parameters into SM address %d.\n",numParams,(int)nodeAddress);
+
+    //keep bus locked over all packets so that nobody else changes the device state in between
+    smLockBus(handle);
+    while(i<numParams)
+    {
+        //number of address subpackets sent before each parameter value, 0 or 1
+        smuint8 addressSent[SM485_MAX_PAYLOAD_BYTES/3];
+        int first=i, txBytes=0, r;
+        SM_STATUS frameStat;
+        smbool statusPreamble=returnsStatus==smtrue ? smfalse : smtrue;
+
+        //return execution status of each subpacket instead of parameter values
+        if(statusPreamble==smtrue)
+        {
+            smStat|=smAppendSMCommandToQueue( handle, SM_SET_WRITE_ADDRESS, SMP_RETURN_PARAM_LEN );
+            smStat|=smAppendSMCommandToQueue( handle, SM_WRITE_VALUE_24B, SM_RETURN_STATUS );
+            txBytes=2+3;
+            writeAddress=SMP_RETURN_PARAM_LEN;
+        }
+
+        //add parameters until payload is full. returns are 1 byte each so only the command side limits.
+        //protocol has no address auto increment, so address can be omitted only when it's same as previous
+        while(i<numParams)
+        {
+            smbool fits24b=(paramVals[i]>=-(1L<<21) && paramVals[i]<(1L<<21)) ? smtrue : smfalse;
+            smbool needAddress=(writeAddress==paramIds[i]) ? smfalse : smtrue;
+            int needTx=(needAddress==smtrue ? 2 : 0)+(fits24b==smtrue ? 3 : 4);
+
+            if(txBytes+needTx>SM485_MAX_PAYLOAD_BYTES)
+                break;
+            smNoteParameterWrite(handle,paramIds[i],paramVals[i]);
+            if(needAddress==smtrue)
+                smStat|=smAppendSMCommandToQueue( handle, SM_SET_WRITE_ADDRESS, paramIds[i] );
+            smStat|=smAppendSMCommandToQueue( handle, fits24b==smtrue ? SM_WRITE_VALUE_24B : SM_WRITE_VALUE_32B, paramVals[i] );
+            addressSent[i-first]=needAddress;
+            writeAddress=paramIds[i];
+            txBytes+=needTx;
+            i++;
+        }
+
+        frameStat=smExecuteCommandQueue(handle,nodeAddress);
+        smStat|=frameStat;
+        returnsStatus=frameStat==SM_OK ? smtrue : smfalse;
+        if(frameStat!=SM_OK)
+            writeAddress=-1;
+
+        if(nodeAddress==0)//no returns from broadcast
+        {
+            if(paramStatuses!=NULL)
+                for(r=first;r<i;r++)
+                    paramStatuses[r]=SMP_CMD_STATUS_ACK;
+            continue;
+        }
+
+        if(frameStat==SM_OK && statusPreamble==smtrue)
+        {
+            smint32 dummy;
+            smStat|=smGetQueuedSMCommandReturnValue(handle,&dummy);
+            smStat|=smGetQueuedSMCommandReturnValue(handle,&dummy);
+        }
+        for(r=first;r<i;r++)
+        {
+            smint32 addressStatus=SMP_CMD_STATUS_ACK, valueStatus=SMP_CMD_STATUS_NACK;
+
+            if(frameStat==SM_OK)
+            {
+                if(addressSent[r-first])
+                    smStat|=smGetQueuedSMCommandReturnValue(handle,&addressStatus);
+                smStat|=smGetQueuedSMCommandReturnValue(handle,&valueStatus);
+            }
+            //rejected address is reported over the status of value write
+            if(addressStatus!=SMP_CMD_STATUS_ACK)
+                valueStatus=addressStatus;
+            if(valueStatus!=SMP_CMD_STATUS_ACK)
+            {
+                rejected=smtrue;
+                smDebug(handle,SMDebugLow,"smWriteParameters: writing parameter [%hu]=%d failed with status %d\n",(unsigned short)paramIds[r],(int)paramVals[r],(int)valueStatus);
+            }
+            if(paramStatuses!=NULL)
+                paramStatuses[r]=valueStatus;
+        }
+    }
+    smUnlockBus(handle);
+
+    if(smStat==SM_NONE)
+        smStat=SM_OK;
+    if(smStat!=SM_OK)
+        smDebug(handle,SMDebugLow,"smWriteParameters failed (SM_STATUS=%d).",(int)smStat);
+    else if(rejected==smtrue)
+        smStat=SM_ERR_PARAMETER;
+
     return recordStatus(handle,smStat);
 }
 
 
+//called for every parameter write made with the library functions. advances bus generation when write makes device
+//restart, so that host side copies of device parameters can see that they're no longer valid
+void smNoteParameterWrite( const smbus handle, const smint16 paramAddress, const smint32 paramValue )
+{
+    if(paramAddress==SMP_SYSTEM_CONTROL && (paramValue==SMP_SYSTEM_CONTROL_RESTART || paramValue==SMP_SYSTEM_CONTROL_RESTART_TO_DFU_MODE))
+        smBus[handle].generation++;
+}
+
+smuint32 smGetBusGeneration( const smbus handle )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return 0;
+
+    return smBus[handle].generation;
+}
+
+#ifdef ENABLE_LATENCY_STATISTICS
+//histogram bucket of latency value, see SM_LATENCY_HISTOGRAM_BUCKETS
+static int smLatencyBucket( smuint32 us )
+{
+    int exponent=3;
+
+    if(us<8) return (int)us;
+    while(exponent<21 && (us>>(exponent+1))!=0)
+        exponent++;
+    if((us>>(exponent+1))!=0)
+        return SM_LATENCY_HISTOGRAM_BUCKETS-1;
+    return 8+(exponent-3)*8+(int)((us>>(exponent-3))&7);
+}
+#endif
+
+//largest latency value that falls in histogram bucket
+static smuint32 smLatencyBucketMaxUs( int bucket )
+{
+    int exponent=(bucket-8)/8+3;
+
+    if(bucket<8) return (smuint32)bucket;
+    return ((smuint32)(9+(bucket-8)%8)<<(exponent-3))-1;
+}
+
+//record time since last smTransmitBuffer as round trip latency. caller must hold bus lock. counters are updated with
+//atomic stores so that smGetBusStatistics can read them from other threads without waiting for the bus
+void smRecordLatency( const smbus handle, const smLatencyType type )
+{
+#ifdef ENABLE_LATENCY_STATISTICS
+    SM_LATENCY_HISTOGRAM *histogram=&smBus[handle].statistics.latency[type];
+    smuint32 us=smGetMonotonicUs()-smBus[handle].transmitTimeUs;
+    int bucket=smLatencyBucket(us);
+
+    smAtomicStore(&histogram->buckets[bucket],histogram->buckets[bucket]+1);
+    if(histogram->count==0 || us<histogram->minUs)
+        smAtomicStore(&histogram->minUs,us);
+    if(us>histogram->maxUs)
+        smAtomicStore(&histogram->maxUs,us);
+    smAtomicStore(&histogram->count,histogram->count+1);
+#else
+    (void)handle;
+    (void)type;
+#endif
+}
+
+SM_STATUS smGetBusStatistics( const smbus handle, SM_BUS_STATISTICS *statistics )
+{
+    if(statistics==NULL) return SM_ERR_PARAMETER;
+    memset(statistics,0,sizeof(*statistics));
+
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+#ifdef ENABLE_LATENCY_STATISTICS
+    {
+        int type, bucket;
+        for(type=0;type<SMLatencyNumTypes;type++)
+        {
+            SM_LATENCY_HISTOGRAM *src=&smBus[handle].statistics.latency[type];
+            SM_LATENCY_HISTOGRAM *dst=&statistics->latency[type];
+
+            dst->count=smAtomicLoad(&src->count);
+            dst->minUs=smAtomicLoad(&src->minUs);
+            dst->maxUs=smAtomicLoad(&src->maxUs);
+            for(bucket=0;bucket<SM_LATENCY_HISTOGRAM_BUCKETS;bucket++)
+                dst->buckets[bucket]=smAtomicLoad(&src->buckets[bucket]);
+        }
+    }
+    return SM_OK;
+#else
+    return SM_ERR_PARAMETER;
+#endif
+}
+
+SM_STATUS smResetBusStatistics( const smbus handle )
+{
+    //check if bus handle is valid & opened
+    if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
+
+#ifdef ENABLE_LATENCY_STATISTICS
+    smLockBus(handle);
+    memset(&smBus[handle].statistics,0,sizeof(smBus[handle].statistics));
+    smUnlockBus(handle);
+    return SM_OK;
+#else
+    return SM_ERR_PARAMETER;
+#endif
+}
+
+smuint32 smGetLatencyPercentile( const SM_LATENCY_HISTOGRAM *histogram, double percentile )
+{
+    smuint32 rank, cumulative=0;
+    int bucket;
+
+    if(histogram==NULL || histogram->count==0) return 0;
+    if(percentile<0) percentile=0;
+    if(percentile>100) percentile=100;
+
+    //smallest value that has at least given percentage of samples at or below it
+    rank=(smuint32)(histogram->count*percentile/100.0+0.999999);
+    if(rank==0) rank=1;
+    for(bucket=0;bucket<SM_LATENCY_HISTOGRAM_BUCKETS;bucket++)
+    {
+        cumulative+=histogram->buckets[bucket];
+        if(cumulative>=rank)
+            break;
+    }
+    if(bucket>=SM_LATENCY_HISTOGRAM_BUCKETS || smLatencyBucketMaxUs(bucket)>histogram->maxUs)
+        return histogram->maxUs;
+    return smLatencyBucketMaxUs(bucket);
+}
+
 //accumulates status to internal variable by ORing the bits. returns same value that is fed as paramter
 SM_STATUS recordStatus( const smbus handle, const SM_STATUS stat )
 {
     //check if bus handle is valid & opened
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    if(smBus[handle].cumulativeSmStatus!=stat && stat!=SM_OK)//if status changed and new status is not SM_OK
-        smDebug(handle,SMDebugLow,"Previous SM call failed and changed the SM_STATUS value obtainable with getCumulativeStatus(). Status before failure was %d, and new error flag valued %d has been now set.\n",(int)smBus[handle].cumulativeSmStatus,(int)stat);
+    if(smAtomicLoad(&smBus[handle].cumulativeSmStatus)!=stat && stat!=SM_OK)//if status changed and new status is not SM_OK
+        smDebug(handle,SMDebugLow,"Previous SM call failed and changed the SM_STATUS value obtainable with getCumulativeStatus(). Status before failure was %d, and new error flag valued %d has been now set.\n",(int)smAtomicLoad(&smBus[handle].cumulativeSmStatus),(int)stat);
 
-    smBus[handle].cumulativeSmStatus|=stat;
+    smAtomicOr(&smBus[handle].cumulativeSmStatus,stat);
+    if(stat!=SM_OK)
+        smTraceEvent(handle,SMTraceStatus,0,stat,0);
 
     return stat;
 }
@@ -1072,7 +2460,7 @@ SM_STATUS getCumulativeStatus( const smbus handle )
 {
     if(smIsHandleOpen(handle)==smfalse) return SM_ERR_NODEVICE;
 
-    return smBus[handle].cumulativeSmStatus;
+    return smAtomicLoad(&smBus[handle].cumulativeSmStatus);
 }
 
 /** Reset cululative status so getCumultiveStatus returns 0 after calling this until one of the other functions are called*/
@@ -1082,7 +2470,7 @@ SM_STATUS resetCumulativeStatus( const smbus handle )
 
     smDebug(handle,SMDebugMid,"resetCumulativeStatus called.\n");
 
-    smBus[handle].cumulativeSmStatus=0;
+    smAtomicStore(&smBus[handle].cumulativeSmStatus,0);
 
     return SM_OK;
 }
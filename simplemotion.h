@@ -81,6 +81,13 @@ LIB void smSetBaudrate( unsigned long pbs );
  */
 LIB SM_STATUS smSetTimeout( smuint16 millsecs );
 
+/** Clear pending (stray) bytes in bus device reception buffer. This may be needed i.e. after restarting device to
+ * eliminate glitches that appear in serial line. */
+LIB SM_STATUS smPurge( const smbus bushandle );
+
+/** Block until pending TX bytes are physically out. Max blocking time is same that is set with smSetTimeout */
+LIB SM_STATUS smFlushTX( const smbus bushandle );
+
 /** Close connection to given bus handle number. This frees communication link therefore makes it available for other apps for opening.
   -return value: a SM_STATUS value, i.e. SM_OK if command succeed
 */
@@ -97,7 +104,8 @@ smVerbosityLevel:
  * SMDebugLow=only some excepetion/errors printed
  * SMDebugMid=some common function calls printed
  * SMDebugHigh=more details of function calls/bus communication printed
- * SMDebugTrace=print all raw RX/TX data and parsed read values of RX data
+ * SMDebugTrace=same as SMDebugHigh. raw RX/TX bytes and parsed return values are recorded in binary trace
+ *   instead of printing them, see eventtrace.h
  *
  * NOTE: for debug prints to work, SM library must be compiled with ENABLE_DEBUG_PRINTS defined (i.e. uncomment
  * that definition from simplemotion.h or define it application wide with compiler flag, i.e. -DENABLE_DEBUG_PRINTS).
@@ -111,6 +119,44 @@ LIB SM_STATUS getCumulativeStatus( const smbus handle );
 LIB SM_STATUS resetCumulativeStatus( const smbus handle );
 
 
+/** Returns a counter that changes whenever parameter values of devices on the bus may have changed without the host
+ * knowing their new values: when the bus is opened or purged (smPurge), or when a device is restarted by writing
+ * SMP_SYSTEM_CONTROL_RESTART or SMP_SYSTEM_CONTROL_RESTART_TO_DFU_MODE into SMP_SYSTEM_CONTROL through this library.
+ * Host side copies of parameter values (i.e. smParamCache) compare it to the value seen when they were filled.
+ */
+LIB smuint32 smGetBusGeneration( const smbus handle );
+
+/** Round trip latency statistics. Time from sending a command to receiving its reply is recorded to a histogram per
+ * bus and per command type (see smLatencyType) without debug prints or locking, so they may be kept on in production.
+ * smGetBusStatistics copies the histograms of the bus to statistics and may be called from any thread while the bus is
+ * in use, smResetBusStatistics zeroes them. Histograms are also zeroed when bus is opened. Failed commands (timeouts,
+ * corrupt replies) are not recorded, see getCumulativeStatus for those.
+ * Both return SM_ERR_PARAMETER if library is compiled without ENABLE_LATENCY_STATISTICS (see user_options.h).
+ */
+LIB SM_STATUS smGetBusStatistics( const smbus handle, SM_BUS_STATISTICS *statistics );
+LIB SM_STATUS smResetBusStatistics( const smbus handle );
+/** Returns the latency in microseconds that given percentage of samples of histogram are equal or below of, i.e.
+ * percentile=99.9 for p999. Result is the upper end of histogram bucket, so it's at most 1/8 above the exact value.
+ * Returns 0 if histogram is empty.
+ */
+LIB smuint32 smGetLatencyPercentile( const SM_LATENCY_HISTOGRAM *histogram, double percentile );
+
+/** Thread safety. When library is compiled with ENABLE_BUS_LOCKING (see user_options.h), each bus has its own
+ * recursive lock and different buses can be used from different threads in parallel without application side locking.
+ * Opening & closing of buses and getCumulativeStatus/resetCumulativeStatus are safe to call from any thread.
+ *
+ * Functions that perform a complete operation in one call (i.e. smRead*Parameter(s), smSetParameter, smGetBufferClock,
+ * smFastUpdateCycle*, smExecuteTransaction and the execute/upload calls of the queue) lock the bus internally, so
+ * one bus may also be shared by several threads. However the bus command queue and pipeline keep state between calls
+ * (smAppend*, smExecuteCommandQueue, smGetQueued*), so when several threads use them on the same bus, hold the bus
+ * lock over the whole sequence with smLockBus and smUnlockBus. Transactions don't need this as each thread may fill
+ * and read its own transaction objects.
+ *
+ * Without ENABLE_BUS_LOCKING these functions do nothing, and each bus must be used by one thread at a time.
+ */
+LIB SM_STATUS smLockBus( const smbus handle );
+LIB SM_STATUS smUnlockBus( const smbus handle );
+
 /** SMV2 Device communication functionss */
 LIB SM_STATUS smAppendCommandToQueue( smbus handle, smuint8 cmdid, smuint16 param  );
 LIB SM_STATUS smExecuteCommandQueue( const smbus bushandle, const smaddr targetaddress );
@@ -121,6 +167,78 @@ LIB SM_STATUS smBytesReceived( const smbus bushandle, smint32 *bytesinbuffer );
 
 LIB SM_STATUS smAppendSMCommandToQueue( smbus handle, int smpCmdType, smint32 paramvalue  );
 LIB SM_STATUS smGetQueuedSMCommandReturnValue(  const smbus bushandle, smint32 *retValue );
+/** Decode all return values that are left in the received payload to retValues in one pass, like calling
+ * smGetQueuedSMCommandReturnValue until smBytesReceived gives 0. retValues must have room for SM485_MAX_PAYLOAD_BYTES
+ * (120) values. Returns the number of values stored. */
+LIB smint32 smGetQueuedSMCommandReturnValues( const smbus bushandle, smint32 *retValues );
+
+/** Pipelined transactions send queued commands to several nodes back-to-back in one bus device write and
+ * collect the replies afterwards, so polling N nodes costs roughly one round trip of USB or TCP latency instead of N.
+ *
+ * Usage: for each node, fill the command queue with smAppend* functions as usual and call smAppendCommandQueueToPipeline
+ * (max SM_MAX_PIPELINED_NODES nodes, each address only once). Then call smExecutePipeline which sends all packets and
+ * waits replies of all nodes. Finally call smSelectPipelinedReturnValues for each node, after which that node's return
+ * values are read with smGetQueued* functions like after smExecuteCommandQueue.
+ *
+ * smExecutePipeline returns SM_ERR_COMMUNICATION if any reply is missing or corrupt. Replies that were received
+ * may still be selected, selecting a node without reply returns SM_ERR_COMMUNICATION.
+ *
+ * smAppendBufferedCommandQueueToPipeline is the same for commands that go to the buffered command FIFO of the node,
+ * like with smUploadCommandQueueToDeviceBuffer. Both kinds may be mixed in one pipeline.
+ *
+ * NOTE: all packets are on the wire before the first node replies. This requires a bus interface that
+ * buffers host packets and replies, such as a TCP/IP gateway, or a full duplex bus. On a plain half duplex RS485 link
+ * a node could start replying while later packets are still being transmitted. Use this only on buses where it
+ * has been verified to work, otherwise use smExecuteCommandQueue for each node.
+ */
+LIB SM_STATUS smAppendCommandQueueToPipeline( const smbus bushandle, const smaddr targetaddress );
+LIB SM_STATUS smAppendBufferedCommandQueueToPipeline( const smbus bushandle, const smaddr targetaddress );
+LIB SM_STATUS smExecutePipeline( const smbus bushandle );
+LIB SM_STATUS smSelectPipelinedReturnValues( const smbus bushandle, const smaddr targetaddress );
+
+/** Transactions are command queues with their own command and return value buffers, allocated from a per-bus pool of
+ * SM_MAX_TRANSACTIONS objects. Unlike the bus command queue (smAppendSMCommandToQueue etc), several transactions may be
+ * filled and hold return values simultaneously, so i.e. commands of next cycle can be prepared before return values of
+ * previous cycle have been read. Executing a transaction doesn't disturb the bus command queue: commands appended to it
+ * and its return values not read yet are kept.
+ *
+ * Usage: allocate with smAllocateTransaction (returns -1 if pool is empty), fill with smAppend*ToTransaction, send to device
+ * with smExecuteTransaction and read return values with smGetTransaction* functions in the same order as commands were
+ * appended. The first append after execution clears the transaction for reuse. Free with smFreeTransaction when not needed.
+ * Transactions are freed also when bus is closed.
+ */
+LIB smtransaction smAllocateTransaction( const smbus bushandle );
+LIB SM_STATUS smFreeTransaction( const smtransaction transaction );
+LIB SM_STATUS smAppendSMCommandToTransaction( const smtransaction transaction, int smpCmdType, smint32 paramvalue );
+LIB SM_STATUS smAppendGetParamCommandToTransaction( const smtransaction transaction, smint16 paramAddress );
+LIB SM_STATUS smAppendSetParamCommandToTransaction( const smtransaction transaction, smint16 paramAddress, smint32 paramValue );
+LIB SM_STATUS smExecuteTransaction( const smtransaction transaction, const smaddr targetaddress );
+LIB SM_STATUS smGetTransactionSMCommandReturnValue( const smtransaction transaction, smint32 *retValue );
+LIB SM_STATUS smGetTransactionGetParamReturnValue( const smtransaction transaction, smint32 *retValue );
+LIB SM_STATUS smGetTransactionSetParamReturnValue( const smtransaction transaction, smint32 *retValue );
+
+/** Non-blocking execution of transactions. smSubmitTransaction queues a filled transaction for execution and returns
+ * immediately, the transaction handle serves as the request id. smPoll does all work that can be done without waiting:
+ * sends queued transactions one at a time, reads reply bytes that have arrived and completes transactions whose reply
+ * is complete or has timeouted (timeout set by smSetTimeout). On completion the callback (may be NULL) is called from
+ * inside smPoll with the execution status, after which return values can be read with smGetTransaction* functions.
+ * The callback runs while smPoll holds the bus lock (if ENABLE_BUS_LOCKING is defined): calling library functions from
+ * it is allowed as the lock is recursive, but other threads using the same bus wait until the callback returns, so keep
+ * it short.
+ * smGetTransactionStatus returns SM_NONE while transaction is pending. Submitted transaction can't be modified or freed
+ * before completion.
+ *
+ * smPoll never waits if the bus device has a file descriptor (built-in unix serial port and TCP/IP drivers). Get it with
+ * smGetBusFileDescriptor and call smPoll when it becomes readable, i.e. from select/poll/epoll based event loop, and
+ * periodically to detect timeouts. With other bus devices reading in smPoll may block as long as the driver read does.
+ *
+ * Blocking functions and appending to the bus command queue on a bus that has a transaction in flight wait for it to
+ * complete first.
+ */
+LIB SM_STATUS smSubmitTransaction( const smtransaction transaction, const smaddr targetaddress, smTransactionCallback callback, void *userdata );
+LIB SM_STATUS smGetTransactionStatus( const smtransaction transaction );
+LIB SM_STATUS smPoll( const smbus bushandle );
+LIB SM_STATUS smGetBusFileDescriptor( const smbus bushandle, smint32 *fd );
 
 LIB SM_STATUS smAppendGetParamCommandToQueue( smbus handle, smint16 paramAddress );
 LIB SM_STATUS smGetQueuedGetParamReturnValue(  const smbus bushandle, smint32 *retValue  );
@@ -134,6 +252,30 @@ LIB SM_STATUS smRead2Parameters( const smbus handle, const smaddr nodeAddress, c
 LIB SM_STATUS smRead3Parameters( const smbus handle, const smaddr nodeAddress, const smint16 paramId1, smint32 *paramVal1,const smint16 paramId2, smint32 *paramVal2 ,const smint16 paramId3, smint32 *paramVal3 );
 LIB SM_STATUS smSetParameter( const smbus handle, const smaddr nodeAddress, const smint16 paramId, smint32 paramVal );
 
+/** Read any number of parameters from one device with as few packets as possible. Return value width is
+ * set only when it changes instead of once per parameter, and parameters are split automatically in as many
+ * packets as needed. Values are stored to paramVals in same order as paramIds.
+ *
+ * smReadParametersWithWidths takes also return width of each parameter, one of SM_RETURN_VALUE_16B (14 bit
+ * signed range), SM_RETURN_VALUE_24B (22 bit signed range) or SM_RETURN_VALUE_32B (30 bit signed range). Narrower
+ * widths shrink the reply so more parameters fit in one packet. Value that does not fit in the given width is
+ * truncated by device, so use narrow widths only for parameters whose range is known. If returnWidths is NULL,
+ * all values are read with SM_RETURN_VALUE_32B which is what smReadParameters does.
+ */
+LIB SM_STATUS smReadParameters( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, smint32 *paramVals, const int numParams );
+LIB SM_STATUS smReadParametersWithWidths( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, const smuint8 *returnWidths, smint32 *paramVals, const int numParams );
+
+/** Write any number of parameters into one device with as few packets as possible. Values that fit in 22 bits are sent
+ * as 24 bit subpackets and as many parameters are packed in each packet as fit. Execution status of each write
+ * (SMP_CMD_STATUS_ACK on success, otherwise SMP_CMD_STATUS_ bits telling the reason) is stored to paramStatuses in
+ * same order as paramIds, pass NULL if not needed. When writing to broadcast address, device doesn't
+ * reply and all statuses are set to SMP_CMD_STATUS_ACK. Parameters are written in given order.
+ *
+ * Returns SM_OK if all parameters were acknowledged, SM_ERR_PARAMETER if device rejected some of them and other
+ * errors if communication failed. Statuses of parameters in a failed packet are set to SMP_CMD_STATUS_NACK.
+ */
+LIB SM_STATUS smWriteParameters( const smbus handle, const smaddr nodeAddress, const smint16 *paramIds, const smint32 *paramVals, smint32 *paramStatuses, const int numParams );
+
 
 LIB SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smuint16 *clock );
 
@@ -141,6 +283,7 @@ LIB SM_STATUS smGetBufferClock( const smbus handle, const smaddr targetaddr, smu
  * smFastUpdateCycleWithStructs has been desniged to have lowest possible response time.
  * Typically the worst case response is 50 microseconds, which makes it to achieve up to 20kHz call rate. This may be useful especially when using external
  * closed loop and controlling motor torque or velocity in real time.
+ * Reaching high call rates requires also deterministic timing on host side, see cyclicscheduler.h for a fixed period scheduler.
  *
  * Parameters write and read are unions and contain several bit field arrangements.
  * The format mode should be set by setting SMP_FAST_UPDATE_CYCLE_FORMAT value before calling this function.
@@ -153,6 +296,19 @@ LIB SM_STATUS smFastUpdateCycleWithStructs( smbus handle, smuint8 nodeAddress, F
 */
 LIB SM_STATUS smFastUpdateCycle( smbus handle, smuint8 nodeAddress, smuint16 write1, smuint16 write2, smuint16 *read1, smuint16 *read2);
 
+/** smFastUpdateCycleMultiple performs smFastUpdateCycleWithStructs for numNodes nodes (max SM_MAX_PIPELINED_NODES) at once,
+ * nodeAddresses, write and read are arrays of numNodes elements. All packets are sent in one bus device write and all
+ * replies are read with as few reads as the bus device allows, which keeps cyclic control of many axes cheap.
+ *
+ * Result of each node is stored to nodeStatuses (may be NULL) and read values of failed nodes are not modified.
+ * Because fast update replies don't contain node address, a missing reply makes results of all nodes invalid
+ * and then all of them fail. Returns SM_OK if all nodes succeeded.
+ *
+ * NOTE: all packets are sent back-to-back like with pipelined transactions (see smExecutePipeline), so the same
+ * bus interface requirements apply.
+ */
+LIB SM_STATUS smFastUpdateCycleMultiple( smbus handle, int numNodes, const smuint8 *nodeAddresses, const FastUpdateCycleWriteData *write, FastUpdateCycleReadData *read, SM_STATUS *nodeStatuses );
+
 /** Return number of bus devices found. details of each device may be consequently fetched by smGetBusDeviceDetails() */
 LIB smint smGetNumberOfDetectedBuses();
 
@@ -8,6 +8,7 @@
 #include "simplemotion.h"
 #include "busdevice.h"
 #include "user_options.h"
+#include "eventtrace.h"
 #include <stdio.h>
 
 #define SM_VERSION 0x020700
@@ -28,6 +29,7 @@ extern unsigned long SMBusBaudrate; //the next opened port (with smOpenBus) will
 extern const smuint8 table_crc16_hi[];
 extern const smuint8 table_crc16_lo[];
 extern const smuint8 table_crc8[];
+extern const smuint16 table_crc16_slice[8][256];
 extern FILE *smDebugOut; //such as stderr or file handle. if NULL, debug info disbled
 extern smuint16 readTimeoutMs;
 
@@ -36,14 +38,63 @@ extern smuint16 readTimeoutMs;
 //set verbositylevel according to frequency of prints made.
 //I.e SMDebugLow=low frequency, so it gets displayed when global verbosity level is set to at least Low or set it to Trace which gets filtered
 //out if global verbisity level is set less than SMDebugTrace
+//
+//smDebug is a macro that checks the level before evaluating its arguments, so disabled prints cost one comparison.
+//prints above SM_DEBUG_COMPILE_LEVEL (see user_options.h) are removed at compile time. smDebugEnabled may be used to
+//skip a block of prints, i.e. a loop printing a buffer.
 #ifdef ENABLE_DEBUG_PRINTS
-void smDebug( smbus handle, smVerbosityLevel verbositylevel, char *format, ...);
+extern smVerbosityLevel smDebugThreshold;
+void smDebugPrint( smbus handle, smVerbosityLevel verbositylevel, char *format, ...);
+#define smDebugEnabled(verbositylevel) ((verbositylevel)<=SM_DEBUG_COMPILE_LEVEL && smDebugOut!=NULL && (verbositylevel)<=smDebugThreshold)
+#define smDebug(handle,verbositylevel,...) do{ if(smDebugEnabled(verbositylevel)) smDebugPrint((handle),(verbositylevel),__VA_ARGS__); }while(0)
 #else
-#define smDebug(...) {}
+#define smDebugEnabled(verbositylevel) 0
+#define smDebug(...) do{}while(0)
 #endif
+//cumulative status, statistics and trace events may be read and reset by other threads than the one using the bus.
+//smAtomicAdd returns the value before addition. smAtomicFenceRelease/Acquire order plain memory accesses around them like C11 atomic_thread_fence
+#if defined(__GNUC__)
+#define smAtomicOr(ptr,val) __atomic_fetch_or((ptr),(val),__ATOMIC_RELAXED)
+#define smAtomicLoad(ptr) __atomic_load_n((ptr),__ATOMIC_RELAXED)
+#define smAtomicStore(ptr,val) __atomic_store_n((ptr),(val),__ATOMIC_RELAXED)
+#define smAtomicAdd(ptr,val) __atomic_fetch_add((ptr),(val),__ATOMIC_RELAXED)
+#define smAtomicFenceRelease() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smAtomicFenceAcquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define smAtomicOr(ptr,val) _InterlockedOr((long volatile*)(ptr),(long)(val))
+#define smAtomicLoad(ptr) (*(volatile SM_STATUS*)(ptr))
+#define smAtomicStore(ptr,val) _InterlockedExchange((long volatile*)(ptr),(long)(val))
+#define smAtomicAdd(ptr,val) _InterlockedExchangeAdd((long volatile*)(ptr),(long)(val))
+#define smAtomicFenceRelease() _ReadWriteBarrier()//enough on x86/x64 where stores are not reordered with each other
+#define smAtomicFenceAcquire() _ReadWriteBarrier()
+#else
+#define smAtomicOr(ptr,val) (*(ptr)|=(val))
+#define smAtomicLoad(ptr) (*(ptr))
+#define smAtomicStore(ptr,val) (*(ptr)=(val))
+#define smAtomicAdd(ptr,val) ((*(ptr)+=(val))-(val))
+#define smAtomicFenceRelease() {}
+#define smAtomicFenceAcquire() {}
+#endif
+
+//smTraceEvent: records binary event to trace ring of the bus, see eventtrace.h. type is one of smTraceEventType
+#ifdef ENABLE_EVENT_TRACE
+void smTraceEvent( const smbus handle, const smuint8 type, const smuint8 address, const smint32 arg0, const smint32 arg1 );
+void smTraceReset( const smbus handle );
+#else
+#define smTraceEvent(handle,type,address,arg0,arg1) do{}while(0)
+#define smTraceReset(handle) do{}while(0)
+#endif
+char *cmdidToStr( smuint8 cmdid );
+
 //accumulates status to internal variable by ORing the bits. returns same value that is fed as paramter
 SM_STATUS recordStatus( const smbus handle, const SM_STATUS stat );
 
+//calculate SM CRC16 of a buffer. crcinit is the CRC of preceding data or SM485_CRCINIT at start of packet.
+//result is in the same format as with calcCRC16, i.e. high byte gets transmitted first
+smuint16 calcCRC16BufWithInit( const smuint8 *buf, smint32 len, smuint16 crcinit );
+smuint16 calcCRC16( smuint8 data, smuint16 crc );
+
 SM_STATUS smRawCmd( const char *axisname, smuint8 cmd, smuint16 val, smuint32 *retdata );
 
 /*Workaround to have packed structs that compile on GCC and MSVC*/
@@ -143,16 +194,6 @@ typedef union
 #endif
 
 
-/** Clear pending (stray) bytes in bus device reception buffer and reset receiver state. This may be needed i.e. after restarting device to eliminate clitches that appear in serial line.
-  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
-*/
-LIB SM_STATUS smPurge( const smbus bushandle );
-
-/** Block until pending TX bytes are phyiscally out. Max blocking time is same that is set with smSetTimeout
-  -return value: a SM_STATUS value, i.e. SM_OK if command succeed
-*/
-LIB SM_STATUS smFlushTX( const smbus bushandle );
-
 /* OS independent sleep function for SM internal use
  *
  * SM lib has implementation for unix/win systems (incl linux & mac). For other systems, please add your own smSleepMs implementation in your application.
@@ -165,5 +206,15 @@ LIB SM_STATUS smFlushTX( const smbus bushandle );
  */
 void smSleepMs(int millisecs);
 
+/* OS independent monotonic clock in milliseconds for SM internal use (i.e. timeouts of smPoll). Wraps around every ~49 days
+ * so compare times only by their difference. Like smSleepMs, implement this in your application on other than unix/win systems.
+ */
+smuint32 smGetMonotonicMs();
+
+/* Same in microseconds for latency statistics, wraps around every ~71 minutes. Implement this too on other than unix/win
+ * systems if ENABLE_LATENCY_STATISTICS is defined.
+ */
+smuint32 smGetMonotonicUs();
+
 
 #endif // SIMPLEMOTION_PRIVATE_H
@@ -29,6 +29,9 @@ typedef smint32 smint;
 #define smfalse 0
 typedef int SM_STATUS;
 typedef smuint8 smaddr;
+typedef smint32 smtransaction;//handle of transaction allocated with smAllocateTransaction, -1 if invalid
+//completion callback of smSubmitTransaction. status is the result of execution, i.e. SM_OK or SM_ERR_COMMUNICATION on timeout
+typedef void (*smTransactionCallback)(smtransaction transaction, SM_STATUS status, void *userdata);
 
 // output parameter type of smGetBusDeviceDetails
 typedef struct
@@ -43,10 +46,38 @@ typedef struct
  * SMDebugLow=only some excepetion/errors printed
  * SMDebugMid=some common function calls printed
  * SMDebugHigh=more details of function calls/bus communication printed
- * SMDebugTrace=print all raw RX/TX data and parsed read values of RX data
+ * SMDebugTrace=same as SMDebugHigh. raw RX/TX bytes and parsed return values are recorded in binary trace
+ *   instead of printing them, see eventtrace.h
  */
 typedef enum _smVerbosityLevel {SMDebugOff,SMDebugLow,SMDebugMid,SMDebugHigh,SMDebugTrace} smVerbosityLevel;
 
+/* Command types of round trip latency statistics, see smGetBusStatistics
+ * SMLatencyInstantCmd=SMCMD_INSTANT_CMD, i.e. smExecuteCommandQueue, smSetParameter, smRead*Parameter(s), transactions
+ * SMLatencyBufferedCmd=SMCMD_BUFFERED_CMD, i.e. buffered motion stream
+ * SMLatencyGetClock=SMCMD_GET_CLOCK
+ * SMLatencyFastUpdateCycle=SMCMD_FAST_UPDATE_CYCLE, smFastUpdateCycleMultiple is counted once per call
+ */
+typedef enum _smLatencyType {SMLatencyInstantCmd,SMLatencyBufferedCmd,SMLatencyGetClock,SMLatencyFastUpdateCycle,SMLatencyNumTypes} smLatencyType;
+
+//number of log-linear histogram buckets. values 0-7 us have own buckets, above that each power of two is split in
+//8 buckets so that bucket width is at most 1/8 of its value. last bucket counts also all values above ~4.2 s
+#define SM_LATENCY_HISTOGRAM_BUCKETS 160
+
+//latency histogram of one command type, times are in microseconds from sending command to receiving its reply
+typedef struct
+{
+    smuint32 count;
+    smuint32 minUs;
+    smuint32 maxUs;
+    smuint32 buckets[SM_LATENCY_HISTOGRAM_BUCKETS];
+} SM_LATENCY_HISTOGRAM;
+
+// output parameter type of smGetBusStatistics
+typedef struct
+{
+    SM_LATENCY_HISTOGRAM latency[SMLatencyNumTypes];//indexed by smLatencyType
+} SM_BUS_STATISTICS;
+
 /* Operations for BusdeviceMiscOperation callback.
  *
  * MiscOperationFlushTX = blocking call to make sure that all data has been physically transmitter
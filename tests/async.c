@@ -0,0 +1,107 @@
+// Verifies non-blocking transaction execution with smSubmitTransaction and smPoll:
+// completion callbacks, in order execution of several submitted transactions,
+// timeouts and blocking calls made while a transaction is in flight.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+
+static int completions;
+static smtransaction lastCompleted = -1;
+static SM_STATUS lastStatus;
+
+static void onComplete(smtransaction transaction, SM_STATUS status, void *userdata) {
+	assert(userdata == &completions);
+	completions++;
+	lastCompleted = transaction;
+	lastStatus = status;
+}
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smtransaction t1, t2;
+	smint32 value = 0, fd;
+	assert(handle >= 0);
+
+	simDevice.nodes[1].params[SMP_STATUS] = 11;
+	simDevice.nodes[2].params[SMP_STATUS] = 22;
+	t1 = smAllocateTransaction(handle);
+	t2 = smAllocateTransaction(handle);
+	assert(t1 >= 0 && t2 >= 0);
+
+	assert(smGetBusFileDescriptor(handle, &fd) == SM_ERR_PARAMETER);
+
+	{
+		// nothing happens before poll, and poll doesn't wait for reply
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t2, SMP_STATUS) == SM_OK);
+		assert(smSubmitTransaction(t1, 1, onComplete, &completions) == SM_OK);
+		assert(smSubmitTransaction(t2, 2, onComplete, &completions) == SM_OK);
+		assert(simDevice.framesReceived == 0);
+		assert(smGetTransactionStatus(t1) == SM_NONE);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_ERR_PARAMETER);
+		assert(smFreeTransaction(t1) == SM_ERR_PARAMETER);
+
+		simDevice.holdReplies = 1;
+		assert(smPoll(handle) == SM_OK);
+		assert(simDevice.framesReceived == 1);
+		assert(completions == 0);
+
+		// second one is sent only after first has completed
+		simDevice.holdReplies = 0;
+		simDevice.maxReadChunk = 5;
+		assert(smPoll(handle) == SM_OK);
+		simDevice.maxReadChunk = 0;
+		assert(completions == 2 && lastCompleted == t2 && lastStatus == SM_OK);
+		assert(simDevice.framesReceived == 2);
+		assert(smGetTransactionStatus(t1) == SM_OK);
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 11);
+		assert(smGetTransactionGetParamReturnValue(t2, &value) == SM_OK);
+		assert(value == 22);
+	}
+
+	{
+		// reply timeout
+		completions = 0;
+		assert(smSetTimeout(20) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smSubmitTransaction(t1, SIM_MAX_NODES + 1, onComplete, &completions) == SM_OK);
+		while (completions == 0)
+			assert(smPoll(handle) == SM_OK);
+		assert(lastCompleted == t1 && lastStatus == SM_ERR_COMMUNICATION);
+		assert(smGetTransactionStatus(t1) == SM_ERR_COMMUNICATION);
+		resetCumulativeStatus(handle);
+	}
+
+	{
+		// blocking call while transaction is in flight completes it first
+		completions = 0;
+		assert(smAppendSetParamCommandToTransaction(t1, SMP_TRAJ_PLANNER_VEL, 777) == SM_OK);
+		assert(smSubmitTransaction(t1, 1, NULL, NULL) == SM_OK);
+		simDevice.holdReplies = 1;
+		assert(smPoll(handle) == SM_OK);
+		simDevice.holdReplies = 0;
+		assert(smRead1Parameter(handle, 2, SMP_STATUS, &value) == SM_OK);
+		assert(value == 22);
+		assert(smGetTransactionStatus(t1) == SM_OK);
+		assert(simDevice.nodes[1].params[SMP_TRAJ_PLANNER_VEL] == 777);
+		assert(completions == 0);
+	}
+
+	{
+		// polling between execution of bus command queue and reading its return values
+		assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+		assert(smExecuteCommandQueue(handle, 2) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smSubmitTransaction(t1, 1, NULL, NULL) == SM_OK);
+		assert(smPoll(handle) == SM_OK);
+		assert(smGetTransactionStatus(t1) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+		assert(value == 22);
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 11);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
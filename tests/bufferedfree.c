@@ -0,0 +1,92 @@
+// Verifies free space estimate of buffered motion: it matches the device when
+// return data is up to date, never exceeds real free space when device has
+// executed commands whose return data is still on its way, and is resynced from
+// the device only every freeSpaceResyncInterval calls or after abort.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../bufferedmotion.h"
+
+static smint32 fillCycle(BufferedMotionAxis *axis, smint32 freeBytes) {
+	static smint32 position;
+	smint32 fill[30], received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, bytesFilled;
+	int i, n = smBufferedGetMaxFillSize(axis, freeBytes);
+	if (n > 10)
+		n = 10;// slower than device so that buffer doesn't fill up
+	for (i = 0; i < n; i++)
+		fill[i] = position++;
+	assert(smBufferedFillAndReceive(axis, n, fill, &numReceived, received, &bytesFilled) == SM_OK);
+	return n;
+}
+
+int main(void) {
+	smbus handle = simOpenBus();
+	BufferedMotionAxis axis, *axes[2], axis2;
+	BufferedMotionStreamer streamer;
+	SimNode *node = &simDevice.nodes[3];
+	smint32 freeBytes;
+	int cycle, frames;
+	assert(handle >= 0);
+	assert(smBufferedInit(&axis, handle, 3, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+	assert(axis.freeSpaceEstimateValid);
+	axis.freeSpaceResyncInterval = 5;
+
+	{
+		// exact when device has sent all return data, device read only every 6th cycle
+		frames = node->framesReceived;
+		for (cycle = 1; cycle <= 20; cycle++) {
+			assert(smBufferedGetFreeEstimate(&axis, &freeBytes) == SM_OK);
+			assert(freeBytes == node->params[SMP_BUFFER_FREE_BYTES]);
+			assert(axis.bufferFreeBytes == freeBytes);
+			fillCycle(&axis, freeBytes);
+		}
+		assert(node->framesReceived - frames == 20 + 3);
+	}
+
+	{
+		// device runs ahead of return data, estimate is conservative also right after resync
+		node->executeAhead = 3;
+		for (cycle = 1; cycle <= 40; cycle++) {
+			assert(smBufferedGetFreeEstimate(&axis, &freeBytes) == SM_OK);
+			assert(freeBytes <= node->params[SMP_BUFFER_FREE_BYTES]);
+			assert(node->params[SMP_BUFFER_FREE_BYTES] - freeBytes <= 3 * 4);
+			fillCycle(&axis, freeBytes);
+		}
+		node->executeAhead = 0;
+	}
+
+	{
+		// abort invalidates estimate
+		assert(smBufferedAbort(&axis) == SM_OK);
+		assert(!axis.freeSpaceEstimateValid);
+		frames = node->framesReceived;
+		assert(smBufferedGetFreeEstimate(&axis, &freeBytes) == SM_OK);
+		assert(node->framesReceived - frames == 1);
+		assert(freeBytes == SIM_BUFFER_LEN);
+	}
+
+	{
+		// streamer reads free space only when resync is due
+		assert(smBufferedInit(&axis2, handle, 4, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+		axes[0] = &axis;
+		axes[1] = &axis2;
+		axis.freeSpaceResyncInterval = axis2.freeSpaceResyncInterval = 3;
+		axis.cyclesSinceFreeSpaceResync = axis2.cyclesSinceFreeSpaceResync = 0;
+		assert(smBufferedStreamerInit(&streamer, 2, axes) == SM_OK);
+		simDevice.writeCalls = 0;
+		for (cycle = 1; cycle <= 8; cycle++) {
+			smint32 fill[2][10] = {{0}}, received[2][SM_BUFFERED_MAX_RETURN_POINTS], numReceived[2], maxFill;
+			smint32 *fillPtr[2] = {fill[0], fill[1]}, *receivedPtr[2] = {received[0], received[1]};
+			assert(smBufferedStreamerGetFree(&streamer, &maxFill) == SM_OK);
+			assert(axis2.bufferFreeBytes == simDevice.nodes[4].params[SMP_BUFFER_FREE_BYTES]);
+			assert(smBufferedStreamerFillAndReceive(&streamer, maxFill < 10 ? maxFill : 10, fillPtr, numReceived, receivedPtr) == SM_OK);
+		}
+		assert(simDevice.writeCalls == 8 + 2);
+		assert(smBufferedDeinit(&axis2) == SM_OK);
+	}
+
+	assert(smBufferedDeinit(&axis) == SM_OK);
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,153 @@
+// Verifies encoding of buffered setpoints: points close to the previous one are
+// sent as 24 bit increments, others as absolute values, and the device ends up
+// at every filled point whatever the mix. Return data of write address changes
+// is not passed to user. After a failed fill the device is resynced with an
+// absolute setpoint.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../bufferedmotion.h"
+
+#define NODE 5
+
+static BufferedMotionAxis axis;
+static smint32 expected[4096];
+static int numFilled, numChecked;
+
+// fill points and check that device setpoint follows them
+static smint32 fillAndCheck(int n, const smint32 *points) {
+	smint32 received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, bytesFilled, bytes;
+	int i;
+	bytes = smBufferedGetBytesConsumedForPoints(&axis, n, points);
+	assert(bytes <= smBufferedGetBytesConsumed(&axis, n));
+	assert(smBufferedFillAndReceive(&axis, n, (smint32 *)points, &numReceived, received, &bytesFilled) == SM_OK);
+	assert(bytesFilled == bytes);
+	for (i = 0; i < n; i++)
+		expected[numFilled++] = points[i];
+	for (i = 0; i < numReceived; i++)
+		assert(received[i] == expected[numChecked++]);
+	assert(numFilled - numChecked == axis.numberOfPendingReadPackets);
+	return bytesFilled;
+}
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smint32 points[40];
+	int i;
+	assert(handle >= 0);
+	// reading back the setpoint makes each return value equal to the point that produced it
+	assert(smBufferedInit(&axis, handle, NODE, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+	// increments are opt in
+	assert(!axis.incrementalSetpoints);
+	axis.incrementalSetpoints = smtrue;
+
+	{
+		// first point is absolute, small steps after it are increments: 12 bytes init, 4, 2 for address, 3 per point
+		for (i = 0; i < 30; i++)
+			points[i] = 100000 + i * 50;
+		assert(fillAndCheck(30, points) == 12 + 4 + 2 + 29 * 3);
+		assert(axis.writingIncrements);
+		// continuing in increments takes 3 bytes per point, so 40 points fit in a frame
+		for (i = 0; i < 40; i++)
+			points[i] = 101500 - i * 50;
+		assert(smBufferedGetMaxFillSizeForPoints(&axis, 1000, 40, points) == 40);
+		assert(smBufferedGetMaxFillSizeForPoints(&axis, 30, 40, points) == 10);
+		assert(smBufferedGetMaxFillSize(&axis, 1000) == 29);
+		assert(fillAndCheck(40, points) == 40 * 3);
+	}
+
+	{
+		// limits of 24 bit increment
+		smint32 last = points[39];
+		points[0] = last + (1 << 21) - 1;
+		points[1] = points[0] - (1 << 21);
+		assert(fillAndCheck(2, points) == 2 * 3);
+		// step that does not fit changes to absolute and short runs of small steps stay absolute
+		points[0] = points[1] + (1 << 21);
+		points[1] = points[0] + 1;
+		points[2] = points[1] + 1;
+		points[3] = -5000000;
+		points[4] = points[3] + 1;
+		points[5] = points[4] + 1;
+		points[6] = points[5] + 1;
+		points[7] = points[6] + 3000000;
+		assert(fillAndCheck(8, points) == 2 + 8 * 4);
+		// alternating big and small steps never take more than absolute points
+		for (i = 0; i < 30; i++)
+			points[i] = i % 2 ? points[i - 1] + 1 : i * 3000000;
+		assert(fillAndCheck(30, points) <= 2 + 30 * 4);
+		assert(!axis.writingIncrements);
+	}
+
+	{
+		// disabled increments send all points absolute
+		axis.incrementalSetpoints = smfalse;
+		for (i = 0; i < 20; i++)
+			points[i] = i;
+		assert(fillAndCheck(20, points) == 20 * 4);
+		axis.incrementalSetpoints = smtrue;
+		assert(fillAndCheck(20, points) == 2 + 20 * 3);
+	}
+
+	// rest of return data
+	while (axis.numberOfPendingReadPackets > 0)
+		fillAndCheck(0, points);
+	assert(numChecked == numFilled);
+	assert(axis.numberOfDiscardableReturnDataPackets == 0);
+	assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == expected[numFilled - 1]);
+
+	{
+		// after abort device setpoint is not known, so first point is absolute
+		assert(smBufferedAbort(&axis) == SM_OK);
+		assert(axis.numberOfPendingReadPackets == 0);
+		simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] = 12345;
+		points[0] = 1000;
+		points[1] = 1001;
+		points[2] = 1002;
+		assert(fillAndCheck(3, points) == 2 + 4 + 2 + 2 * 3);
+		while (axis.numberOfPendingReadPackets > 0)
+			fillAndCheck(0, points);
+		assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == 1002);
+	}
+
+	{
+		// fill that would change to increments fails, first when it doesn't reach the device and then when only its
+		// reply is lost. device may be writing either setpoint, so next fill sets write address and an absolute point
+		smint32 received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, bytesFilled;
+		int lost;
+		assert(smSetTimeout(20) == SM_OK);
+		for (lost = 0; lost < 2; lost++) {
+			points[0] = 0;
+			points[1] = 10000000;
+			points[2] = 20000000;
+			assert(smBufferedFillAndReceive(&axis, 3, points, &numReceived, received, &bytesFilled) == SM_OK);
+			assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == 20000000);
+
+			for (i = 0; i < 20; i++)
+				points[i] = 20000001 + i;
+			if (lost == 0)
+				simDevice.numNodes = NODE - 1;
+			else
+				simDevice.corruptReply = 1;
+			assert(smBufferedFillAndReceive(&axis, 20, points, &numReceived, received, &bytesFilled) != SM_OK);
+			assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == (lost == 0 ? 20000000 : 20000020));
+			assert(!axis.lastSetpointKnown && !axis.writeAddressKnown);
+			simDevice.numNodes = 0;
+			resetCumulativeStatus(handle);
+
+			for (i = 0; i < 20; i++)
+				points[i] = 20000021 + i;
+			assert(smBufferedGetBytesConsumedForPoints(&axis, 20, points) == 2 + 4 + 2 + 19 * 3);
+			assert(smBufferedGetBytesConsumedForPoints(&axis, 20, points) <= smBufferedGetBytesConsumed(&axis, 20));
+			assert(smBufferedFillAndReceive(&axis, 20, points, &numReceived, received, &bytesFilled) == SM_OK);
+			assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == 20000040);
+		}
+		// return data of lost fill doesn't arrive, so start over
+		assert(smBufferedAbort(&axis) == SM_OK);
+	}
+
+	assert(smBufferedDeinit(&axis) == SM_OK);
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
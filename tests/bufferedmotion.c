@@ -0,0 +1,51 @@
+// Verifies buffered motion stream against the simulator: fill points go to
+// the device buffer and their return data comes back in the same order.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../bufferedmotion.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	BufferedMotionAxis axis;
+	smint32 fill[30], received[30], numReceived, bytesFilled, expectedBytes, freeBytes, next = 0, expected = 0;
+	int i, round;
+	assert(handle >= 0);
+
+	// reading back the setpoint makes each return value equal to the point that produced it
+	assert(smBufferedInit(&axis, handle, 4, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+	assert(axis.bufferLength == SIM_BUFFER_LEN);
+	assert(smBufferedGetFree(&axis, &freeBytes) == SM_OK);
+	assert(freeBytes == SIM_BUFFER_LEN);
+
+	for (round = 0; round < 20; round++) {
+		int n = smBufferedGetMaxFillSize(&axis, SM485_MAX_PAYLOAD_BYTES);
+		assert(n > 0 && n <= 30);
+		for (i = 0; i < n; i++)
+			fill[i] = next++ * 7;
+		expectedBytes = smBufferedGetBytesConsumedForPoints(&axis, n, fill);
+		assert(expectedBytes <= smBufferedGetBytesConsumed(&axis, n));
+		assert(smBufferedFillAndReceive(&axis, n, fill, &numReceived, received, &bytesFilled) == SM_OK);
+		assert(bytesFilled == expectedBytes);
+		for (i = 0; i < numReceived; i++)
+			assert(received[i] == expected++ * 7);
+	}
+
+	// rest of return data is received with empty fills
+	while (axis.numberOfPendingReadPackets > 0) {
+		assert(smBufferedFillAndReceive(&axis, 0, fill, &numReceived, received, &bytesFilled) == SM_OK);
+		assert(numReceived > 0);
+		for (i = 0; i < numReceived; i++)
+			assert(received[i] == expected++ * 7);
+	}
+	assert(expected == next);
+	assert(axis.numberOfPendingReadPackets == 0);
+	assert(simDevice.nodes[4].bufferedExecuted > 0);
+
+	assert(smBufferedAbort(&axis) == SM_OK);
+	assert(simDevice.nodes[4].bufferLen == 0);
+	assert(smBufferedDeinit(&axis) == SM_OK);
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Verifies bulk decoding of return data: smGetQueuedSMCommandReturnValues gives
+// the same values as decoding one by one for all return value sizes, and
+// buffered motion return data goes to a caller provided ring with discarded
+// packets left out.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../bufferedmotion.h"
+
+#define NODE 7
+
+// queue commands that return values of all sizes, negative and positive
+static void queueMixedReturns(smbus handle) {
+	static const int lengths[4] = {SM_RETURN_VALUE_32B, SM_RETURN_VALUE_24B, SM_RETURN_VALUE_16B, SM_RETURN_STATUS};
+	int i;
+	assert(smAppendSMCommandToQueue(handle, SMPCMD_SETPARAMADDR, SMP_RETURN_PARAM_ADDR) == SM_OK);
+	assert(smAppendSMCommandToQueue(handle, SMPCMD_24B, SMP_TRAJ_PLANNER_VEL) == SM_OK);
+	for (i = 0; i < 16; i++) {
+		assert(smAppendSMCommandToQueue(handle, SMPCMD_SETPARAMADDR, SMP_RETURN_PARAM_LEN) == SM_OK);
+		assert(smAppendSMCommandToQueue(handle, SMPCMD_24B, lengths[i % 4]) == SM_OK);
+	}
+}
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smint32 single[SM485_MAX_PAYLOAD_BYTES], bulk[SM485_MAX_PAYLOAD_BYTES], bytes;
+	int n = 0, i, round;
+	assert(handle >= 0);
+
+	for (round = 0; round < 2; round++) {
+		// same values decoded one by one and in bulk
+		simDevice.nodes[NODE].params[SMP_TRAJ_PLANNER_VEL] = round ? -1000 : 1000;
+		// first run leaves return settings of device as they are at the start of the next runs
+		queueMixedReturns(handle);
+		assert(smExecuteCommandQueue(handle, NODE) == SM_OK);
+		smGetQueuedSMCommandReturnValues(handle, bulk);
+		queueMixedReturns(handle);
+		assert(smExecuteCommandQueue(handle, NODE) == SM_OK);
+		for (n = 0; assert(smBytesReceived(handle, &bytes) == SM_OK), bytes > 0; n++)
+			assert(smGetQueuedSMCommandReturnValue(handle, &single[n]) == SM_OK);
+		assert(n == 2 + 32);
+
+		queueMixedReturns(handle);
+		assert(smExecuteCommandQueue(handle, NODE) == SM_OK);
+		assert(smGetQueuedSMCommandReturnValues(handle, bulk) == n);
+		assert(smBytesReceived(handle, &bytes) == SM_OK && bytes == 0);
+		for (i = 0; i < n; i++)
+			assert(bulk[i] == single[i]);
+		// return value after setting length 32B/24B/16B is the parameter
+		assert(bulk[3] == simDevice.nodes[NODE].params[SMP_TRAJ_PLANNER_VEL]);
+		assert(bulk[5] == bulk[3] && bulk[7] == bulk[3]);
+	}
+	assert(getCumulativeStatus(handle) == SM_OK);
+
+	{
+		// buffered return data to ring, which wraps around and overflows when not consumed
+		BufferedMotionAxis axis;
+		BufferedReturnRing ring;
+		smint32 storage[100], fill[40], numReceived, bytesFilled, expected = 0, next = 0, total = 0;
+		assert(smBufferedReturnRingInit(&ring, storage, 0) == SM_ERR_PARAMETER);
+		assert(smBufferedReturnRingInit(&ring, storage, 100) == SM_OK);
+		assert(smBufferedInit(&axis, handle, NODE, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_24B) == SM_OK);
+		simDevice.framesReceived = 0;
+		assert(smBufferedFillAndReceiveToRing(&axis, 1, fill, NULL, &numReceived, &bytesFilled) == SM_ERR_PARAMETER);
+		assert(simDevice.framesReceived == 0);
+		resetCumulativeStatus(handle);
+
+		for (round = 0; round < 50; round++) {
+			int num = smBufferedGetMaxFillSize(&axis, SM485_MAX_PAYLOAD_BYTES);
+			for (i = 0; i < num; i++)
+				fill[i] = (next++ - 500) * 3;// negative and positive values
+			assert(smBufferedFillAndReceiveToRing(&axis, num, fill, &ring, &numReceived, &bytesFilled) == SM_OK);
+			total += numReceived;
+			if (round >= 45)
+				continue;// let ring fill up at the end
+			for (i = 0; i < ring.count; i++, expected++)
+				assert(ring.data[(ring.head + i) % ring.size] == (expected - 500) * 3);
+			smBufferedReturnRingConsume(&ring, ring.count);
+		}
+		while (axis.numberOfPendingReadPackets > 0) {
+			assert(smBufferedFillAndReceiveToRing(&axis, 0, fill, &ring, &numReceived, &bytesFilled) == SM_OK);
+			total += numReceived;
+		}
+		assert(total == next);
+		assert(axis.numberOfDiscardableReturnDataPackets == 0);
+		// newest points that didn't fit are dropped
+		assert(next - expected > 100);
+		assert(ring.overflows == (smuint32)(next - expected - 100));
+		assert(ring.count == 100);
+		for (i = 0; i < 100; i++)
+			assert(ring.data[(ring.head + i) % ring.size] == (expected + i - 500) * 3);
+
+		assert(smBufferedDeinit(&axis) == SM_OK);
+	}
+
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,73 @@
+// Verifies multi-axis buffered motion streamer against the simulator: all axes
+// of a bus are filled with one bus write per cycle, get the same number of
+// points and their return data comes back in order.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../bufferedmotion.h"
+
+#define AXES 4
+
+int main(void) {
+	smbus handle = simOpenBus();
+	BufferedMotionAxis axis[AXES], *axes[AXES];
+	BufferedMotionStreamer streamer;
+	smint32 fill[AXES][SM_BUFFERED_MAX_RETURN_POINTS], received[AXES][SM_BUFFERED_MAX_RETURN_POINTS];
+	smint32 *fillPtr[AXES], *receivedPtr[AXES], numReceived[AXES], expected[AXES], next = 0, maxFill;
+	int i, a, round;
+	assert(handle >= 0);
+
+	for (a = 0; a < AXES; a++) {
+		// reading back the setpoint makes each return value equal to the point that produced it
+		assert(smBufferedInit(&axis[a], handle, a + 1, 2500, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+		axes[a] = &axis[a];
+		fillPtr[a] = fill[a];
+		receivedPtr[a] = received[a];
+		expected[a] = 0;
+	}
+
+	{
+		// invalid setups
+		assert(smBufferedStreamerInit(&streamer, 0, axes) == SM_ERR_PARAMETER);
+		axis[1].samplerate = 1000;
+		assert(smBufferedStreamerInit(&streamer, AXES, axes) == SM_ERR_PARAMETER);
+		axis[1].samplerate = 2500;
+		resetCumulativeStatus(handle);
+	}
+
+	assert(smBufferedStreamerInit(&streamer, AXES, axes) == SM_OK);
+	simDevice.nodes[1].params[SMP_BUFFERED_CMD_PERIOD] = 1234;
+	assert(smBufferedStreamerRunAndSyncClocks(&streamer) == SM_OK);
+	for (a = 0; a < AXES; a++)
+		assert(axis[a].driveClock == 1234);
+
+	for (round = 0; round < 20; round++) {
+		simDevice.writeCalls = 0;
+		assert(smBufferedStreamerGetFree(&streamer, &maxFill) == SM_OK);
+		assert(maxFill > 0 && maxFill <= 30);
+		for (a = 0; a < AXES; a++)
+			assert(axis[a].bufferFreeBytes == simDevice.nodes[a + 1].params[SMP_BUFFER_FREE_BYTES]);
+		for (i = 0; i < maxFill; i++, next++)
+			for (a = 0; a < AXES; a++)
+				fill[a][i] = next * 10 + a;
+		assert(smBufferedStreamerFillAndReceive(&streamer, maxFill, fillPtr, numReceived, receivedPtr) == SM_OK);
+		// free space is read from devices only when estimate needs resync
+		assert(simDevice.writeCalls == (axis[0].cyclesSinceFreeSpaceResync == 0 ? 2 : 1));
+		for (a = 0; a < AXES; a++)
+			for (i = 0; i < numReceived[a]; i++, expected[a]++)
+				assert(received[a][i] == expected[a] * 10 + a);
+	}
+
+	// rest of return data is received with empty fills
+	while (axis[0].numberOfPendingReadPackets > 0)
+		assert(smBufferedStreamerFillAndReceive(&streamer, 0, fillPtr, numReceived, receivedPtr) == SM_OK);
+	for (a = 0; a < AXES; a++) {
+		assert(axis[a].numberOfPendingReadPackets == 0);
+		assert(simDevice.nodes[a + 1].bufferedExecuted == simDevice.nodes[1].bufferedExecuted);
+		assert(smBufferedDeinit(&axis[a]) == SM_OK);
+	}
+
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,71 @@
+// Verifies that reply packets are read from bus device driver in chunks instead of
+// one driver read call per byte, and that parsing still works when the driver
+// returns packets split in arbitrary pieces.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	assert(handle >= 0);
+
+	simDevice.nodes[1].params[SMP_FAULTS] = 0x1234;
+	simDevice.nodes[1].params[SMP_STATUS] = -5;
+	simDevice.nodes[1].params[SMP_DEVICE_TYPE] = 11000;
+
+	{
+		smint32 value = 0;
+		simDevice.readCalls = 0;
+		assert(smRead1Parameter(handle, 1, SMP_FAULTS, &value) == SM_OK);
+		assert(value == 0x1234);
+		// 4 bytes header + rest of packet
+		assert(simDevice.readCalls == 2);
+		assert(simDevice.outHead == simDevice.outTail);
+	}
+
+	{
+		smint32 v1 = 0, v2 = 0, v3 = 0;
+		simDevice.readCalls = 0;
+		assert(smRead3Parameters(handle, 1, SMP_FAULTS, &v1, SMP_STATUS, &v2, SMP_DEVICE_TYPE, &v3) == SM_OK);
+		assert(v1 == 0x1234 && v2 == -5 && v3 == 11000);
+		assert(simDevice.readCalls == 2);
+	}
+
+	{
+		// driver returns only few bytes at a time
+		smint32 value = 0;
+		simDevice.maxReadChunk = 3;
+		assert(smSetParameter(handle, 2, SMP_TRAJ_PLANNER_ACCEL, -100000) == SM_OK);
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_ACCEL] == -100000);
+		assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == -100000);
+		simDevice.maxReadChunk = 1;
+		assert(smRead1Parameter(handle, 1, SMP_STATUS, &value) == SM_OK);
+		assert(value == -5);
+		simDevice.maxReadChunk = 0;
+	}
+
+	{
+		// 2 byte fixed payload reply
+		smuint16 clock = 0;
+		simDevice.nodes[3].params[SMP_BUFFERED_CMD_PERIOD] = 4321;
+		simDevice.readCalls = 0;
+		assert(smGetBufferClock(handle, 3, &clock) == SM_OK);
+		assert(clock == 4321);
+		assert(simDevice.readCalls == 2);
+	}
+
+	{
+		// no reply from device must fail without hanging
+		smint32 value = 0;
+		resetCumulativeStatus(handle);
+		assert(smRead1Parameter(handle, SIM_MAX_NODES + 1, SMP_STATUS, &value) != SM_OK);
+		assert(getCumulativeStatus(handle) != SM_OK);
+		resetCumulativeStatus(handle);
+		assert(smRead1Parameter(handle, 1, SMP_FAULTS, &value) == SM_OK);
+		assert(value == 0x1234);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
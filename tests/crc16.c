@@ -0,0 +1,73 @@
+// Verifies that the slicing-by-8 buffer CRC16 gives same results as the byte wise
+// calcCRC16, that outbound packets assembled directly in transmit buffer are sent
+// with one driver write call and valid CRC, and that receiver rejects a reply with
+// any single byte corrupted.
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../simplemotion_private.h"
+
+static smuint16 crcBytewise(const smuint8 *buf, int len, smuint16 crc)
+{
+	int i;
+	for (i = 0; i < len; i++)
+		crc = calcCRC16(buf[i], crc);
+	return crc;
+}
+
+int main(void) {
+	smuint8 data[300];
+	int i, len, split;
+
+	srand(1234);
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = rand() & 0xff;
+
+	{
+		// all lengths and alignments, including continuation from partial CRC
+		for (len = 0; len <= 260; len++) {
+			smuint16 expected = crcBytewise(data + (len & 7), len, SM485_CRCINIT);
+			assert(calcCRC16BufWithInit(data + (len & 7), len, SM485_CRCINIT) == expected);
+			assert(simCrc16(data + (len & 7), len) == expected);
+			for (split = 0; split <= len; split += 7) {
+				smuint16 crc = calcCRC16BufWithInit(data, split, SM485_CRCINIT);
+				assert(calcCRC16BufWithInit(data + split, len - split, crc) == crcBytewise(data, len, SM485_CRCINIT));
+			}
+		}
+		assert(calcCRC16BufWithInit(data, 100, 0xFFFF) == crcBytewise(data, 100, 0xFFFF));
+	}
+
+	{
+		// each outbound packet goes to driver in single write
+		smbus handle = simOpenBus();
+		smint32 value = 0;
+		smuint16 r1 = 0, r2 = 0;
+		assert(handle >= 0);
+
+		simDevice.writeCalls = 0;
+		assert(smSetParameter(handle, 4, SMP_TRAJ_PLANNER_VEL, 123456) == SM_OK);
+		assert(simDevice.writeCalls == 1);
+		assert(smRead1Parameter(handle, 4, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(value == 123456);
+		assert(simDevice.writeCalls == 2);
+
+		assert(smFastUpdateCycle(handle, 5, 0x1111, 0x2220, &r1, &r2) == SM_OK);
+		assert(simDevice.writeCalls == 3);
+		assert(r1 == 0x1111 && r2 == 0x2720);
+
+		// reply of smRead1Parameter is 3 header bytes, 4 bytes of SMP_RETURN_PARAM_LEN write status,
+		// 4 bytes of SMP_RETURN_PARAM_ADDR write status, 4 bytes of value and 2 bytes of CRC
+		for (i = 1; i <= 3 + 12 + 2; i++) {
+			simDevice.corruptReply = i;
+			assert(smRead1Parameter(handle, 4, SMP_TRAJ_PLANNER_VEL, &value) & SM_ERR_COMMUNICATION);
+			assert(simDevice.corruptReply == 0);
+			resetCumulativeStatus(handle);
+			assert(smRead1Parameter(handle, 4, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+			assert(value == 123456);
+		}
+		assert(smCloseBus(handle) == SM_OK);
+	}
+
+	return 0;
+}
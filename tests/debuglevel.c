@@ -0,0 +1,72 @@
+// Verifies smDebug filtering: arguments of prints above the run time or the
+// compile time level are not evaluated and nothing is written for them.
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+// as if library user had compiled with -DSM_DEBUG_COMPILE_LEVEL=SMDebugMid
+#define SM_DEBUG_COMPILE_LEVEL SMDebugMid
+#include "../simplemotion_private.h"
+
+static int evaluated;
+
+static int sideEffect(void) {
+	return ++evaluated;
+}
+
+static long outputLength(FILE *out) {
+	fflush(out);
+	return ftell(out);
+}
+
+int main(void) {
+	FILE *out = tmpfile();
+	assert(out != NULL);
+
+	{
+		// no output stream
+		smSetDebugOutput(SMDebugTrace, NULL);
+		smDebug(-1, SMDebugLow, "%d\n", sideEffect());
+		assert(evaluated == 0);
+		assert(!smDebugEnabled(SMDebugLow));
+	}
+
+	{
+		// run time level
+		smSetDebugOutput(SMDebugLow, out);
+		smDebug(-1, SMDebugLow, "%d\n", sideEffect());
+		assert(evaluated == 1);
+		assert(outputLength(out) > 0);
+		smDebug(-1, SMDebugMid, "%d\n", sideEffect());
+		assert(evaluated == 1);
+	}
+
+	{
+		// compile time level
+		long len;
+		smSetDebugOutput(SMDebugTrace, out);
+		len = outputLength(out);
+		smDebug(-1, SMDebugMid, "%d\n", sideEffect());
+		assert(evaluated == 2);
+		assert(outputLength(out) > len);
+		len = outputLength(out);
+		smDebug(-1, SMDebugHigh, "%d\n", sideEffect());
+		smDebug(-1, SMDebugTrace, "%d\n", sideEffect());
+		assert(evaluated == 2);
+		assert(outputLength(out) == len);
+		assert(smDebugEnabled(SMDebugMid) && !smDebugEnabled(SMDebugHigh));
+	}
+
+	{
+		// usable as single statement
+		if (evaluated > 100)
+			smDebug(-1, SMDebugLow, "never\n");
+		else
+			smDebug(-1, SMDebugLow, "%d\n", sideEffect());
+		assert(evaluated == 3);
+	}
+
+	smSetDebugOutput(SMDebugOff, NULL);
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,445 @@
+// tests/devicesim.h
+//
+// Minimal in-process SimpleMotion V2 device for test cases. The test opens a bus with
+//
+//   smOpenBusWithCallbacks("sim", simBusOpen, simBusClose, simBusRead, simBusWrite, simBusMiscOperation);
+//
+// and every frame the library transmits is parsed and answered by a simulated node
+// with the address given in the frame. Each node has a plain parameter table; writes
+// store values and reads return them according to SMP_RETURN_PARAM_ADDR and
+// SMP_RETURN_PARAM_LEN exactly like a real device does. Writes to SMP_INCREMENTAL_SETPOINT
+// are added to SMP_ABSOLUTE_SETPOINT.
+//
+// Instant and buffered commands have their own write address and SMP_RETURN_PARAM_ADDR and
+// SMP_RETURN_PARAM_LEN settings like in a real device, so reading parameters does not change
+// return data of a running buffered motion stream.
+//
+// SMCMD_BUFFERED_CMD payload is appended to the buffered command FIFO of the node.
+// Buffered commands are executed as soon as they arrive, as many as their return data
+// fits in one reply, and the return data is sent in the reply like from a device that
+// runs buffered motion faster than the host fills it. SMP_BUFFER_FREE_BYTES tells
+// free space of the FIFO and SMP_SYSTEM_CONTROL_ABORTBUFFERED empties it. With executeAhead
+// the node also executes that many commands after each reply and sends their return data in
+// the next reply, like a device that keeps running between host fills.
+//
+// CRC16 is calculated here bit by bit instead of using the library tables so that the
+// simulator also verifies the CRC implementation of the library.
+
+#ifndef DEVICESIM_H
+#define DEVICESIM_H
+
+#include <string.h>
+#include <assert.h>
+#include "../simplemotion.h"
+#include "../sm485.h"
+
+#define SIM_MAX_NODES 32
+#define SIM_NUM_PARAMS (SMP_ADDRESS_BITS_MASK+1)
+#define SIM_QUEUE_LEN 16384
+#define SIM_BUFFER_LEN 2048
+
+// command parser state, separate for instant and buffered commands
+typedef struct
+{
+    smuint16 writeAddr;
+    smint32 returnParamAddr, returnParamLen;
+} SimContext;
+
+typedef struct
+{
+    smint32 params[SIM_NUM_PARAMS];
+    smuint8 readOnly[SIM_NUM_PARAMS];// writes are rejected with SMP_CMD_STATUS_NACK if set
+    SimContext instant, buffered;
+    int framesReceived;
+
+    // buffered command FIFO
+    smuint8 buffer[SIM_BUFFER_LEN];
+    int bufferLen;
+    int bufferedExecuted;// number of buffered subpackets executed
+    int executeAhead;// buffered subpackets executed after reply, return data is sent in next reply
+    smuint8 aheadReturn[SM485_MAX_PAYLOAD_BYTES];
+    int aheadReturnLen;
+} SimNode;
+
+typedef struct
+{
+    SimNode nodes[SIM_MAX_NODES];
+
+    // bytes written by library but not yet forming a complete frame
+    smuint8 in[SIM_QUEUE_LEN];
+    int inLen;
+
+    // reply bytes waiting to be read by library
+    smuint8 out[SIM_QUEUE_LEN];
+    int outHead, outTail;
+
+    // statistics, may be reset by test
+    int readCalls, writeCalls;
+    int bytesRead, bytesWritten;
+    int framesReceived;
+
+    // if >0, each read returns at most this many bytes (simulates split packets)
+    int maxReadChunk;
+
+    // if set, replies are kept back and reads return nothing (simulates reply in transit)
+    int holdReplies;
+
+    // if >0, only nodes 1..numNodes exist and others do not reply. otherwise all addresses below SIM_MAX_NODES reply
+    int numNodes;
+
+    // if >0, one bit of byte number corruptReply-1 of the next reply frame is flipped (simulates noise on bus)
+    int corruptReply;
+} SimDevice;
+
+static SimDevice simDevice;
+
+extern const smuint8 table_crc8[];
+
+static smuint16 simCrc16(const smuint8 *data, int len)
+{
+    smuint16 crc=0;
+    int i,b;
+    for(i=0;i<len;i++)
+    {
+        crc^=data[i];
+        for(b=0;b<8;b++)
+            crc=(crc&1) ? (crc>>1)^0xA001 : crc>>1;
+    }
+    // SM transmits crc low byte first, library stores it in opposite byte order
+    return (smuint16)((crc<<8)|(crc>>8));
+}
+
+static smuint8 simCrc8(const smuint8 *data, int len)
+{
+    smuint8 crc=0x52;
+    int i;
+    for(i=0;i<len;i++)
+        crc=table_crc8[crc^data[i]];
+    return crc;
+}
+
+static void simPut(SimDevice *d, smuint8 byte)
+{
+    assert(d->outHead<SIM_QUEUE_LEN);
+    d->out[d->outHead++]=byte;
+}
+
+static smint32 simSignExtend(smuint32 value, int bits)
+{
+    smuint32 sign=1UL<<(bits-1);
+    value&=(sign<<1)-1;
+    return (smint32)((value^sign)-sign);
+}
+
+// called for every value write subpacket
+static smuint8 simWriteParam(SimNode *node, smuint16 addr, smint32 value)
+{
+    if(node->readOnly[addr&SMP_ADDRESS_BITS_MASK])
+        return SMP_CMD_STATUS_NACK;
+    if((addr&SMP_ADDRESS_BITS_MASK)==SMP_SYSTEM_CONTROL && value==SMP_SYSTEM_CONTROL_ABORTBUFFERED)
+    {
+        node->bufferLen=0;
+        node->aheadReturnLen=0;
+        node->params[SMP_BUFFER_FREE_BYTES]=SIM_BUFFER_LEN;
+    }
+    if((addr&SMP_ADDRESS_BITS_MASK)==SMP_INCREMENTAL_SETPOINT)
+        node->params[SMP_ABSOLUTE_SETPOINT]+=value;
+    node->params[addr&SMP_ADDRESS_BITS_MASK]=value;
+    return SMP_CMD_STATUS_ACK;
+}
+
+// append return subpacket of one executed command to reply payload
+static int simAppendReturn(SimNode *node, SimContext *ctx, smuint8 *ret, smuint8 status)
+{
+    smint32 len=ctx->returnParamLen&3;
+    smint32 value=node->params[ctx->returnParamAddr&SMP_ADDRESS_BITS_MASK];
+    smuint32 raw;
+
+    switch(len)
+    {
+    case SM_RETURN_VALUE_32B:
+        raw=((smuint32)SM_RETURN_VALUE_32B<<30)|((smuint32)value&0x3fffffff);
+        ret[0]=raw>>24; ret[1]=raw>>16; ret[2]=raw>>8; ret[3]=raw;
+        return 4;
+    case SM_RETURN_VALUE_24B:
+        raw=((smuint32)SM_RETURN_VALUE_24B<<22)|((smuint32)value&0x3fffff);
+        ret[0]=raw>>16; ret[1]=raw>>8; ret[2]=raw;
+        return 3;
+    case SM_RETURN_VALUE_16B:
+        raw=((smuint32)SM_RETURN_VALUE_16B<<14)|((smuint32)value&0x3fff);
+        ret[0]=raw>>8; ret[1]=raw;
+        return 2;
+    default:
+        ret[0]=(SM_RETURN_STATUS<<6)|(status&0x3f);
+        return 1;
+    }
+}
+
+// execute one subpacket and append its return data to ret, returns number of payload bytes consumed
+static int simExecuteSubpacket(SimNode *node, SimContext *ctx, const smuint8 *payload, int len, smuint8 *ret, int *retlen)
+{
+    int type=payload[0]>>6, used;
+    smuint8 status=SMP_CMD_STATUS_ACK;
+    smint32 value;
+
+    if(type==SM_SET_WRITE_ADDRESS)
+    {
+        assert(2<=len);
+        ctx->writeAddr=((payload[0]<<8)|payload[1])&0x3fff;
+        used=2;
+    }
+    else if(type==SM_WRITE_VALUE_24B || type==SM_WRITE_VALUE_32B)
+    {
+        if(type==SM_WRITE_VALUE_24B)
+        {
+            assert(3<=len);
+            value=simSignExtend(((smuint32)payload[0]<<16)|(payload[1]<<8)|payload[2],22);
+            used=3;
+        }
+        else
+        {
+            assert(4<=len);
+            value=simSignExtend(((smuint32)payload[0]<<24)|((smuint32)payload[1]<<16)|(payload[2]<<8)|payload[3],30);
+            used=4;
+        }
+        if((ctx->writeAddr&SMP_ADDRESS_BITS_MASK)==SMP_RETURN_PARAM_ADDR)
+            ctx->returnParamAddr=value;
+        else if((ctx->writeAddr&SMP_ADDRESS_BITS_MASK)==SMP_RETURN_PARAM_LEN)
+            ctx->returnParamLen=value;
+        else
+            status=simWriteParam(node,ctx->writeAddr,value);
+    }
+    else
+    {
+        assert(!"reserved subpacket type");
+        return len;
+    }
+
+    *retlen+=simAppendReturn(node,ctx,ret+*retlen,status);
+    assert(*retlen<=SM485_MAX_PAYLOAD_BYTES);
+    return used;
+}
+
+// execute subpackets of INSTANT_CMD payload and form return payload, returns its length
+static int simExecuteSubpackets(SimNode *node, const smuint8 *payload, int len, smuint8 *ret)
+{
+    int i=0, retlen=0;
+
+    while(i<len)
+        i+=simExecuteSubpacket(node,&node->instant,payload+i,len-i,ret,&retlen);
+    return retlen;
+}
+
+// execute buffered commands while their return data fits in one reply, returns return payload length
+static int simExecuteBuffered(SimNode *node, smuint8 *ret)
+{
+    int i=0, retlen=node->aheadReturnLen, k;
+
+    memcpy(ret,node->aheadReturn,node->aheadReturnLen);
+    node->aheadReturnLen=0;
+    while(i<node->bufferLen && retlen+4<=SM485_MAX_PAYLOAD_BYTES)
+    {
+        i+=simExecuteSubpacket(node,&node->buffered,node->buffer+i,node->bufferLen-i,ret,&retlen);
+        node->bufferedExecuted++;
+    }
+    for(k=0;k<node->executeAhead && i<node->bufferLen && node->aheadReturnLen+4<=SM485_MAX_PAYLOAD_BYTES/2;k++)
+    {
+        i+=simExecuteSubpacket(node,&node->buffered,node->buffer+i,node->bufferLen-i,node->aheadReturn,&node->aheadReturnLen);
+        node->bufferedExecuted++;
+    }
+    memmove(node->buffer,node->buffer+i,node->bufferLen-i);
+    node->bufferLen-=i;
+    node->params[SMP_BUFFER_FREE_BYTES]=SIM_BUFFER_LEN-node->bufferLen;
+    return retlen;
+}
+
+static void simSendFrame(SimDevice *d, smuint8 cmdid, smuint8 addr, const smuint8 *payload, int len, smbool withsize)
+{
+    smuint8 frame[SM485_BUFSIZE+8];
+    int n=0;
+    smuint16 crc;
+
+    frame[n++]=cmdid;
+    if(withsize)
+        frame[n++]=len;
+    frame[n++]=addr;
+    memcpy(frame+n,payload,len);
+    n+=len;
+    crc=simCrc16(frame,n);
+    frame[n++]=crc>>8;
+    frame[n++]=crc&0xff;
+
+    if(d->corruptReply>0 && d->corruptReply<=n)
+    {
+        frame[d->corruptReply-1]^=0x10;
+        d->corruptReply=0;
+    }
+
+    for(int i=0;i<n;i++)
+        simPut(d,frame[i]);
+}
+
+static int simNodeExists(SimDevice *d, int addr)
+{
+    if(addr>=SIM_MAX_NODES)
+        return 0;
+    return d->numNodes<=0 || addr==SM_BROADCAST_ADDR || addr<=d->numNodes;
+}
+
+// try to parse and answer one frame from input queue, returns number of bytes consumed or 0 if frame is not complete yet
+static int simProcessFrame(SimDevice *d)
+{
+    const smuint8 *f=d->in;
+    smuint8 cmdid;
+    int framelen, payloadlen, addr;
+    const smuint8 *payload;
+
+    if(d->inLen<1) return 0;
+    cmdid=f[0];
+
+    if(cmdid==SMCMD_FAST_UPDATE_CYCLE)
+    {
+        smuint8 ret[6];
+        if(d->inLen<7) return 0;
+        assert(simCrc8(f,6)==f[6]);
+        addr=f[1];
+        if(!simNodeExists(d,addr)) return 7; // no such node, no reply
+        d->nodes[addr].framesReceived++;
+        d->framesReceived++;
+        // echo write data back so test can verify it went to correct node
+        ret[0]=SMCMD_FAST_UPDATE_CYCLE_RET;
+        ret[1]=f[2]; ret[2]=f[3];
+        ret[3]=f[4]; ret[4]=(smuint8)(f[5]+addr);
+        ret[5]=simCrc8(ret,5);
+        for(int i=0;i<6;i++)
+            simPut(d,ret[i]);
+        return 7;
+    }
+
+    switch(cmdid&SMCMD_MASK_PARAMS_BITS)
+    {
+    case SMCMD_MASK_N_PARAMS:
+        if(d->inLen<3) return 0;
+        payloadlen=f[1];
+        addr=f[2];
+        payload=f+3;
+        framelen=3+payloadlen+2;
+        break;
+    case SMCMD_MASK_0_PARAMS:
+        payloadlen=0;
+        addr=d->inLen>1 ? f[1] : 0;
+        payload=f+2;
+        framelen=2+2;
+        break;
+    default:
+        assert(!"unsupported command from host");
+        return 0;
+    }
+
+    if(d->inLen<framelen) return 0;
+    {
+        smuint16 crc=simCrc16(f,framelen-2);
+        assert(f[framelen-2]==(crc>>8) && f[framelen-1]==(crc&0xff));
+    }
+    if(!simNodeExists(d,addr)) return framelen; // no such node, no reply
+    d->framesReceived++;
+    d->nodes[addr].framesReceived++;
+
+    if(cmdid==SMCMD_INSTANT_CMD)
+    {
+        smuint8 ret[SM485_MAX_PAYLOAD_BYTES];
+        int retlen=simExecuteSubpackets(&d->nodes[addr],payload,payloadlen,ret);
+        if(addr!=SM_BROADCAST_ADDR)
+            simSendFrame(d,SMCMD_INSTANT_CMD_RET,addr,ret,retlen,smtrue);
+    }
+    else if(cmdid==SMCMD_BUFFERED_CMD)
+    {
+        SimNode *node=&d->nodes[addr];
+        smuint8 ret[SM485_MAX_PAYLOAD_BYTES];
+        int retlen;
+        assert(node->bufferLen+payloadlen<=SIM_BUFFER_LEN);
+        memcpy(node->buffer+node->bufferLen,payload,payloadlen);
+        node->bufferLen+=payloadlen;
+        retlen=simExecuteBuffered(node,ret);
+        if(addr!=SM_BROADCAST_ADDR)
+            simSendFrame(d,SMCMD_BUFFERED_CMD_RET,addr,ret,retlen,smtrue);
+    }
+    else if(cmdid==SMCMD_GET_CLOCK)
+    {
+        smuint16 clock=(smuint16)d->nodes[addr].params[SMP_BUFFERED_CMD_PERIOD];
+        simSendFrame(d,SMCMD_GET_CLOCK_RET,addr,(smuint8*)&clock,2,smfalse);
+    }
+    else
+    {
+        assert(!"command not simulated");
+    }
+
+    return framelen;
+}
+
+static smBusdevicePointer simBusOpen(const char *port_device_name, smint32 baudrate_bps, smbool *success)
+{
+    (void)port_device_name;
+    (void)baudrate_bps;
+    memset(&simDevice,0,sizeof(simDevice));
+    for(int i=0;i<SIM_MAX_NODES;i++)
+        simDevice.nodes[i].params[SMP_BUFFER_FREE_BYTES]=SIM_BUFFER_LEN;
+    *success=smtrue;
+    return &simDevice;
+}
+
+static void simBusClose(smBusdevicePointer busdevicePointer)
+{
+    (void)busdevicePointer;
+}
+
+static smint32 simBusRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    SimDevice *d=(SimDevice*)busdevicePointer;
+    int n=d->outHead-d->outTail;
+
+    d->readCalls++;
+    if(d->holdReplies) n=0;
+    if(n>size) n=size;
+    if(d->maxReadChunk>0 && n>d->maxReadChunk) n=d->maxReadChunk;
+    memcpy(buf,d->out+d->outTail,n);
+    d->outTail+=n;
+    if(d->outTail==d->outHead)
+        d->outTail=d->outHead=0;
+    d->bytesRead+=n;
+    return n;
+}
+
+static smint32 simBusWrite(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size)
+{
+    SimDevice *d=(SimDevice*)busdevicePointer;
+    int used;
+
+    d->writeCalls++;
+    d->bytesWritten+=size;
+    assert(d->inLen+size<=SIM_QUEUE_LEN);
+    memcpy(d->in+d->inLen,buf,size);
+    d->inLen+=size;
+
+    while((used=simProcessFrame(d))>0)
+    {
+        memmove(d->in,d->in+used,d->inLen-used);
+        d->inLen-=used;
+    }
+    return size;
+}
+
+static smbool simBusMiscOperation(smBusdevicePointer busdevicePointer, BusDeviceMiscOperationType operation)
+{
+    SimDevice *d=(SimDevice*)busdevicePointer;
+    if(operation==MiscOperationPurgeRX)
+        d->outHead=d->outTail=0;
+    return smtrue;
+}
+
+static smbus simOpenBus(void)
+{
+    return smOpenBusWithCallbacks("sim", simBusOpen, simBusClose, simBusRead, simBusWrite, simBusMiscOperation);
+}
+
+#endif // DEVICESIM_H
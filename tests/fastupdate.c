@@ -0,0 +1,70 @@
+// Verifies smFastUpdateCycleMultiple: packets of all axes go out in one write,
+// replies are read in bulk and each reply ends up to the node that sent it.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../user_options.h"
+
+#define NUM_AXES 6
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smuint8 nodes[NUM_AXES] = {1, 2, 3, 4, 5, 6};
+	FastUpdateCycleWriteData write[NUM_AXES];
+	FastUpdateCycleReadData read[NUM_AXES];
+	SM_STATUS statuses[NUM_AXES];
+	int i, cycle;
+	assert(handle >= 0);
+
+	{
+		// simulator echoes write data with node address added to last byte
+		for (cycle = 0; cycle < 100; cycle++) {
+			for (i = 0; i < NUM_AXES; i++) {
+				write[i].U16[0] = cycle * 10 + i;
+				write[i].U16[1] = 0x1000;
+			}
+			simDevice.writeCalls = 0;
+			simDevice.readCalls = 0;
+			assert(smFastUpdateCycleMultiple(handle, NUM_AXES, nodes, write, read, statuses) == SM_OK);
+			assert(simDevice.writeCalls == 1);
+			assert(simDevice.readCalls == 1);
+			for (i = 0; i < NUM_AXES; i++) {
+				assert(statuses[i] == SM_OK);
+				assert(read[i].U16[0] == cycle * 10 + i);
+				assert(read[i].U16[1] == 0x1000 + (nodes[i] << 8));
+			}
+		}
+	}
+
+	{
+		// split reads are collected
+		simDevice.maxReadChunk = 4;
+		assert(smFastUpdateCycleMultiple(handle, NUM_AXES, nodes, write, read, NULL) == SM_OK);
+		assert(read[5].U16[1] == 0x1600);
+		simDevice.maxReadChunk = 0;
+	}
+
+	{
+		// missing node fails all as replies can't be matched
+		nodes[2] = SIM_MAX_NODES + 1;
+		read[0].U16[0] = 0xbeef;
+		assert(smSetTimeout(20) == SM_OK);
+		assert(smFastUpdateCycleMultiple(handle, NUM_AXES, nodes, write, read, statuses) != SM_OK);
+		for (i = 0; i < NUM_AXES; i++)
+			assert(statuses[i] != SM_OK);
+		assert(read[0].U16[0] == 0xbeef);
+		resetCumulativeStatus(handle);
+		nodes[2] = 3;
+	}
+
+	{
+		// too many nodes
+		assert(smFastUpdateCycleMultiple(handle, SM_MAX_PIPELINED_NODES + 1, nodes, write, read, NULL) == SM_ERR_PARAMETER);
+		assert(smFastUpdateCycleMultiple(handle, 0, nodes, write, read, NULL) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(handle);
+	}
+
+	assert(smFastUpdateCycleMultiple(handle, NUM_AXES, nodes, write, read, statuses) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
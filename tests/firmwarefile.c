@@ -0,0 +1,98 @@
+// Verifies .gdf file loading of smFirmwareUpload: invalid headers are rejected
+// before the device is accessed and the version 300 checksum is verified over
+// a file whose bytes would overflow narrow sums.
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../devicedeployment.h"
+
+#define FW_SIZE 5001
+
+static char path[] = "/tmp/smfirmwareXXXXXX";
+
+static void writeFile(const void *data, size_t len) {
+	FILE *f = fopen(path, "wb");
+	assert(f != NULL);
+	assert(fwrite(data, 1, len, f) == len);
+	fclose(f);
+}
+
+// GDF version 300: "GDFW", version, device type, primary and secondary MCU sizes, data, byte sum
+static size_t makeFirmware(smuint8 *file, smuint16 deviceType) {
+	smuint16 version = 300;
+	smuint32 primary = FW_SIZE, secondary = 0xffffffff, sum = 0;
+	size_t len = 16 + FW_SIZE, i;
+
+	memcpy(file, "GDFW", 4);
+	memcpy(file + 4, &version, 2);
+	memcpy(file + 6, &deviceType, 2);
+	memcpy(file + 8, &primary, 4);
+	memcpy(file + 12, &secondary, 4);
+	memset(file + 16, 0xff, FW_SIZE);
+	for (i = 0; i < len; i++)
+		sum += file[i];
+	memcpy(file + len, &sum, 4);
+	return len + 4;
+}
+
+int main(void) {
+	static smuint8 file[16 + FW_SIZE + 4];
+	smbus handle = simOpenBus();
+	size_t len;
+	int fd = mkstemp(path);
+	assert(handle >= 0 && fd >= 0);
+	close(fd);
+	simDevice.nodes[1].params[SMP_DEVICE_TYPE] = 11000;
+	simDevice.nodes[1].params[SMP_BUS_MODE] = SMP_BUS_MODE_NORMAL;
+
+	{
+		// missing file, bad header, unsupported version and sizes past end of file fail without bus traffic
+		smuint16 version = 200;
+		smuint32 size = 0x7fffffff;
+		assert(smFirmwareUpload(handle, 1, "/nonexistent/file.gdf") == FWFileNotReadable);
+		writeFile("GDF", 3);
+		assert(smFirmwareUpload(handle, 1, path) == FWInvalidFile);
+		len = makeFirmware(file, 11000);
+		file[0] = 'X';
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == FWInvalidFile);
+		len = makeFirmware(file, 11000);
+		memcpy(file + 4, &version, 2);
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == FWIncompatibleFW);
+		len = makeFirmware(file, 11000);
+		memcpy(file + 8, &size, 4);
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == FWInvalidFile);
+		writeFile(file, 10);
+		assert(smFirmwareUpload(handle, 1, path) == FWInvalidFile);
+		assert(simDevice.framesReceived == 0);
+	}
+
+	{
+		// checksum mismatch and wrong device
+		len = makeFirmware(file, 11000);
+		file[100] ^= 1;
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == FWIncompatibleFW);
+		len = makeFirmware(file, 4000);
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == FWIncompatibleFW);
+		assert(simDevice.framesReceived > 0);
+	}
+
+	{
+		// valid file passes verify and upload starts by restarting device in DFU mode
+		len = makeFirmware(file, 11000);
+		writeFile(file, len);
+		assert(smFirmwareUpload(handle, 1, path) == 2);
+		assert(simDevice.nodes[1].params[SMP_SYSTEM_CONTROL] == 64);
+	}
+
+	unlink(path);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,171 @@
+// tests/gatewaydevice.h
+//
+// Simulated TCP/IP SimpleMotion gateway, for exercising the real TCP/IP driver
+// (drivers/tcpip/tcpclient.c) without hardware. gatewayDeviceStart listens on
+// 127.0.0.1 and runs the simulator of devicesim.h in a thread for the connected
+// client. The library connects to it with
+//
+//   smOpenBus("127.0.0.1:4001");
+//
+// Replies can be delayed and split to look like a gateway behind a real network:
+//
+//   latencyUs   delay from receiving a request to sending its reply
+//   jitterUs    random extra delay 0..jitterUs added to each reply
+//   maxChunk    if >0, replies are written in pieces of at most this many bytes
+//   chunkGapUs  delay between the pieces, so that they arrive in separate reads
+//
+// Settings may be changed while the gateway runs. Only one client is served at a
+// time, a new one may connect after the previous one has closed.
+//
+// Only available on unix. Define _GNU_SOURCE before including any headers.
+
+#ifndef GATEWAYDEVICE_H
+#define GATEWAYDEVICE_H
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "devicesim.h"
+
+typedef struct
+{
+    int listenFd, clientFd;
+    unsigned short port;
+    pthread_t thread;
+    volatile int running;
+    unsigned int seed;
+
+    // reply timing, see above
+    volatile int latencyUs, jitterUs;
+    volatile int maxChunk, chunkGapUs;
+
+    // statistics, may be reset by test
+    volatile int connections;
+    volatile int clientReads;// read calls that returned data, i.e. how many pieces host writes arrived in
+} GatewayDevice;
+
+static GatewayDevice gatewayDevice;
+
+static void gatewayDeviceSend(GatewayDevice *g, const unsigned char *buf, int n)
+{
+    int written=0;
+    while(written<n)
+    {
+        int len=n-written, w;
+        if(g->maxChunk>0 && len>g->maxChunk)
+            len=g->maxChunk;
+        if(written>0 && g->chunkGapUs>0)
+            usleep(g->chunkGapUs);
+        w=write(g->clientFd,buf+written,len);
+        if(w<=0)
+            return;
+        written+=w;
+    }
+}
+
+static void *gatewayDeviceThread(void *arg)
+{
+    GatewayDevice *g=(GatewayDevice*)arg;
+
+    while(g->running)
+    {
+        struct pollfd pfd;
+        unsigned char buf[4096];
+        int n;
+
+        pfd.fd=g->clientFd>=0 ? g->clientFd : g->listenFd;
+        pfd.events=POLLIN;
+        pfd.revents=0;
+        if(poll(&pfd,1,10)<=0)
+            continue;
+
+        if(g->clientFd<0)
+        {
+            int one=1;
+            g->clientFd=accept(g->listenFd,NULL,NULL);
+            if(g->clientFd>=0)
+            {
+                setsockopt(g->clientFd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+                g->connections++;
+            }
+            continue;
+        }
+
+        n=read(g->clientFd,buf,sizeof(buf));
+        if(n<=0)
+        {
+            // client closed, wait for next one. bytes of an incomplete frame are dropped with it
+            close(g->clientFd);
+            g->clientFd=-1;
+            simDevice.inLen=0;
+            simDevice.outHead=simDevice.outTail=0;
+            continue;
+        }
+        g->clientReads++;
+        simBusWrite(&simDevice,buf,n);
+
+        n=simBusRead(&simDevice,buf,sizeof(buf));
+        if(n<=0)
+            continue;
+        if(g->latencyUs>0 || g->jitterUs>0)
+            usleep(g->latencyUs+(g->jitterUs>0 ? rand_r(&g->seed)%(g->jitterUs+1) : 0));
+        gatewayDeviceSend(g,buf,n);
+    }
+    return NULL;
+}
+
+// start listening on 127.0.0.1:port, port 0 picks a free one. returns 0 on success and
+// sets gatewayDevice.port. settings are reset to an ideal network
+static int gatewayDeviceStart(unsigned short port)
+{
+    struct sockaddr_in addr;
+    socklen_t len=sizeof(addr);
+    int one=1;
+    smbool success;
+
+    memset(&gatewayDevice,0,sizeof(gatewayDevice));
+    gatewayDevice.clientFd=-1;
+    gatewayDevice.seed=1;
+    gatewayDevice.listenFd=socket(AF_INET,SOCK_STREAM,IPPROTO_TCP);
+    if(gatewayDevice.listenFd<0)
+        return -1;
+    setsockopt(gatewayDevice.listenFd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    addr.sin_port=htons(port);
+    if(bind(gatewayDevice.listenFd,(struct sockaddr*)&addr,sizeof(addr))!=0 ||
+       listen(gatewayDevice.listenFd,1)!=0 ||
+       getsockname(gatewayDevice.listenFd,(struct sockaddr*)&addr,&len)!=0)
+    {
+        close(gatewayDevice.listenFd);
+        return -1;
+    }
+    gatewayDevice.port=ntohs(addr.sin_port);
+
+    simBusOpen("gateway",0,&success);
+    gatewayDevice.running=1;
+    if(pthread_create(&gatewayDevice.thread,NULL,gatewayDeviceThread,&gatewayDevice)!=0)
+    {
+        close(gatewayDevice.listenFd);
+        return -1;
+    }
+    return 0;
+}
+
+static void gatewayDeviceStop(void)
+{
+    gatewayDevice.running=0;
+    pthread_join(gatewayDevice.thread,NULL);
+    if(gatewayDevice.clientFd>=0)
+        close(gatewayDevice.clientFd);
+    close(gatewayDevice.listenFd);
+}
+
+#endif // GATEWAYDEVICE_H
@@ -0,0 +1,106 @@
+// Verifies round trip latency statistics: each command type is recorded to
+// its own histogram, failed commands are not recorded and percentiles land
+// within bucket resolution of the real delay.
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include "devicesim.h"
+#include "../user_options.h"
+
+static int readDelayUs;
+
+// simulated bus where reply takes readDelayUs to arrive
+static smint32 delayedRead(smBusdevicePointer busdevicePointer, unsigned char *buf, smint32 size) {
+	if (readDelayUs > 0)
+		usleep(readDelayUs);
+	return simBusRead(busdevicePointer, buf, size);
+}
+
+static smuint32 bucketSum(const SM_LATENCY_HISTOGRAM *histogram) {
+	smuint32 sum = 0;
+	int i;
+	for (i = 0; i < SM_LATENCY_HISTOGRAM_BUCKETS; i++)
+		sum += histogram->buckets[i];
+	return sum;
+}
+
+int main(void) {
+	smbus handle = smOpenBusWithCallbacks("sim", simBusOpen, simBusClose, delayedRead, simBusWrite, simBusMiscOperation);
+	SM_BUS_STATISTICS stats;
+	smint32 value;
+	smuint16 read1, read2;
+	int i;
+	assert(handle >= 0);
+
+	assert(smGetBusStatistics(handle, &stats) == SM_OK);
+	for (i = 0; i < SMLatencyNumTypes; i++)
+		assert(stats.latency[i].count == 0);
+	assert(smGetLatencyPercentile(&stats.latency[0], 50) == 0);
+
+	{
+		// counted per command type
+		for (i = 0; i < 10; i++)
+			assert(smRead1Parameter(handle, 1, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		for (i = 0; i < 3; i++)
+			assert(smGetBufferClock(handle, 1, &read1) == SM_OK);
+		for (i = 0; i < 5; i++)
+			assert(smFastUpdateCycle(handle, 1, 0, 0, &read1, &read2) == SM_OK);
+		assert(smGetBusStatistics(handle, &stats) == SM_OK);
+		assert(stats.latency[SMLatencyInstantCmd].count == 10);
+		assert(stats.latency[SMLatencyBufferedCmd].count == 0);
+		assert(stats.latency[SMLatencyGetClock].count == 3);
+		assert(stats.latency[SMLatencyFastUpdateCycle].count == 5);
+		for (i = 0; i < SMLatencyNumTypes; i++) {
+			assert(bucketSum(&stats.latency[i]) == stats.latency[i].count);
+			assert(stats.latency[i].minUs <= stats.latency[i].maxUs);
+		}
+	}
+
+	{
+		// timeouts are not recorded
+		assert(smSetTimeout(20) == SM_OK);
+		assert(smRead1Parameter(handle, SIM_MAX_NODES + 1, SMP_TRAJ_PLANNER_VEL, &value) != SM_OK);
+		resetCumulativeStatus(handle);
+		assert(smGetBusStatistics(handle, &stats) == SM_OK);
+		assert(stats.latency[SMLatencyInstantCmd].count == 10);
+	}
+
+	{
+		// percentiles follow the delay of replies
+		assert(smResetBusStatistics(handle) == SM_OK);
+		readDelayUs = 2000;
+		for (i = 0; i < 20; i++)
+			assert(smRead1Parameter(handle, 1, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		readDelayUs = 0;
+		assert(smGetBusStatistics(handle, &stats) == SM_OK);
+		assert(stats.latency[SMLatencyInstantCmd].count == 20);
+		assert(stats.latency[SMLatencyGetClock].count == 0);
+		printf("p50 %u us, p99 %u us, max %u us\n", smGetLatencyPercentile(&stats.latency[SMLatencyInstantCmd], 50),
+		       smGetLatencyPercentile(&stats.latency[SMLatencyInstantCmd], 99), stats.latency[SMLatencyInstantCmd].maxUs);
+		assert(stats.latency[SMLatencyInstantCmd].minUs >= 2000);
+		assert(smGetLatencyPercentile(&stats.latency[SMLatencyInstantCmd], 50) >= stats.latency[SMLatencyInstantCmd].minUs);
+		assert(smGetLatencyPercentile(&stats.latency[SMLatencyInstantCmd], 100) == stats.latency[SMLatencyInstantCmd].maxUs);
+	}
+
+	{
+		// percentile of known distribution: 90 samples in bucket 5 us, 10 in bucket 960-1023 us
+		SM_LATENCY_HISTOGRAM histogram;
+		memset(&histogram, 0, sizeof(histogram));
+		histogram.count = 100;
+		histogram.minUs = 5;
+		histogram.maxUs = 1010;
+		histogram.buckets[5] = 90;
+		histogram.buckets[8 + (9 - 3) * 8 + 7] = 10;
+		assert(smGetLatencyPercentile(&histogram, 50) == 5);
+		assert(smGetLatencyPercentile(&histogram, 90) == 5);
+		assert(smGetLatencyPercentile(&histogram, 90.5) == 1010);
+		assert(smGetLatencyPercentile(&histogram, 99.9) == 1010);
+		histogram.maxUs = 2000;
+		assert(smGetLatencyPercentile(&histogram, 99.9) == 1023);
+	}
+
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Verifies smParamCache: redundant writes are suppressed, repeated writes are
+// coalesced into one batch at flush, and known values are dropped after device
+// restart or bus purge.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../paramcache.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	ParamCache cache;
+	smint32 value, written;
+	int i;
+	assert(handle >= 0);
+
+	simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] = 1000;
+	assert(smParamCacheInit(&cache, handle, 2) == SM_OK);
+
+	{
+		// read goes to device once
+		simDevice.framesReceived = 0;
+		assert(smParamCacheGet(&cache, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(value == 1000);
+		assert(smParamCacheGet(&cache, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(value == 1000);
+		assert(simDevice.framesReceived == 1);
+
+		// writing known value sends nothing
+		assert(smParamCacheSet(&cache, SMP_TRAJ_PLANNER_VEL, 1000) == SM_OK);
+		assert(smParamCacheFlush(&cache, &written) == SM_OK);
+		assert(written == 0);
+		assert(simDevice.framesReceived == 1);
+	}
+
+	{
+		// several writes per parameter become one batch with last values
+		simDevice.framesReceived = 0;
+		for (i = 0; i < 5; i++) {
+			assert(smParamCacheSet(&cache, SMP_TRAJ_PLANNER_VEL, 2000 + i) == SM_OK);
+			assert(smParamCacheSet(&cache, SMP_TRAJ_PLANNER_ACCEL, 300 + i) == SM_OK);
+		}
+		assert(simDevice.framesReceived == 0);
+		assert(smParamCacheGet(&cache, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 304);
+		assert(smParamCacheFlush(&cache, &written) == SM_OK);
+		assert(written == 2);
+		assert(simDevice.framesReceived == 1);
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] == 2004);
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_ACCEL] == 304);
+		assert(smParamCacheFlush(&cache, &written) == SM_OK);
+		assert(written == 0);
+	}
+
+	{
+		// rejected write is dropped from cache
+		simDevice.nodes[2].readOnly[SMP_FAULTS] = 1;
+		simDevice.nodes[2].params[SMP_FAULTS] = 7;
+		assert(smParamCacheSet(&cache, SMP_FAULTS, 0) == SM_OK);
+		assert(smParamCacheFlush(&cache, &written) == SM_ERR_PARAMETER);
+		assert(written == 1);
+		resetCumulativeStatus(handle);
+		assert(smParamCacheGet(&cache, SMP_FAULTS, &value) == SM_OK);
+		assert(value == 7);
+	}
+
+	{
+		// device restart invalidates known values but keeps pending writes
+		assert(smParamCacheSet(&cache, SMP_TRAJ_PLANNER_ACCEL, 555) == SM_OK);
+		assert(smSetParameter(handle, 2, SMP_SYSTEM_CONTROL, SMP_SYSTEM_CONTROL_RESTART) == SM_OK);
+		simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] = 1000;
+		simDevice.framesReceived = 0;
+		assert(smParamCacheSet(&cache, SMP_TRAJ_PLANNER_VEL, 2004) == SM_OK);
+		assert(smParamCacheFlush(&cache, &written) == SM_OK);
+		assert(written == 2);
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] == 2004);
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_ACCEL] == 555);
+
+		// and so does purge
+		simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] = 1;
+		assert(smPurge(handle) == SM_OK);
+		assert(smParamCacheGet(&cache, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(value == 1);
+	}
+
+	{
+		// cache full of pending writes flushes itself
+		simDevice.framesReceived = 0;
+		for (i = 0; i < SM_PARAM_CACHE_SIZE + 10; i++)
+			assert(smParamCacheSet(&cache, 3000 + i, i) == SM_OK);
+		assert(simDevice.framesReceived > 0);
+		assert(smParamCacheFlush(&cache, NULL) == SM_OK);
+		for (i = 0; i < SM_PARAM_CACHE_SIZE + 10; i++)
+			assert(simDevice.nodes[2].params[3000 + i] == i);
+	}
+
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,87 @@
+// Verifies pipelined transactions: packets to several nodes are sent in one driver
+// write and replies end up in the slot of the node that sent them.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smaddr node;
+	smint32 value;
+	assert(handle >= 0);
+
+	for (node = 1; node <= 16; node++) {
+		simDevice.nodes[node].params[SMP_STATUS] = 100 + node;
+		simDevice.nodes[node].params[SMP_FAULTS] = -(smint32)node;
+	}
+
+	{
+		// status sweep of 16 nodes in one write
+		simDevice.writeCalls = 0;
+		for (node = 1; node <= 16; node++) {
+			assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+			assert(smAppendGetParamCommandToQueue(handle, SMP_FAULTS) == SM_OK);
+			assert(smAppendCommandQueueToPipeline(handle, node) == SM_OK);
+		}
+		assert(smExecutePipeline(handle) == SM_OK);
+		assert(simDevice.writeCalls == 1);
+
+		// select in different order than sent
+		for (node = 16; node >= 1; node--) {
+			assert(smSelectPipelinedReturnValues(handle, node) == SM_OK);
+			assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+			assert(value == 100 + node);
+			assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+			assert(value == -(smint32)node);
+			assert(smGetQueuedSMCommandReturnValue(handle, &value) == SM_ERR_LENGTH);
+		}
+		assert(smSelectPipelinedReturnValues(handle, 17) == SM_ERR_PARAMETER);
+	}
+
+	{
+		// packets of all nodes don't fit in transmit buffer at once
+		int i;
+		resetCumulativeStatus(handle);
+		simDevice.writeCalls = 0;
+		for (node = 1; node <= 16; node++) {
+			for (i = 0; i < 12; i++)
+				assert(smAppendSetParamCommandToQueue(handle, SMP_TRAJ_PLANNER_ACCEL, node * 1000 + i) == SM_OK);
+			assert(smAppendCommandQueueToPipeline(handle, node) == SM_OK);
+		}
+		assert(smExecutePipeline(handle) == SM_OK);
+		assert(simDevice.writeCalls > 1);
+		assert(getCumulativeStatus(handle) == SM_OK);
+		for (node = 1; node <= 16; node++) {
+			assert(simDevice.nodes[node].params[SMP_TRAJ_PLANNER_ACCEL] == node * 1000 + 11);
+			assert(smSelectPipelinedReturnValues(handle, node) == SM_OK);
+			for (i = 0; i < 12; i++)
+				assert(smGetQueuedSetParamReturnValue(handle, &value) == SM_OK);
+		}
+	}
+
+	{
+		// duplicate address and missing node
+		assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+		assert(smAppendCommandQueueToPipeline(handle, 1) == SM_OK);
+		assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+		assert(smAppendCommandQueueToPipeline(handle, 1) == SM_ERR_PARAMETER);
+		assert(smAppendCommandQueueToPipeline(handle, 2) == SM_OK); // rejected queue is kept
+		assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+		assert(smAppendCommandQueueToPipeline(handle, SIM_MAX_NODES + 1) == SM_OK);
+		assert(smExecutePipeline(handle) == SM_ERR_COMMUNICATION);
+		assert(smSelectPipelinedReturnValues(handle, 2) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+		assert(value == 102);
+		assert(smSelectPipelinedReturnValues(handle, SIM_MAX_NODES + 1) == SM_ERR_COMMUNICATION);
+		resetCumulativeStatus(handle);
+	}
+
+	{
+		// normal transactions still work after pipelining
+		assert(smRead1Parameter(handle, 3, SMP_STATUS, &value) == SM_OK);
+		assert(value == 103);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,117 @@
+// tests/ptydevice.h
+//
+// Simulated device behind a pseudo-terminal, for exercising the real serial port
+// driver (drivers/serial/pcserialport.c) without hardware. ptyDeviceStart creates a
+// pty pair and runs the simulator of devicesim.h in a thread on the master side. The
+// slave side is an ordinary tty that the library opens with
+//
+//   smOpenBus(ptyDevice.slavePath);
+//
+// so reads and writes go through termios (VMIN/VTIME), purge and timeouts like with
+// a USB serial adapter. Bytes are passed in the chunks they arrive from the kernel.
+//
+// Only available on Linux. Define _GNU_SOURCE before including any headers.
+
+#ifndef PTYDEVICE_H
+#define PTYDEVICE_H
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <termios.h>
+#include "devicesim.h"
+
+typedef struct
+{
+    int master;
+    char slavePath[64];
+    pthread_t thread;
+    volatile int running;
+
+    // statistics, may be reset by test
+    volatile int masterReads;// read calls that returned data, i.e. how many pieces host writes arrived in
+} PtyDevice;
+
+static PtyDevice ptyDevice;
+
+static void *ptyDeviceThread(void *arg)
+{
+    PtyDevice *p=(PtyDevice*)arg;
+
+    while(p->running)
+    {
+        struct pollfd pfd;
+        unsigned char buf[4096];
+        int n;
+
+        pfd.fd=p->master;
+        pfd.events=POLLIN;
+        pfd.revents=0;
+        if(poll(&pfd,1,10)>0 && (pfd.revents&POLLIN))
+        {
+            n=read(p->master,buf,sizeof(buf));
+            if(n>0)
+            {
+                p->masterReads++;
+                simBusWrite(&simDevice,buf,n);
+            }
+        }
+
+        //also replies that were held back (simDevice.holdReplies) are sent when released
+        while((n=simBusRead(&simDevice,buf,sizeof(buf)))>0)
+        {
+            int written=0;
+            while(written<n)
+            {
+                int w=write(p->master,buf+written,n-written);
+                if(w<=0)
+                    break;
+                written+=w;
+            }
+        }
+    }
+    return NULL;
+}
+
+// create pty pair and start simulated device, returns 0 on success
+static int ptyDeviceStart(void)
+{
+    struct termios settings;
+    smbool success;
+
+    ptyDevice.master=posix_openpt(O_RDWR|O_NOCTTY);
+    if(ptyDevice.master<0)
+        return -1;
+    if(grantpt(ptyDevice.master)!=0 || unlockpt(ptyDevice.master)!=0 ||
+       ptsname_r(ptyDevice.master,ptyDevice.slavePath,sizeof(ptyDevice.slavePath))!=0)
+    {
+        close(ptyDevice.master);
+        return -1;
+    }
+
+    // raw mode on master side too, so that no byte gets translated
+    tcgetattr(ptyDevice.master,&settings);
+    cfmakeraw(&settings);
+    tcsetattr(ptyDevice.master,TCSANOW,&settings);
+
+    simBusOpen("pty",0,&success);
+    ptyDevice.masterReads=0;
+    ptyDevice.running=1;
+    if(pthread_create(&ptyDevice.thread,NULL,ptyDeviceThread,&ptyDevice)!=0)
+    {
+        close(ptyDevice.master);
+        return -1;
+    }
+    return 0;
+}
+
+static void ptyDeviceStop(void)
+{
+    ptyDevice.running=0;
+    pthread_join(ptyDevice.thread,NULL);
+    close(ptyDevice.master);
+}
+
+#endif // PTYDEVICE_H
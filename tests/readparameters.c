@@ -0,0 +1,79 @@
+// Verifies smReadParameters: values end up in caller order, return width is set
+// only when it changes and long lists are split to several packets.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+
+#define NUM_PARAMS 40
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smint16 ids[NUM_PARAMS];
+	smint32 vals[NUM_PARAMS];
+	smuint8 widths[NUM_PARAMS];
+	int i;
+	assert(handle >= 0);
+
+	for (i = 0; i < NUM_PARAMS; i++) {
+		ids[i] = 1000 + i;
+		simDevice.nodes[3].params[1000 + i] = (i & 1) ? -i * 100 : i * 100;
+	}
+
+	{
+		// 12 values fit in one packet
+		simDevice.framesReceived = 0;
+		assert(smReadParameters(handle, 3, ids, vals, 12) == SM_OK);
+		assert(simDevice.framesReceived == 1);
+		for (i = 0; i < 12; i++)
+			assert(vals[i] == simDevice.nodes[3].params[ids[i]]);
+	}
+
+	{
+		// long list is split
+		simDevice.framesReceived = 0;
+		assert(smReadParameters(handle, 3, ids, vals, NUM_PARAMS) == SM_OK);
+		assert(simDevice.framesReceived == 2);
+		for (i = 0; i < NUM_PARAMS; i++)
+			assert(vals[i] == simDevice.nodes[3].params[ids[i]]);
+	}
+
+	{
+		// mixed widths keep caller order, and narrow widths pack more values per packet
+		for (i = 0; i < NUM_PARAMS; i++)
+			widths[i] = (i % 3 == 0) ? SM_RETURN_VALUE_24B : SM_RETURN_VALUE_16B;
+		simDevice.nodes[3].params[1000] = -2000000;
+		simDevice.framesReceived = 0;
+		assert(smReadParameters(handle, 3, ids, vals, 30) == SM_OK);
+		assert(simDevice.framesReceived == 2);
+		simDevice.framesReceived = 0;
+		assert(smReadParametersWithWidths(handle, 3, ids, widths, vals, 30) == SM_OK);
+		assert(simDevice.framesReceived == 1);
+		for (i = 0; i < 30; i++)
+			assert(vals[i] == simDevice.nodes[3].params[ids[i]]);
+
+		widths[5] = SM_RETURN_STATUS;
+		assert(smReadParametersWithWidths(handle, 3, ids, widths, vals, NUM_PARAMS) == SM_ERR_PARAMETER);
+		resetCumulativeStatus(handle);
+	}
+
+	{
+		// fixed size variants use same path
+		smint32 a, b, c;
+		simDevice.framesReceived = 0;
+		assert(smRead3Parameters(handle, 3, ids[1], &a, ids[2], &b, ids[3], &c) == SM_OK);
+		assert(simDevice.framesReceived == 1);
+		assert(a == -100 && b == 200 && c == -300);
+		assert(smRead1Parameter(handle, 3, ids[4], &a) == SM_OK);
+		assert(a == 400);
+	}
+
+	{
+		// missing node and empty list
+		assert(smReadParameters(handle, SIM_MAX_NODES + 1, ids, vals, 3) != SM_OK);
+		resetCumulativeStatus(handle);
+		assert(smReadParameters(handle, 3, ids, vals, 0) == SM_OK);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,75 @@
+// Verifies cyclic scheduler: callback runs at given period, statistics are
+// collected and overruns skip cycles instead of running them late.
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include "../cyclicscheduler.h"
+
+static volatile int calls;
+static volatile int sleepUs;
+static int context;
+
+static SM_STATUS tick(void *userdata) {
+	assert(userdata == &context);
+	calls++;
+	if (sleepUs > 0)
+		usleep(sleepUs);
+	return (calls % 10 == 0) ? SM_ERR_COMMUNICATION : SM_OK;
+}
+
+static smuint32 histogramSum(volatile smuint32 *histogram) {
+	smuint32 sum = 0;
+	int i;
+	for (i = 0; i < SM_CYCLIC_HISTOGRAM_BINS; i++)
+		sum += histogram[i];
+	return sum;
+}
+
+int main(void) {
+	CyclicScheduler scheduler;
+
+	smCyclicSchedulerInit(&scheduler, 1000, tick, &context);
+	assert(scheduler.replyDeadlineUs == 500 && scheduler.cpu == -1 && scheduler.priority == 0);
+	assert(smCyclicSchedulerStop(&scheduler) == SM_ERR_PARAMETER);
+
+	{
+		// 1 kHz for 100 ms
+		assert(smCyclicSchedulerStart(&scheduler) == SM_OK);
+		assert(smCyclicSchedulerStart(&scheduler) == SM_ERR_PARAMETER);
+		usleep(100000);
+		assert(smCyclicSchedulerStop(&scheduler) == SM_OK);
+		printf("cycles %u, max wake up latency %u us, max callback %u us, overruns %u\n",
+		       scheduler.cycles, scheduler.maxWakeupLatencyUs, scheduler.maxCallbackUs, scheduler.overruns);
+		assert(scheduler.cycles == (smuint32)calls);
+		assert(calls > 20 && calls <= 101);
+		assert(scheduler.failedCycles == (smuint32)calls / 10);
+		assert(histogramSum(scheduler.wakeupLatencyHistogram) == scheduler.cycles);
+		assert(histogramSum(scheduler.callbackHistogram) == scheduler.cycles);
+	}
+
+	{
+		// callback takes 2.5 periods, so each one overruns and skips the missed cycles
+		smCyclicSchedulerResetStatistics(&scheduler);
+		calls = 0;
+		sleepUs = 2500;
+		assert(smCyclicSchedulerStart(&scheduler) == SM_OK);
+		usleep(60000);
+		assert(smCyclicSchedulerStop(&scheduler) == SM_OK);
+		assert(calls > 3 && calls <= 21);
+		assert(scheduler.overruns == scheduler.cycles);
+		assert(scheduler.lateReplies == scheduler.cycles);
+		assert(scheduler.callbackHistogram[SM_CYCLIC_HISTOGRAM_BINS - 1] == scheduler.cycles);
+	}
+
+	{
+		// invalid settings
+		scheduler.periodUs = 0;
+		assert(smCyclicSchedulerStart(&scheduler) == SM_ERR_PARAMETER);
+		scheduler.periodUs = 1000;
+		scheduler.cpu = 100000;
+		assert(smCyclicSchedulerStart(&scheduler) == SM_ERR_PARAMETER);
+	}
+
+	return 0;
+}
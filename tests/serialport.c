@@ -0,0 +1,78 @@
+// Verifies the built-in serial port driver end to end against a simulated
+// device behind a pseudo-terminal: normal reads and writes, replies split in
+// pieces by the tty layer, timeout of a missing node and purge.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include "ptydevice.h"
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+	smbus handle;
+	smint32 value;
+	smuint16 read1, read2;
+	double start;
+	int i;
+
+	if (ptyDeviceStart() != 0) {
+		printf("no pseudo-terminals available, skipped\n");
+		return 0;
+	}
+	assert(smSetTimeout(100) == SM_OK);// VTIME is set from this at open
+	handle = smOpenBus(ptyDevice.slavePath);
+	assert(handle >= 0);
+	assert(smOpenBus("/dev/pts") < 0);
+
+	{
+		// parameters
+		for (i = 0; i < 100; i++) {
+			assert(smSetParameter(handle, 2, SMP_TRAJ_PLANNER_VEL, i * 1000) == SM_OK);
+			assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+			assert(value == i * 1000);
+		}
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] == 99000);
+	}
+
+	{
+		// fast update cycle reply has no length field, so it must be read fully even if it arrives in pieces.
+		// simulator echoes write data with node address added to last byte
+		for (i = 0; i < 100; i++) {
+			assert(smFastUpdateCycle(handle, 3, i, 0x100, &read1, &read2) == SM_OK);
+			assert(read1 == i && read2 == 0x100 + (3 << 8));
+		}
+	}
+
+	{
+		// missing node timeouts after VTIME and bus works after that
+		start = now();
+		assert(smRead1Parameter(handle, SIM_MAX_NODES + 1, SMP_TRAJ_PLANNER_VEL, &value) & SM_ERR_COMMUNICATION);
+		assert(now() - start >= 0.09 && now() - start < 2.0);
+		resetCumulativeStatus(handle);
+		assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+	}
+
+	{
+		// reply arriving after timeout is discarded by purge
+		simDevice.holdReplies = 1;
+		assert(smSetParameter(handle, 2, SMP_TRAJ_PLANNER_VEL, 5) & SM_ERR_COMMUNICATION);
+		simDevice.holdReplies = 0;
+		usleep(50000);
+		assert(smPurge(handle) == SM_OK);
+		resetCumulativeStatus(handle);
+		simDevice.nodes[2].params[SMP_TRAJ_PLANNER_ACCEL] = 77;
+		assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 77);
+	}
+
+	printf("host writes arrived in %d pieces\n", ptyDevice.masterReads);
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	ptyDeviceStop();
+	return 0;
+}
@@ -0,0 +1,112 @@
+// Verifies the built-in TCP/IP driver end to end against a simulated gateway:
+// normal reads and writes, replies split in pieces, network latency, timeout
+// of a missing node, late reply discarded by purge and reconnecting.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include "gatewaydevice.h"
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static smbus openGateway(void) {
+	char name[32];
+	snprintf(name, sizeof(name), "127.0.0.1:%d", gatewayDevice.port);
+	return smOpenBus(name);
+}
+
+int main(void) {
+	smbus handle;
+	smint32 value;
+	smuint16 read1, read2;
+	double start;
+	int i;
+
+	if (gatewayDeviceStart(0) != 0) {
+		printf("no loopback networking available, skipped\n");
+		return 0;
+	}
+	simDevice.numNodes = 4;
+	assert(smSetTimeout(100) == SM_OK);
+	handle = openGateway();
+	assert(handle >= 0);
+
+	{
+		// parameters
+		for (i = 0; i < 50; i++) {
+			assert(smSetParameter(handle, 2, SMP_TRAJ_PLANNER_VEL, i * 1000) == SM_OK);
+			assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+			assert(value == i * 1000);
+		}
+		assert(simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] == 49000);
+	}
+
+	{
+		// replies arriving one byte at a time
+		gatewayDevice.maxChunk = 1;
+		gatewayDevice.chunkGapUs = 200;
+		for (i = 0; i < 20; i++) {
+			assert(smFastUpdateCycle(handle, 3, i, 0x100, &read1, &read2) == SM_OK);
+			assert(read1 == i && read2 == 0x100 + (3 << 8));
+			assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+			assert(value == 49000);
+		}
+		gatewayDevice.maxChunk = 0;
+		gatewayDevice.chunkGapUs = 0;
+	}
+
+	{
+		// latency and jitter below timeout only slow things down
+		gatewayDevice.latencyUs = 20000;
+		gatewayDevice.jitterUs = 10000;
+		start = now();
+		for (i = 0; i < 5; i++)
+			assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(now() - start >= 5 * 0.02);
+		gatewayDevice.latencyUs = 0;
+		gatewayDevice.jitterUs = 0;
+	}
+
+	{
+		// node that does not exist timeouts and bus works after that
+		start = now();
+		assert(smRead1Parameter(handle, 5, SMP_TRAJ_PLANNER_VEL, &value) & SM_ERR_COMMUNICATION);
+		assert(now() - start >= 0.09 && now() - start < 2.0);
+		resetCumulativeStatus(handle);
+		assert(smRead1Parameter(handle, 4, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+	}
+
+	{
+		// reply arriving after timeout is discarded by purge
+		gatewayDevice.latencyUs = 150000;
+		assert(smSetParameter(handle, 2, SMP_TRAJ_PLANNER_VEL, 5) & SM_ERR_COMMUNICATION);
+		gatewayDevice.latencyUs = 0;
+		usleep(100000);
+		assert(smPurge(handle) == SM_OK);
+		resetCumulativeStatus(handle);
+		simDevice.nodes[2].params[SMP_TRAJ_PLANNER_ACCEL] = 77;
+		assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 77);
+	}
+
+	{
+		// reconnect
+		assert(getCumulativeStatus(handle) == SM_OK);
+		assert(smCloseBus(handle) == SM_OK);
+		handle = openGateway();
+		assert(handle >= 0);
+		assert(smRead1Parameter(handle, 2, SMP_TRAJ_PLANNER_ACCEL, &value) == SM_OK);
+		assert(value == 77);
+		assert(gatewayDevice.connections == 2);
+	}
+
+	printf("host writes arrived in %d pieces\n", gatewayDevice.clientReads);
+	assert(getCumulativeStatus(handle) == SM_OK);
+	assert(smCloseBus(handle) == SM_OK);
+	gatewayDeviceStop();
+	return 0;
+}
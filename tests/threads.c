@@ -0,0 +1,83 @@
+// Verifies that one bus can be shared by several threads when library is compiled
+// with ENABLE_BUS_LOCKING: single call functions and transactions lock the bus
+// internally and command queue sequences are protected with smLockBus. Bus is
+// closed only once when several threads close it at the same time.
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "devicesim.h"
+
+#define NUM_THREADS 4
+#define NUM_ROUNDS 200
+
+static smbus handle;
+
+static void *worker(void *arg) {
+	smaddr node = (smaddr)(size_t)arg;
+	smtransaction t = smAllocateTransaction(handle);
+	smint32 value;
+	int i;
+
+	assert(t >= 0);
+	for (i = 0; i < NUM_ROUNDS; i++) {
+		assert(smSetParameter(handle, node, SMP_TRAJ_PLANNER_VEL, node * 10000 + i) == SM_OK);
+		assert(smRead1Parameter(handle, node, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		assert(value == node * 10000 + i);
+
+		assert(smAppendGetParamCommandToTransaction(t, SMP_STATUS) == SM_OK);
+		assert(smExecuteTransaction(t, node) == SM_OK);
+		assert(smGetTransactionGetParamReturnValue(t, &value) == SM_OK);
+		assert(value == node);
+
+		assert(smLockBus(handle) == SM_OK);
+		assert(smAppendGetParamCommandToQueue(handle, SMP_STATUS) == SM_OK);
+		assert(smExecuteCommandQueue(handle, node) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+		assert(value == node);
+		assert(smUnlockBus(handle) == SM_OK);
+	}
+	assert(smFreeTransaction(t) == SM_OK);
+	return NULL;
+}
+
+static void *closer(void *arg) {
+	*(SM_STATUS *)arg = smCloseBus(handle);
+	return NULL;
+}
+
+int main(void) {
+	pthread_t threads[NUM_THREADS];
+	size_t i;
+
+	handle = simOpenBus();
+	assert(handle >= 0);
+
+	for (i = 0; i < NUM_THREADS; i++) {
+		simDevice.nodes[i + 1].params[SMP_STATUS] = i + 1;
+		assert(pthread_create(&threads[i], NULL, worker, (void *)(i + 1)) == 0);
+	}
+	for (i = 0; i < NUM_THREADS; i++)
+		assert(pthread_join(threads[i], NULL) == 0);
+
+	assert(getCumulativeStatus(handle) == SM_OK);
+
+	{
+		// closers pass the open check and then wait for the bus lock held here
+		SM_STATUS stat[NUM_THREADS];
+		int closed = 0;
+		assert(smLockBus(handle) == SM_OK);
+		for (i = 0; i < NUM_THREADS; i++)
+			assert(pthread_create(&threads[i], NULL, closer, &stat[i]) == 0);
+		usleep(50000);
+		assert(smUnlockBus(handle) == SM_OK);
+		for (i = 0; i < NUM_THREADS; i++) {
+			assert(pthread_join(threads[i], NULL) == 0);
+			assert(stat[i] == SM_OK || stat[i] == SM_ERR_NODEVICE);
+			closed += stat[i] == SM_OK;
+		}
+		assert(closed == 1);
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+// Verifies binary event trace: packets and return values are recorded in
+// order, overflowing ring keeps newest events and counts lost ones, and
+// events format to readable text.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../eventtrace.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	SM_TRACE_EVENT events[SM_TRACE_EVENTS];
+	smuint32 lost;
+	smint32 value, n;
+	char text[128];
+	int i, found;
+	assert(handle >= 0);
+
+	// opening the bus is not traced
+	assert(smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost) == 0);
+	assert(lost == 0);
+
+	{
+		// one parameter read
+		simDevice.nodes[3].params[SMP_TRAJ_PLANNER_VEL] = 4321;
+		assert(smRead1Parameter(handle, 3, SMP_TRAJ_PLANNER_VEL, &value) == SM_OK);
+		n = smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost);
+		assert(n >= 4 && lost == 0);
+		assert(events[0].type == SMTraceFrameOut && events[0].address == 3 && events[0].bus == handle);
+		assert(events[1].type == SMTraceTransmit && events[1].args[0] == 1);
+		assert(events[2].type == SMTraceFrameIn);
+		found = 0;
+		for (i = 3; i < n; i++) {
+			assert(events[i].type == SMTraceReturnValue);
+			if (events[i].args[1] == 4321)
+				found = 1;
+		}
+		assert(found);
+		for (i = 1; i < n; i++)
+			assert((smint32)(events[i].timestampUs - events[i - 1].timestampUs) >= 0);
+
+		smFormatTraceEvent(&events[0], text, sizeof(text));
+		printf("%s\n", text);
+		assert(strstr(text, "> SMCMD_INSTANT_CMD (addr=3, payload=") != NULL);
+
+		// all read
+		assert(smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost) == 0);
+	}
+
+	{
+		// errors are recorded
+		assert(smSetTimeout(20) == SM_OK);
+		assert(smRead1Parameter(handle, SIM_MAX_NODES + 1, SMP_TRAJ_PLANNER_VEL, &value) != SM_OK);
+		resetCumulativeStatus(handle);
+		n = smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost);
+		found = 0;
+		for (i = 0; i < n; i++)
+			if (events[i].type == SMTraceReceiveError)
+				found |= 1;
+			else if (events[i].type == SMTraceStatus && (events[i].args[0] & SM_ERR_COMMUNICATION))
+				found |= 2;
+		assert(found == 3);
+	}
+
+	{
+		// overflow keeps newest events, reading in small pieces continues where previous ended
+		for (i = 0; i < SM_TRACE_EVENTS; i++)
+			assert(smSetParameter(handle, 1, SMP_TRAJ_PLANNER_ACCEL, i) == SM_OK);
+		n = smReadTraceEvents(handle, events, 10, &lost);
+		assert(n == 10 && lost > 0);
+		n = smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost);
+		assert(n == SM_TRACE_EVENTS - 10 && lost == 0);
+		assert(events[n - 1].type == SMTraceReturnValue);
+	}
+
+	{
+		// disabled
+		smSetTraceEnabled(smfalse);
+		assert(smSetParameter(handle, 1, SMP_TRAJ_PLANNER_ACCEL, 1) == SM_OK);
+		assert(smReadTraceEvents(handle, events, SM_TRACE_EVENTS, &lost) == 0);
+		smSetTraceEnabled(smtrue);
+	}
+
+	{
+		// formatting
+		SM_TRACE_EVENT event;
+		memset(&event, 0, sizeof(event));
+		event.timestampUs = 1000;
+		event.type = SMTraceFrameIn;
+		event.address = 2;
+		event.args[0] = SMCMD_FAST_UPDATE_CYCLE_RET;
+		event.args[1] = 5 | (7 << 16);
+		assert(smFormatTraceEvent(&event, text, sizeof(text)) == (smint32)strlen(text));
+		assert(strcmp(text, "1000 us bus 0: < SMCMD_FAST_UPDATE_CYCLE_RET (addr=2, r1=5, r2=7)") == 0);
+		event.type = SMTraceStatus;
+		event.args[0] = SM_ERR_BUS;
+		smFormatTraceEvent(&event, text, sizeof(text));
+		assert(strcmp(text, "1000 us bus 0: status error 4") == 0);
+		// truncated like snprintf
+		assert(smFormatTraceEvent(&event, text, 8) > 8 && strlen(text) == 7);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
@@ -0,0 +1,150 @@
+// Verifies trajectory generator: jerk limited moves end exactly at target and
+// respect limits, PVT points are passed through, queue limits are kept and a
+// long path streams to a simulated device with constant memory.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../trajectory.h"
+
+#define RATE 1000
+#define NODE 6
+
+static smint32 points[20000];
+
+// generate all points of queued segments
+static int generateAll(TrajectoryGenerator *traj) {
+	int n = 0, got;
+	while ((got = smTrajectoryGenerate(traj, 100, points + n)) > 0)
+		n += got;
+	assert(n < 20000 - 100);
+	return n;
+}
+
+// check velocity, acceleration and end of a sampled move. rounding of samples to integers adds up to
+// 1 count of error to differences, which is allowed in limits
+static void checkMove(int n, smint32 start, smint32 target, double maxVelocity, double maxAcceleration) {
+	int i;
+	assert(points[0] == start);
+	assert(points[n - 1] == target);
+	for (i = 1; i < n; i++) {
+		double v = (double)(points[i] - points[i - 1]) * RATE;
+		assert(fabs(v) <= maxVelocity + RATE);
+		assert(target > start ? points[i] >= points[i - 1] : points[i] <= points[i - 1]);
+		if (i >= 2) {
+			double a = (double)(points[i] - 2 * points[i - 1] + points[i - 2]) * RATE * RATE;
+			assert(fabs(a) <= maxAcceleration * 1.01 + 2.0 * RATE * RATE);
+		}
+	}
+}
+
+int main(void) {
+	TrajectoryGenerator traj, reference;
+	int n, i;
+
+	assert(smTrajectoryInit(&traj, 0, 0) == SM_ERR_PARAMETER);
+	assert(smTrajectoryInit(&traj, 2501, 0) == SM_ERR_PARAMETER);
+	assert(smTrajectoryInit(&traj, RATE, 0) == SM_OK);
+	assert(smTrajectoryGenerate(&traj, 100, points) == 0);
+
+	{
+		// long move reaches max velocity: 0.35 s acceleration, 1.65 s constant velocity and 0.35 s deceleration
+		assert(smTrajectoryAppendMove(&traj, 100000, 50000, 200000, 2000000) == SM_OK);
+		assert(smTrajectoryGetFreePieces(&traj) == SM_TRAJECTORY_MAX_PIECES - 7);
+		n = generateAll(&traj);
+		assert(n >= 2350 && n <= 2352);
+		checkMove(n, 0, 100000, 50000, 200000);
+		assert(points[n / 2] - points[n / 2 - 1] == 50);
+
+		// short moves, one that doesn't reach velocity and one that doesn't reach acceleration either
+		assert(smTrajectoryAppendMove(&traj, 90000, 50000, 200000, 2000000) == SM_OK);
+		n = generateAll(&traj);
+		checkMove(n, 100000, 90000, 50000, 200000);
+		assert(smTrajectoryAppendMove(&traj, 89990, 50000, 200000, 2000000) == SM_OK);
+		assert(smTrajectoryGetFreePieces(&traj) == SM_TRAJECTORY_MAX_PIECES - 4);
+		n = generateAll(&traj);
+		checkMove(n, 90000, 89990, 50000, 200000);
+		assert(smTrajectoryGenerate(&traj, 100, points) == 0);
+	}
+
+	{
+		// PVT points are hit at their times, samples at 0.1 s intervals land on them when sampling starts from 0
+		static const double pos[4] = {1000, 3000, 2500, 0}, vel[4] = {20000, 0, -10000, 0};
+		assert(smTrajectoryInit(&traj, RATE, 0) == SM_OK);
+		for (i = 0; i < 4; i++)
+			assert(smTrajectoryAppendPVT(&traj, pos[i], vel[i], 0.1) == SM_OK);
+		n = generateAll(&traj);
+		assert(n == 401);
+		assert(points[0] == 0);
+		for (i = 0; i < 4; i++)
+			assert(points[(i + 1) * 100] == pos[i]);
+		// velocity is continuous at points
+		assert(abs((points[101] - points[99]) * RATE / 2 - 20000) <= RATE);
+		assert(abs(points[201] - points[199]) <= 1 + 1);
+	}
+
+	{
+		// invalid segments
+		assert(smTrajectoryAppendMove(&traj, 1000, 0, 1, 1) == SM_ERR_PARAMETER);
+		assert(smTrajectoryAppendPVT(&traj, 1000, 0, 0) == SM_ERR_PARAMETER);
+		assert(smTrajectoryAppendPVT(&traj, 1000, 5000, 0.1) == SM_OK);
+		assert(smTrajectoryAppendMove(&traj, 0, 1000, 1000, 1000) == SM_ERR_PARAMETER);
+		assert(smTrajectoryAppendDwell(&traj, 1) == SM_ERR_PARAMETER);
+		assert(smTrajectoryAppendPVT(&traj, 1500, 0, 0.1) == SM_OK);
+		generateAll(&traj);
+
+		// full queue is not modified
+		while (smTrajectoryAppendMove(&traj, traj.endPosition + 1000000, 50000, 200000, 2000000) == SM_OK)
+			;
+		n = smTrajectoryGetFreePieces(&traj);
+		assert(n < 7);
+		assert(smTrajectoryAppendMove(&traj, 0, 50000, 200000, 2000000) == SM_ERR_LENGTH);
+		assert(smTrajectoryGetFreePieces(&traj) == n);
+		while (n-- > 0)
+			assert(smTrajectoryAppendDwell(&traj, 0.01) == SM_OK);
+		assert(smTrajectoryAppendDwell(&traj, 0.01) == SM_ERR_LENGTH);
+	}
+
+	{
+		// stream a path that is much longer than the queue to device, appending moves lazily before each fill.
+		// device setpoint follows the same points as generated separately
+		smbus handle = simOpenBus();
+		BufferedMotionAxis axis;
+		smint32 received[SM_BUFFERED_MAX_RETURN_POINTS], numReceived, numFilled, freeBytes, expected[100];
+		int moves = 0, reference_moves = 0, checked = 0;
+		assert(handle >= 0);
+		assert(smBufferedInit(&axis, handle, NODE, RATE, SMP_ABSOLUTE_SETPOINT, SM_RETURN_VALUE_32B) == SM_OK);
+		axis.incrementalSetpoints = smtrue;
+		simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] = 0;
+		assert(smTrajectoryInit(&traj, axis.samplerate, 0) == SM_OK);
+		assert(smTrajectoryInit(&reference, axis.samplerate, 0) == SM_OK);
+		// nothing is filled and generated points are kept if free space is negative
+		assert(smTrajectoryAppendMove(&traj, 20000, 100000, 1000000, 20000000) == SM_OK);
+		moves++;
+		assert(smTrajectoryFillAndReceive(&traj, &axis, -10, &numFilled, &numReceived, received) == SM_OK);
+		assert(numFilled == 0 && traj.lookaheadLen == SM_TRAJECTORY_LOOKAHEAD);
+		for (;;) {
+			while (moves < 50 && smTrajectoryAppendMove(&traj, moves % 2 ? 0 : 20000, 100000, 1000000, 20000000) == SM_OK)
+				moves++;
+			assert(smBufferedGetFreeEstimate(&axis, &freeBytes) == SM_OK);
+			assert(smTrajectoryFillAndReceive(&traj, &axis, freeBytes, &numFilled, &numReceived, received) == SM_OK);
+			for (i = 0; i < numReceived; i++, checked++) {
+				if (checked % 100 == 0) {
+					while (reference_moves < 50 && smTrajectoryGetFreePieces(&reference) >= 7)
+						assert(smTrajectoryAppendMove(&reference, reference_moves++ % 2 ? 0 : 20000, 100000, 1000000, 20000000) == SM_OK);
+					assert(smTrajectoryGenerate(&reference, 100, expected) > 0);
+				}
+				assert(received[i] == expected[checked % 100]);
+			}
+			if (moves == 50 && numFilled == 0 && axis.numberOfPendingReadPackets == 0)
+				break;
+		}
+		assert(checked > 50 * 200);
+		assert(simDevice.nodes[NODE].params[SMP_ABSOLUTE_SETPOINT] == 0);
+		assert(smBufferedDeinit(&axis) == SM_OK);
+		assert(getCumulativeStatus(handle) == SM_OK);
+		assert(smCloseBus(handle) == SM_OK);
+	}
+	return 0;
+}
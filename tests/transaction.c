@@ -0,0 +1,125 @@
+// Verifies transaction objects: several transactions can be prepared and hold
+// return values at the same time without disturbing each other or the bus
+// command queue.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+#include "../user_options.h"
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smtransaction t1, t2, pool[SM_MAX_TRANSACTIONS];
+	smint32 value = 0;
+	int i;
+	assert(handle >= 0);
+
+	simDevice.nodes[1].params[SMP_STATUS] = 11;
+	simDevice.nodes[2].params[SMP_STATUS] = 22;
+
+	{
+		// prepare second transaction while first one has unread return values
+		t1 = smAllocateTransaction(handle);
+		t2 = smAllocateTransaction(handle);
+		assert(t1 >= 0 && t2 >= 0 && t1 != t2);
+
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smAppendSetParamCommandToTransaction(t1, SMP_TRAJ_PLANNER_VEL, 5000) == SM_OK);
+		assert(smExecuteTransaction(t1, 1) == SM_OK);
+		assert(simDevice.nodes[1].params[SMP_TRAJ_PLANNER_VEL] == 5000);
+
+		assert(smAppendGetParamCommandToTransaction(t2, SMP_STATUS) == SM_OK);
+		// bus command queue is independent too
+		assert(smRead1Parameter(handle, 2, SMP_STATUS, &value) == SM_OK);
+		assert(value == 22);
+		assert(smExecuteTransaction(t2, 2) == SM_OK);
+
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 11);
+		assert(smGetTransactionSetParamReturnValue(t1, &value) == SM_OK);
+		assert(smGetTransactionSMCommandReturnValue(t1, &value) == SM_ERR_LENGTH);
+		assert(smGetTransactionGetParamReturnValue(t2, &value) == SM_OK);
+		assert(value == 22);
+	}
+
+	{
+		// commands appended to bus command queue before transaction are sent as they were
+		simDevice.nodes[2].params[SMP_TRAJ_PLANNER_VEL] = 777;
+		assert(smAppendGetParamCommandToQueue(handle, SMP_TRAJ_PLANNER_VEL) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smExecuteTransaction(t1, 1) == SM_OK);
+		assert(smExecuteCommandQueue(handle, 2) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+		assert(value == 777);
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 11);
+
+		// and return values of queue executed before transaction are kept
+		assert(smAppendGetParamCommandToQueue(handle, SMP_TRAJ_PLANNER_VEL) == SM_OK);
+		assert(smExecuteCommandQueue(handle, 2) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_STATUS) == SM_OK);
+		assert(smExecuteTransaction(t1, 1) == SM_OK);
+		assert(smGetQueuedGetParamReturnValue(handle, &value) == SM_OK);
+		assert(value == 777);
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 11);
+	}
+
+	{
+		// reuse after execution clears old commands
+		resetCumulativeStatus(handle);
+		assert(smAppendGetParamCommandToTransaction(t1, SMP_TRAJ_PLANNER_VEL) == SM_OK);
+		assert(smExecuteTransaction(t1, 1) == SM_OK);
+		assert(smGetTransactionGetParamReturnValue(t1, &value) == SM_OK);
+		assert(value == 5000);
+		assert(smGetTransactionSMCommandReturnValue(t1, &value) == SM_ERR_LENGTH);
+		resetCumulativeStatus(handle);
+	}
+
+	{
+		// payload overflow
+		smtransaction t = t2;
+		for (i = 0; i < 20; i++)
+			assert(smAppendSetParamCommandToTransaction(t, SMP_TRAJ_PLANNER_VEL, i) == SM_OK);
+		assert(smAppendSetParamCommandToTransaction(t, SMP_TRAJ_PLANNER_VEL, i) == SM_ERR_LENGTH);
+		// nothing of overflowed transaction is sent
+		simDevice.framesReceived = 0;
+		assert(smExecuteTransaction(t, 1) == SM_ERR_LENGTH);
+		assert(simDevice.framesReceived == 0);
+		assert(simDevice.nodes[1].params[SMP_TRAJ_PLANNER_VEL] == 5000);
+		resetCumulativeStatus(handle);
+
+		// group that fits only partially, address of get is left out
+		for (i = 0; i < 28; i++)
+			assert(smAppendSMCommandToTransaction(t, SMPCMD_32B, 0) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(t, SMP_STATUS) & SM_ERR_LENGTH);
+		assert(smSubmitTransaction(t, 1, NULL, NULL) == SM_OK);
+		assert(smPoll(handle) == SM_OK);
+		assert(smGetTransactionStatus(t) == SM_ERR_LENGTH);
+		assert(simDevice.framesReceived == 0);
+		resetCumulativeStatus(handle);
+
+		// next append after execution starts over
+		assert(smAppendGetParamCommandToTransaction(t, SMP_STATUS) == SM_OK);
+		assert(smExecuteTransaction(t, 1) == SM_OK);
+		assert(smGetTransactionGetParamReturnValue(t, &value) == SM_OK);
+		assert(value == 11);
+	}
+
+	{
+		// pool exhaustion and freeing
+		assert(smFreeTransaction(t1) == SM_OK);
+		assert(smFreeTransaction(t2) == SM_OK);
+		assert(smFreeTransaction(t2) == SM_ERR_PARAMETER);
+		for (i = 0; i < SM_MAX_TRANSACTIONS; i++)
+			assert((pool[i] = smAllocateTransaction(handle)) >= 0);
+		assert(smAllocateTransaction(handle) == -1);
+		assert(smFreeTransaction(pool[0]) == SM_OK);
+		assert(smAppendGetParamCommandToTransaction(pool[0], SMP_STATUS) != SM_OK);
+		assert(smAllocateTransaction(handle) >= 0);
+		resetCumulativeStatus(handle);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	assert(smExecuteTransaction(pool[1], 1) == SM_ERR_PARAMETER);
+	return 0;
+}
@@ -0,0 +1,116 @@
+// Verifies smWriteParameters: values are written in few packets, narrow values use
+// 24 bit subpackets and execution status of every write is reported.
+#include <stdio.h>
+#include <assert.h>
+#include "devicesim.h"
+
+#define NUM_PARAMS 46
+
+int main(void) {
+	smbus handle = simOpenBus();
+	smint16 ids[NUM_PARAMS];
+	smint32 vals[NUM_PARAMS], statuses[NUM_PARAMS];
+	int i;
+	assert(handle >= 0);
+
+	for (i = 0; i < NUM_PARAMS; i++)
+		ids[i] = 2000 + i;
+
+	{
+		// 24 bit values pack more per packet than 32 bit ones
+		for (i = 0; i < NUM_PARAMS; i++)
+			vals[i] = (i & 1) ? -i : (1 << 21) - 1 - i;
+		simDevice.framesReceived = 0;
+		assert(smWriteParameters(handle, 5, ids, vals, statuses, NUM_PARAMS) == SM_OK);
+		assert(simDevice.framesReceived == 2);
+		for (i = 0; i < NUM_PARAMS; i++) {
+			assert(simDevice.nodes[5].params[ids[i]] == vals[i]);
+			assert(statuses[i] == SMP_CMD_STATUS_ACK);
+		}
+
+		for (i = 0; i < NUM_PARAMS; i++)
+			vals[i] = (i & 1) ? -(1 << 21) - 1 - i : 100000000 + i;
+		simDevice.framesReceived = 0;
+		assert(smWriteParameters(handle, 5, ids, vals, NULL, NUM_PARAMS) == SM_OK);
+		assert(simDevice.framesReceived == 3);
+		for (i = 0; i < NUM_PARAMS; i++)
+			assert(simDevice.nodes[5].params[ids[i]] == vals[i]);
+	}
+
+	{
+		// rejected writes are reported per parameter
+		simDevice.nodes[5].readOnly[ids[3]] = 1;
+		simDevice.nodes[5].readOnly[ids[40]] = 1;
+		for (i = 0; i < NUM_PARAMS; i++)
+			vals[i] = i;
+		assert(smWriteParameters(handle, 5, ids, vals, statuses, NUM_PARAMS) == SM_ERR_PARAMETER);
+		for (i = 0; i < NUM_PARAMS; i++) {
+			assert(statuses[i] == ((i == 3 || i == 40) ? SMP_CMD_STATUS_NACK : SMP_CMD_STATUS_ACK));
+			if (i != 3 && i != 40)
+				assert(simDevice.nodes[5].params[ids[i]] == i);
+		}
+		resetCumulativeStatus(handle);
+	}
+
+	{
+		// repeated writes to same address don't resend it, also over packet boundary
+		smint16 same[30];
+		for (i = 0; i < 30; i++) {
+			same[i] = 3000;
+			vals[i] = i;
+		}
+		simDevice.bytesWritten = 0;
+		simDevice.framesReceived = 0;
+		assert(smWriteParameters(handle, 5, same, vals, statuses, 30) == SM_OK);
+		assert(simDevice.framesReceived == 1);
+		assert(simDevice.bytesWritten == 5 + 5 + 2 + 30 * 3);
+		assert(simDevice.nodes[5].params[3000] == 29);
+		for (i = 0; i < 30; i++)
+			assert(statuses[i] == SMP_CMD_STATUS_ACK);
+	}
+
+	{
+		// block of consecutive addresses (torque biquad coefficients) needs address for every
+		// value, only status return length is sent once
+		smint16 block[10];
+		for (i = 0; i < 10; i++) {
+			block[i] = SMP_TORQUE_BIQUAD_FILTER1_B0 + i;
+			vals[i] = 1000 * i - 4000;
+		}
+		simDevice.bytesWritten = 0;
+		assert(smWriteParameters(handle, 5, block, vals, statuses, 10) == SM_OK);
+		assert(simDevice.bytesWritten == 5 + 5 + 10 * 5);
+		for (i = 0; i < 10; i++)
+			assert(simDevice.nodes[5].params[block[i]] == vals[i]);
+	}
+
+	{
+		// status return length is set only in first packet of call
+		for (i = 0; i < NUM_PARAMS; i++)
+			vals[i] = i;
+		simDevice.nodes[5].readOnly[ids[3]] = 0;
+		simDevice.nodes[5].readOnly[ids[40]] = 0;
+		simDevice.bytesWritten = 0;
+		assert(smWriteParameters(handle, 5, ids, vals, statuses, NUM_PARAMS) == SM_OK);
+		assert(simDevice.bytesWritten == 2 * 5 + 5 + NUM_PARAMS * 5);
+	}
+
+	{
+		// parameter reads work after device was left returning statuses
+		smint32 value;
+		assert(smRead1Parameter(handle, 5, ids[7], &value) == SM_OK);
+		assert(value == 7);
+	}
+
+	{
+		// broadcast and missing node
+		assert(smWriteParameters(handle, 0, ids, vals, statuses, 2) == SM_OK);
+		assert(statuses[0] == SMP_CMD_STATUS_ACK && statuses[1] == SMP_CMD_STATUS_ACK);
+		assert(smWriteParameters(handle, SIM_MAX_NODES + 1, ids, vals, statuses, 2) & SM_ERR_COMMUNICATION);
+		assert(statuses[0] == SMP_CMD_STATUS_NACK && statuses[1] == SMP_CMD_STATUS_NACK);
+		resetCumulativeStatus(handle);
+	}
+
+	assert(smCloseBus(handle) == SM_OK);
+	return 0;
+}
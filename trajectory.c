@@ -0,0 +1,212 @@
+#include <string.h>
+#include <math.h>
+#include "simplemotion.h"
+#include "user_options.h"
+#include "simplemotion_private.h"
+#include "trajectory.h"
+
+//durations shorter than this are treated as zero, avoids pieces that come from rounding errors
+#define TRAJECTORY_MIN_DURATION 1e-9
+
+SM_STATUS smTrajectoryInit( TrajectoryGenerator *traj, smint32 sampleRate, double startPosition )
+{
+    //value out of range, same limits as in smBufferedInit
+    if(sampleRate<1 || sampleRate>2500)
+        return SM_ERR_PARAMETER;
+
+    memset(traj,0,sizeof(*traj));
+    traj->samplerate=sampleRate;
+    traj->sampleTime=1.0/sampleRate;
+    traj->endPosition=startPosition;
+    traj->endVelocity=0;
+    traj->piecesHead=0;
+    traj->piecesLen=0;
+    traj->time=0;
+    traj->endReached=smtrue;//standing at start position, nothing to output
+    traj->lookaheadLen=0;
+    return SM_OK;
+}
+
+int smTrajectoryGetFreePieces( TrajectoryGenerator *traj )
+{
+    return SM_TRAJECTORY_MAX_PIECES-traj->piecesLen;
+}
+
+//add piece to end of queue, caller has checked that there is room
+static void smTrajectoryPushPiece( TrajectoryGenerator *traj, double duration, double c0, double c1, double c2, double c3 )
+{
+    TrajectoryPiece *piece=&traj->pieces[(traj->piecesHead+traj->piecesLen)%SM_TRAJECTORY_MAX_PIECES];
+
+    piece->duration=duration;
+    piece->c[0]=c0;
+    piece->c[1]=c1;
+    piece->c[2]=c2;
+    piece->c[3]=c3;
+    traj->piecesLen++;
+    traj->endReached=smfalse;
+}
+
+SM_STATUS smTrajectoryAppendMove( TrajectoryGenerator *traj, double position, double maxVelocity, double maxAcceleration, double maxJerk )
+{
+    double distance=fabs(position-traj->endPosition), direction=position<traj->endPosition ? -1 : 1;
+    double velocity=maxVelocity, acceleration=maxAcceleration, jerk=maxJerk;
+    double jerkTime, accelerationTime, phaseTime[7], p, v, a;
+    static const double phaseJerk[7]={1,0,-1,0,-1,0,1};
+    int i, numPieces=0;
+
+    if(!(maxVelocity>0) || !(maxAcceleration>0) || !(maxJerk>0) || traj->endVelocity!=0)
+        return SM_ERR_PARAMETER;
+    if(distance==0)
+        return SM_OK;
+
+    //S-curve accelerates to velocity in time accelerationTime, and decelerates symmetrically, moving velocity*accelerationTime
+    //in total. acceleration ramps up and down with jerk in jerkTime. if velocity is low, acceleration never reaches its limit
+    if(velocity*jerk>=acceleration*acceleration)
+    {
+        jerkTime=acceleration/jerk;
+        accelerationTime=velocity/acceleration+jerkTime;
+    }
+    else
+    {
+        jerkTime=sqrt(velocity/jerk);
+        accelerationTime=2*jerkTime;
+    }
+
+    //move too short to reach velocity, solve peak velocity from distance=velocity*accelerationTime
+    if(velocity*accelerationTime>distance)
+    {
+        velocity=acceleration/2*(-acceleration/jerk+sqrt(acceleration*acceleration/(jerk*jerk)+4*distance/acceleration));
+        if(velocity*jerk>=acceleration*acceleration)
+        {
+            jerkTime=acceleration/jerk;
+            accelerationTime=velocity/acceleration+jerkTime;
+        }
+        else
+        {
+            velocity=pow(distance*distance*jerk/4,1.0/3.0);
+            jerkTime=sqrt(velocity/jerk);
+            accelerationTime=2*jerkTime;
+        }
+    }
+
+    //jerk up, constant acceleration, jerk down, constant velocity and the same in reverse for deceleration
+    phaseTime[0]=phaseTime[2]=phaseTime[4]=phaseTime[6]=jerkTime;
+    phaseTime[1]=phaseTime[5]=accelerationTime-2*jerkTime;
+    phaseTime[3]=(distance-velocity*accelerationTime)/velocity;
+    for(i=0;i<7;i++)
+    {
+        if(phaseTime[i]<TRAJECTORY_MIN_DURATION)
+            phaseTime[i]=0;
+        else
+            numPieces++;
+    }
+    if(numPieces>smTrajectoryGetFreePieces(traj))
+        return SM_ERR_LENGTH;
+
+    //each phase has constant jerk, so position is a cubic of time in it
+    p=traj->endPosition;
+    v=0;
+    a=0;
+    for(i=0;i<7;i++)
+    {
+        double t=phaseTime[i], j=phaseJerk[i]*jerk*direction;
+        if(t==0)
+            continue;
+        smTrajectoryPushPiece(traj,t,p,v,a/2,j/6);
+        p+=v*t+a*t*t/2+j*t*t*t/6;
+        v+=a*t+j*t*t/2;
+        a+=j*t;
+    }
+
+    //next segment starts from exact target, not from accumulated rounding errors
+    traj->endPosition=position;
+    traj->endVelocity=0;
+    return SM_OK;
+}
+
+SM_STATUS smTrajectoryAppendPVT( TrajectoryGenerator *traj, double position, double velocity, double duration )
+{
+    double p0=traj->endPosition, v0=traj->endVelocity, t=duration;
+
+    if(!(duration>=TRAJECTORY_MIN_DURATION))
+        return SM_ERR_PARAMETER;
+    if(smTrajectoryGetFreePieces(traj)<1)
+        return SM_ERR_LENGTH;
+
+    //cubic Hermite polynomial, position and velocity match at both ends
+    smTrajectoryPushPiece(traj,t,p0,v0,(3*(position-p0)-(2*v0+velocity)*t)/(t*t),(2*(p0-position)+(v0+velocity)*t)/(t*t*t));
+    traj->endPosition=position;
+    traj->endVelocity=velocity;
+    return SM_OK;
+}
+
+SM_STATUS smTrajectoryAppendDwell( TrajectoryGenerator *traj, double duration )
+{
+    if(!(duration>=TRAJECTORY_MIN_DURATION) || traj->endVelocity!=0)
+        return SM_ERR_PARAMETER;
+    if(smTrajectoryGetFreePieces(traj)<1)
+        return SM_ERR_LENGTH;
+
+    smTrajectoryPushPiece(traj,duration,traj->endPosition,0,0,0);
+    return SM_OK;
+}
+
+static smint32 smTrajectoryRound( double position )
+{
+    return (smint32)floor(position+0.5);
+}
+
+smint32 smTrajectoryGenerate( TrajectoryGenerator *traj, smint32 maxPoints, smint32 *points )
+{
+    smint32 n=0;
+
+    while(n<maxPoints)
+    {
+        const TrajectoryPiece *piece;
+        double t;
+
+        //skip pieces that have been sampled to the end. time is kept relative to start of next piece so that sample
+        //interval stays exact over piece boundaries
+        while(traj->piecesLen>0 && traj->time>=traj->pieces[traj->piecesHead].duration)
+        {
+            traj->time-=traj->pieces[traj->piecesHead].duration;
+            traj->piecesHead=(traj->piecesHead+1)%SM_TRAJECTORY_MAX_PIECES;
+            traj->piecesLen--;
+        }
+
+        //end position of queue is output once, as sampling usually doesn't hit it exactly
+        if(traj->piecesLen==0)
+        {
+            if(traj->endReached==smtrue)
+                break;
+            points[n++]=smTrajectoryRound(traj->endPosition);
+            traj->endReached=smtrue;
+            traj->time+=traj->sampleTime;
+            continue;
+        }
+
+        piece=&traj->pieces[traj->piecesHead];
+        t=traj->time;
+        points[n++]=smTrajectoryRound(((piece->c[3]*t+piece->c[2])*t+piece->c[1])*t+piece->c[0]);
+        traj->time+=traj->sampleTime;
+    }
+    return n;
+}
+
+SM_STATUS smTrajectoryFillAndReceive( TrajectoryGenerator *traj, BufferedMotionAxis *axis, smint32 numBytesFree, smint32 *numFilledPoints, smint32 *numReceivedPoints, smint32 *receivedPoints )
+{
+    smint32 n, bytesFilled;
+    SM_STATUS stat;
+
+    //generate only as many points as may fit, so memory use doesn't depend on the length of trajectory
+    traj->lookaheadLen+=smTrajectoryGenerate(traj,SM_TRAJECTORY_LOOKAHEAD-traj->lookaheadLen,traj->lookahead+traj->lookaheadLen);
+    n=smBufferedGetMaxFillSizeForPoints(axis,numBytesFree,traj->lookaheadLen,traj->lookahead);
+
+    stat=smBufferedFillAndReceive(axis,n,traj->lookahead,numReceivedPoints,receivedPoints,&bytesFilled);
+
+    //points are consumed even if fill failed. device may have executed them, and axis sends next point as absolute
+    memmove(traj->lookahead,traj->lookahead+n,(traj->lookaheadLen-n)*sizeof(smint32));
+    traj->lookaheadLen-=n;
+    *numFilledPoints=n;
+    return stat;
+}
@@ -0,0 +1,91 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "simplemotion.h"
+#include "bufferedmotion.h"
+
+/* Trajectory generator produces buffered motion setpoints from motion segments on the fly, so that paths of any
+ * length can be streamed with constant memory. Segments are queued with:
+ * -smTrajectoryAppendMove: jerk limited point to point move that starts and ends at rest (S-curve with limited
+ *  velocity, acceleration and jerk)
+ * -smTrajectoryAppendPVT: move to position with velocity in given time. position is a cubic polynomial of time
+ *  between points, so a series of PVT points makes a smooth spline
+ * -smTrajectoryAppendDwell: stay in place for given time
+ *
+ * Segments are stored as polynomial pieces of time in a queue of SM_TRAJECTORY_MAX_PIECES pieces. A move takes up to
+ * 7 pieces and others one. Append returns SM_ERR_LENGTH and doesn't modify the queue if it doesn't fit, so segments
+ * can be appended lazily between fills until append fails.
+ *
+ * Setpoints are sampled at the samplerate given to smTrajectoryInit, which should be the same as given to
+ * smBufferedInit. Units are the same as of the setpoints (i.e. encoder counts, counts/s, counts/s^2 and counts/s^3).
+ * When the queue runs empty, end position of last segment is output once and generation stops until more segments
+ * are appended.
+ *
+ * Typical use:
+ *
+ * smBufferedInit(&axis,...);
+ * axis.incrementalSetpoints=smtrue;//optional, small steps take 3 bytes instead of 4
+ * smTrajectoryInit(&traj,axis.samplerate,startPosition);
+ * smBufferedRunAndSyncClocks(&axis);
+ * while(!done)
+ * {
+ *     while(more segments && smTrajectoryAppendMove(&traj,...)==SM_OK) next segment;
+ *     smBufferedGetFreeEstimate(&axis,&freeBytes);
+ *     smTrajectoryFillAndReceive(&traj,&axis,freeBytes,&numFilled,&numReceived,received);
+ * }
+ */
+
+#define SM_TRAJECTORY_MAX_PIECES 32
+//points generated ahead of fill, as many as fit in one fill (120 bytes) when sent as 3 byte increments
+#define SM_TRAJECTORY_LOOKAHEAD 40
+
+typedef struct _TrajectoryPiece {
+    double duration;//seconds
+    double c[4];//position is c[0]+c[1]*t+c[2]*t^2+c[3]*t^3 where t is time from start of piece
+} TrajectoryPiece;
+
+typedef struct _TrajectoryGenerator {
+    smint32 samplerate;
+    double sampleTime;//1/samplerate
+    double endPosition;//end position of last appended segment
+    double endVelocity;//end velocity of last appended segment
+
+    //queue of pieces that have not been sampled to the end yet
+    TrajectoryPiece pieces[SM_TRAJECTORY_MAX_PIECES];
+    int piecesHead, piecesLen;
+    double time;//time of next sample from start of first piece in queue
+    smbool endReached;//end position has been output after queue went empty
+
+    //points that have been generated but not filled yet
+    smint32 lookahead[SM_TRAJECTORY_LOOKAHEAD];
+    int lookaheadLen;
+} TrajectoryGenerator;
+
+/** Initialize generator to stand at startPosition. sampleRate is in Hz, 1-2500. */
+LIB SM_STATUS smTrajectoryInit( TrajectoryGenerator *traj, smint32 sampleRate, double startPosition );
+/** Append rest to rest move from end of previous segment to position. Velocity, acceleration and jerk are limited
+ * to maxVelocity, maxAcceleration and maxJerk, which must be positive. Previous segment must end at zero velocity. */
+LIB SM_STATUS smTrajectoryAppendMove( TrajectoryGenerator *traj, double position, double maxVelocity, double maxAcceleration, double maxJerk );
+/** Append move from end of previous segment to position so that velocity at the end is velocity, in duration seconds */
+LIB SM_STATUS smTrajectoryAppendPVT( TrajectoryGenerator *traj, double position, double velocity, double duration );
+/** Append stop at end position of previous segment for duration seconds. Previous segment must end at zero velocity. */
+LIB SM_STATUS smTrajectoryAppendDwell( TrajectoryGenerator *traj, double duration );
+/** Number of pieces that can still be appended, a move needs up to 7 and PVT and dwell one */
+LIB int smTrajectoryGetFreePieces( TrajectoryGenerator *traj );
+/** Generate up to maxPoints next setpoints to points. Returns number of points generated, which is less than
+ * maxPoints only if queue runs empty. */
+LIB smint32 smTrajectoryGenerate( TrajectoryGenerator *traj, smint32 maxPoints, smint32 *points );
+/** Fill axis with next setpoints of trajectory, as many as fit in numBytesFree bytes of device buffer and in one fill,
+ * and receive return data like smBufferedFillAndReceive. numFilledPoints is set to number of points filled. Points that
+ * don't fit are kept for next call. If fill fails, its points are not filled again: they may or may not have been
+ * executed, and next fill resyncs the device with an absolute setpoint (see smBufferedFillAndReceive). */
+LIB SM_STATUS smTrajectoryFillAndReceive( TrajectoryGenerator *traj, BufferedMotionAxis *axis, smint32 numBytesFree, smint32 *numFilledPoints, smint32 *numReceivedPoints, smint32 *receivedPoints );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TRAJECTORY_H
@@ -9,9 +9,40 @@
 // Commenting out this will also disable smDescribe* functions.
 #define ENABLE_DEBUG_PRINTS
 
+//most verbose debug print level that is compiled in, one of smVerbosityLevel values. prints above it are removed at
+//compile time, so i.e. SMDebugLow keeps error prints in release builds without the cost of the frequent ones.
+//may also be defined with compiler flag, i.e. -DSM_DEBUG_COMPILE_LEVEL=SMDebugLow
+#ifndef SM_DEBUG_COMPILE_LEVEL
+#define SM_DEBUG_COMPILE_LEVEL SMDebugTrace
+#endif
+
 //max number of simultaneously opened buses. change this and recompiple SMlib if
 //necessary (to increase channels or reduce to save memory)
 #define SM_MAX_BUSES 10
 
+//max number of nodes in one pipelined transaction per bus (see smExecutePipeline). each node reserves
+//a payload buffer of 120 bytes for every bus, so reduce this to save memory
+#define SM_MAX_PIPELINED_NODES 16
+
+//size of per-bus pool of transaction objects (see smAllocateTransaction). each transaction reserves
+//240 bytes of tx & rx buffers for every bus
+#define SM_MAX_TRANSACTIONS 4
+
+//number of parameters that one smParamCache can hold. each entry takes 12 bytes
+#define SM_PARAM_CACHE_SIZE 64
+
+//comment out to disable round trip latency histograms (see smGetBusStatistics). they take ~2.6 kB of memory per bus
+//and a clock read per command
+#define ENABLE_LATENCY_STATISTICS
+
+//comment out to disable binary protocol trace (see eventtrace.h). each bus reserves a ring of SM_TRACE_EVENTS
+//events of 20 bytes, the number must be a power of two
+#define ENABLE_EVENT_TRACE
+#define SM_TRACE_EVENTS 256
+
+//uncomment to make bus handles thread safe with per-bus locks (see smLockBus). requires pthreads or win32, on
+//unix link application with -pthread. may also be defined with compiler flag, i.e. -DENABLE_BUS_LOCKING
+//#define ENABLE_BUS_LOCKING
+
 
 #endif // USER_OPTIONS_H